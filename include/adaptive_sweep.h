@@ -0,0 +1,6 @@
+#ifndef FILTOPT_ADAPTIVE_SWEEP
+#define FILTOPT_ADAPTIVE_SWEEP
+
+void init_adaptive_sweep(void);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef FILTOPT_AFFINE_BOUNDS
+#define FILTOPT_AFFINE_BOUNDS
+
+void init_affine_bounds(void);
+
+#endif
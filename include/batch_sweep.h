@@ -0,0 +1,27 @@
+#ifndef FILTOPT_BATCH_SWEEP
+#define FILTOPT_BATCH_SWEEP
+
+#include <complex.h>
+#include <stddef.h>
+
+#include "flat_filter.h"
+#include "two_port_network.h"
+
+void init_batch_sweep(void);
+void batch_filter_gains(
+    FlatFilter **filters, 
+    size_t filter_count, 
+    const double *angular_frequencies, 
+    size_t frequency_count, 
+    double complex *gains
+);
+void batch_filter_networks(
+    FlatFilter **filters, 
+    size_t filter_count, 
+    const double *angular_frequencies, 
+    size_t frequency_count, 
+    TwoPortNetwork *networks
+);
+FlatFilter **compile_filters(SCM filters, int position, const char *subr);
+
+#endif
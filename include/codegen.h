@@ -0,0 +1,10 @@
+#ifndef FILTOPT_CODEGEN
+#define FILTOPT_CODEGEN
+
+#include <libguile.h>
+
+extern SCM filter_kernel_type;
+
+void init_filter_kernel_type(void);
+
+#endif
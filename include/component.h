@@ -4,11 +4,36 @@
 #include <complex.h>
 #include <libguile.h>
 
+typedef enum {
+    RESISTOR_COMPONENT,
+    CAPACITOR_COMPONENT,
+    INDUCTOR_COMPONENT
+} ComponentKind;
+
 extern SCM component_type;
+extern SCM resistor_symbol;
+extern SCM capacitor_symbol;
+extern SCM inductor_symbol;
 
 void init_component_type(void);
+SCM make_component(
+    SCM type, 
+    SCM value, 
+    SCM lower_limit, 
+    SCM upper_limit, 
+    SCM is_connected,
+    SCM prng
+);
+ComponentKind component_kind(SCM component);
 double complex component_impedance(double angular_frequency, SCM component);
 SCM duplicate_component(SCM component);
 SCM component_random_update(SCM component);
+SCM get_component_value(SCM component);
+SCM get_component_type(SCM component);
+SCM get_component_lower_limit(SCM component);
+SCM get_component_upper_limit(SCM component);
+SCM get_component_is_connected(SCM component);
+SCM set_component_is_connected(SCM is_connected, SCM component);
+SCM get_component_prng(SCM component);
 
 #endif
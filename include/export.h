@@ -0,0 +1,6 @@
+#ifndef FILTOPT_EXPORT
+#define FILTOPT_EXPORT
+
+void init_export(void);
+
+#endif
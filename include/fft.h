@@ -0,0 +1,15 @@
+#ifndef FILTOPT_FFT
+#define FILTOPT_FFT
+
+#include <complex.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * In-place discrete Fourier transform of any length. The inverse is
+ * unscaled (no 1/n factor). Returns false if memory for a plan or the work
+ * buffer cannot be allocated. Safe to call from any thread.
+ */
+bool fft(double complex *values, size_t count, bool inverse);
+
+#endif
@@ -6,6 +6,15 @@
 #include "load.h"
 #include "two_port_network.h"
 
+extern SCM filter_stage_type;
+extern SCM series_filter_symbol;
+extern SCM shunt_filter_symbol;
+
 void init_filter_stage_type(void);
+SCM make_series_filter_stage(SCM load);
+SCM make_shunt_filter_stage(SCM load);
+SCM get_filter_stage_type(SCM filter_stage);
+SCM get_filter_stage_load(SCM filter_stage);
+void get_filter_network(TwoPortNetwork *network, double angular_frequency, SCM stages);
 
 #endif
@@ -0,0 +1,71 @@
+#ifndef FILTOPT_FLAT_FILTER
+#define FILTOPT_FLAT_FILTER
+
+#include <complex.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <libguile.h>
+
+#include "component.h"
+#include "two_port_network.h"
+
+/*
+ * A flat filter is a plain C copy of a vector of filter stages. It holds no
+ * SCM values, so it can be evaluated on threads that are not in Guile mode.
+ * Load trees are stored in prefix order and visited in the same order as
+ * load_impedance, which keeps the arithmetic identical to the SCM path.
+ */
+
+typedef struct {
+    ComponentKind kind;
+    int rank;
+    int lower_rank;
+    int upper_rank;
+    bool is_connected;
+    double value;
+} FlatComponent;
+
+typedef enum {
+    COMPONENT_NODE,
+    SERIES_NODE,
+    PARALLEL_NODE
+} FlatNodeKind;
+
+typedef struct {
+    FlatNodeKind kind;
+    size_t operand; /* Component index, or number of children. */
+} FlatNode;
+
+typedef enum {
+    SERIES_STAGE,
+    SHUNT_STAGE
+} FlatStageKind;
+
+typedef struct {
+    FlatStageKind kind;
+    size_t first_node;
+    size_t node_count;
+} FlatStage;
+
+typedef struct {
+    size_t component_count;
+    size_t node_count;
+    size_t stage_count;
+    FlatComponent *components;
+    FlatNode *nodes;
+    FlatStage *stages;
+} FlatFilter;
+
+FlatFilter *compile_filter(SCM stages);
+FlatFilter *copy_flat_filter(const FlatFilter *filter);
+void store_flat_filter_state(const FlatFilter *filter, SCM stages);
+void flatten_component(SCM component, FlatComponent *flat_component);
+void set_flat_component_rank(FlatComponent *component, int rank);
+
+double complex flat_component_impedance(double angular_frequency, const FlatComponent *component);
+double complex flat_stage_impedance(double angular_frequency, const FlatFilter *filter, size_t stage);
+void flat_stage_network(TwoPortNetwork *network, double angular_frequency, const FlatFilter *filter, size_t stage);
+void flat_filter_network(TwoPortNetwork *network, double angular_frequency, const FlatFilter *filter);
+double complex flat_filter_voltage_gain(double angular_frequency, const FlatFilter *filter);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef FILTOPT_HASH
+#define FILTOPT_HASH
+
+#include <stdint.h>
+
+static inline uint64_t hash_combine(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    return hash ^ (hash >> 31);
+}
+
+#endif
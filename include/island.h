@@ -0,0 +1,6 @@
+#ifndef FILTOPT_ISLAND
+#define FILTOPT_ISLAND
+
+void init_island_search(void);
+
+#endif
@@ -6,8 +6,17 @@
 #include "component.h"
 
 extern SCM load_type;
+extern SCM component_load_symbol;
+extern SCM series_load_symbol;
+extern SCM parallel_load_symbol;
 
 void init_load_type(void);
+SCM make_component_load(SCM component);
+SCM make_series_load(SCM loads);
+SCM make_parallel_load(SCM loads);
+SCM get_load_type(SCM load);
+SCM get_load_elements(SCM load);
+_Noreturn void invalid_load_type_error(void);
 double complex load_impedance(double angular_frequency, SCM load);
 double complex admittance(double angular_frequency, SCM load);
 SCM duplicate_load(SCM load);
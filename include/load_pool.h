@@ -0,0 +1,11 @@
+#ifndef FILTOPT_LOAD_POOL
+#define FILTOPT_LOAD_POOL
+
+#include <libguile.h>
+
+extern SCM load_pool_type;
+extern SCM pooled_filter_type;
+
+void init_load_pool_type(void);
+
+#endif
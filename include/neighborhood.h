@@ -0,0 +1,26 @@
+#ifndef FILTOPT_NEIGHBORHOOD
+#define FILTOPT_NEIGHBORHOOD
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "flat_filter.h"
+#include "response_target.h"
+
+typedef struct {
+    size_t component;
+    int rank_delta;
+    bool toggles_connection;
+    double cost;
+} NeighborMove;
+
+void init_neighborhood(void);
+size_t scan_neighborhood(
+    const FlatFilter *filter, 
+    const ResponseTarget *target, 
+    int radius, 
+    NeighborMove **moves
+);
+void apply_neighbor_move(FlatFilter *filter, const NeighborMove *move);
+
+#endif
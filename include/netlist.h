@@ -0,0 +1,6 @@
+#ifndef FILTOPT_NETLIST
+#define FILTOPT_NETLIST
+
+void init_netlist(void);
+
+#endif
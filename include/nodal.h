@@ -0,0 +1,52 @@
+#ifndef FILTOPT_NODAL
+#define FILTOPT_NODAL
+
+#include <complex.h>
+#include <stddef.h>
+#include <libguile.h>
+
+#include "flat_filter.h"
+
+/*
+ * A circuit given as a netlist of components between numbered nodes, driven
+ * by an ideal unit source at the input node with node 0 as ground. The
+ * source is eliminated, leaving a complex symmetric nodal admittance matrix
+ * over the remaining nodes. Its minimum-degree ordering and the schedule of
+ * LDL^T update operations are computed once per netlist; each evaluation
+ * only stamps the current component values and replays the schedule.
+ */
+
+typedef struct {
+    size_t diagonal[2];
+    size_t off_diagonal;
+    size_t source_row;
+} NodalStamp;
+
+typedef struct {
+    size_t element_count;
+    size_t unknown_count;
+    size_t output;
+    NodalStamp *stamps;
+    size_t entry_count;
+    size_t *diagonal;
+    size_t *column_starts;
+    size_t *column_rows;
+    size_t *column_entries;
+    size_t *update_starts;
+    size_t *updates;
+} NodalCircuit;
+
+extern SCM nodal_circuit_type;
+
+void init_nodal_circuit_type(void);
+NodalCircuit *get_nodal_circuit(SCM circuit);
+FlatComponent *flatten_nodal_components(SCM circuit);
+double complex nodal_voltage_gain(
+    const NodalCircuit *circuit, 
+    const FlatComponent *components, 
+    double angular_frequency, 
+    double complex *values, 
+    double complex *solution
+);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef FILTOPT_NUMERIC_VECTOR
+#define FILTOPT_NUMERIC_VECTOR
+
+#include <complex.h>
+#include <stddef.h>
+#include <libguile.h>
+
+double *double_array_from_vector(SCM vector, size_t *count, int position, const char *subr);
+SCM real_vector_from_array(const double *values, size_t count);
+SCM complex_vector_from_array(const double complex *values, size_t count);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef FILTOPT_PARETO_ARCHIVE
+#define FILTOPT_PARETO_ARCHIVE
+
+#include <libguile.h>
+
+extern SCM pareto_archive_type;
+
+void init_pareto_archive_type(void);
+
+#endif
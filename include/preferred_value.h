@@ -5,6 +5,13 @@ extern SCM preferred_component_value_type;
 
 void init_preferred_component_value_type(void);
 double evaluated_component_value(SCM preferred_value);
+double preferred_value_from_rank(int rank);
+int preferred_component_value_rank(SCM preferred_value);
+void set_preferred_component_value_rank(SCM preferred_value, int rank);
+int floor_preferred_value_rank(double value);
+int ceiling_preferred_value_rank(double value);
+int nearest_preferred_value_rank(double value);
+SCM make_preferred_component_value_from_rank(int rank);
 SCM duplicate_preferred_component_value(SCM preferred_value);
 SCM increment_component_value(SCM value); 
 SCM decrement_component_value(SCM value);
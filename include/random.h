@@ -1,4 +1,6 @@
 #include <libguile.h>
+#include <stdbool.h>
 
 void init_rng(void);
-unsigned long gen_random(SCM prng);
\ No newline at end of file
+unsigned long gen_random(SCM prng);
+bool gen_random_bool(SCM prng);
\ No newline at end of file
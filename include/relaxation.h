@@ -0,0 +1,6 @@
+#ifndef FILTOPT_RELAXATION
+#define FILTOPT_RELAXATION
+
+void init_relaxation(void);
+
+#endif
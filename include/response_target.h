@@ -0,0 +1,27 @@
+#ifndef FILTOPT_RESPONSE_TARGET
+#define FILTOPT_RESPONSE_TARGET
+
+#include <complex.h>
+#include <stddef.h>
+#include <libguile.h>
+
+#include "flat_filter.h"
+
+typedef struct {
+    size_t count;
+    double *angular_frequencies;
+    double *magnitudes;
+    double *weights;
+    double total_weight;
+} ResponseTarget;
+
+extern SCM response_target_type;
+
+void init_response_target_type(void);
+ResponseTarget *get_response_target(SCM target);
+double response_point_error(const ResponseTarget *target, size_t point, double complex gain);
+double response_error(const ResponseTarget *target, const double complex *gains);
+double flat_filter_cost(const FlatFilter *filter, const ResponseTarget *target);
+double filter_cost(SCM stages, const ResponseTarget *target);
+
+#endif
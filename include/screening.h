@@ -0,0 +1,10 @@
+#ifndef FILTOPT_SCREENING
+#define FILTOPT_SCREENING
+
+#include "flat_filter.h"
+#include "response_target.h"
+
+void init_screening(void);
+double single_precision_cost_bound(const FlatFilter *filter, const ResponseTarget *target);
+
+#endif
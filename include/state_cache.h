@@ -0,0 +1,15 @@
+#ifndef FILTOPT_STATE_CACHE
+#define FILTOPT_STATE_CACHE
+
+#include <stdint.h>
+#include <libguile.h>
+
+#include "flat_filter.h"
+
+extern SCM state_cache_type;
+
+void init_state_cache_type(void);
+uint64_t filter_state_hash(SCM stages);
+uint64_t flat_filter_state_hash(const FlatFilter *filter);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef FILTOPT_STEP_RESPONSE
+#define FILTOPT_STEP_RESPONSE
+
+void init_step_response(void);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef FILTOPT_SURROGATE
+#define FILTOPT_SURROGATE
+
+#include <libguile.h>
+
+extern SCM surrogate_type;
+
+void init_surrogate_type(void);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef FILTOPT_THREAD_POOL
+#define FILTOPT_THREAD_POOL
+
+#include <stddef.h>
+
+typedef void (*ParallelTask)(size_t index, void *context);
+
+size_t thread_pool_size(void);
+void parallel_for(size_t count, ParallelTask task, void *context);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef FILTOPT_TOPOLOGY
+#define FILTOPT_TOPOLOGY
+
+#include <stddef.h>
+#include <libguile.h>
+
+#include "flat_filter.h"
+#include "response_target.h"
+
+void init_topology(void);
+double descend_component_values(FlatFilter *filter, const ResponseTarget *target, size_t passes);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef FILTOPT_TRACE
+#define FILTOPT_TRACE
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+extern atomic_bool tracing_enabled;
+
+void init_trace(void);
+void record_trace_event(const char *name, char phase);
+void begin_trace_scope(const char *name);
+void end_trace_scope(void);
+
+/* Disabled tracing costs one relaxed load and a predictable branch. */
+#define TRACE_BEGIN(name) \
+    do { \
+        if (atomic_load_explicit(&tracing_enabled, memory_order_relaxed)) { \
+            record_trace_event((name), 'B'); \
+        } \
+    } while (0)
+
+#define TRACE_END(name) \
+    do { \
+        if (atomic_load_explicit(&tracing_enabled, memory_order_relaxed)) { \
+            record_trace_event((name), 'E'); \
+        } \
+    } while (0)
+
+/*
+ * TRACE_BEGIN/TRACE_END for spans around code that may exit non-locally
+ * (scm_error and friends): while tracing, the span lives in a dynwind
+ * context whose unwind handler ends it, so a raised error still leaves
+ * the trace balanced. Use at most one pair per block.
+ */
+#define TRACE_SCOPE_BEGIN(name) \
+    bool trace_scope_active = atomic_load_explicit(&tracing_enabled, memory_order_relaxed); \
+    if (trace_scope_active) { \
+        begin_trace_scope(name); \
+    }
+
+#define TRACE_SCOPE_END() \
+    do { \
+        if (trace_scope_active) { \
+            end_trace_scope(); \
+        } \
+    } while (0)
+
+#endif
@@ -2,6 +2,7 @@
 #define FILTOPT_TWO_PORT_NETWORK
 
 #include <complex.h>
+#include <stddef.h>
 
 typedef struct {
     double complex element11;
@@ -10,12 +11,28 @@ typedef struct {
     double complex element22;
 } TwoPortNetwork;
 
+typedef struct {
+    float complex element11;
+    float complex element12;
+    float complex element21;
+    float complex element22;
+} SinglePrecisionNetwork;
+
 double complex network_voltage_gain(TwoPortNetwork *matrix);
 
 void cascade_network(TwoPortNetwork *result, TwoPortNetwork *matrix1, TwoPortNetwork *matrix2);
+void cascade_networks(TwoPortNetwork *result, TwoPortNetwork *networks, size_t count);
+void parallel_cascade_networks(TwoPortNetwork *result, TwoPortNetwork *networks, size_t count);
+size_t parallel_cascade_crossover(void);
 void series_connected_network(TwoPortNetwork *matrix, complex impedance);
 void shunt_connected_network(TwoPortNetwork *matrix, complex impedance);
 void transformer_network(TwoPortNetwork *matrix, double turns_ratio);
 void identity_network(TwoPortNetwork *matrix);
 
+float complex network_voltage_gain_f(SinglePrecisionNetwork *matrix);
+void cascade_network_f(SinglePrecisionNetwork *result, SinglePrecisionNetwork *matrix1, SinglePrecisionNetwork *matrix2);
+void series_connected_network_f(SinglePrecisionNetwork *matrix, float complex impedance);
+void shunt_connected_network_f(SinglePrecisionNetwork *matrix, float complex impedance);
+void identity_network_f(SinglePrecisionNetwork *matrix);
+
 #endif
@@ -0,0 +1,283 @@
+#include <complex.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "adaptive_sweep.h"
+#include "flat_filter.h"
+#include "numeric_vector.h"
+
+/*
+ * Samples the response on a coarse logarithmic grid, then bisects (in log
+ * frequency) intervals whose midpoint departs from the straight line
+ * between its ends by more than the magnitude (dB) or phase (degree)
+ * tolerance. The midpoint error is a second difference, so intervals are
+ * refined where the response curves (resonances, notches, corners) and
+ * left coarse where it is flat or a straight asymptote.
+ *
+ * Intervals are refined worst first from a max-heap on their error relative
+ * to the tolerance, so a point budget that runs out is spent where the
+ * response is least resolved rather than on the lowest frequencies. An
+ * interval whose gain is finite at some of its three points but not at
+ * others brackets an exact notch or pole and is refined down to the depth
+ * limit; one with no finite gain at all (an open series component) is
+ * left alone. The coarse grid is always evaluated, so max_points must be
+ * at least INITIAL_POINTS.
+ */
+
+#define INITIAL_POINTS 33
+#define MAX_BISECTION_DEPTH 40
+#define DEFAULT_PHASE_TOLERANCE 1.0
+#define DEFAULT_MAX_POINTS 4096
+/* A half interval turning more than this may hide a full revolution. */
+#define MAX_HALF_INTERVAL_TURN 90.0
+#define DEGREES_PER_RADIAN (180.0 / 3.14159265358979323846)
+
+typedef struct {
+    double angular_frequency;
+    double complex gain;
+} SweepPoint;
+
+typedef struct {
+    double start_log;
+    double middle_log;
+    double end_log;
+    double complex start_gain;
+    double complex middle_gain;
+    double complex end_gain;
+    double error; /* Midpoint error over the tolerance; above 1 needs refinement. */
+    int depth;
+} SweepInterval;
+
+typedef struct {
+    const FlatFilter *filter;
+    double magnitude_tolerance;
+    double phase_tolerance;
+    size_t max_points;
+    size_t evaluations;
+    SweepPoint *points;
+    size_t count;
+    size_t capacity;
+    SweepInterval *heap;
+    size_t heap_count;
+    size_t heap_capacity;
+} AdaptiveSweep;
+
+SCM adaptive_sweep(
+    SCM stages, 
+    SCM min_angular_frequency, 
+    SCM max_angular_frequency, 
+    SCM magnitude_tolerance, 
+    SCM phase_tolerance, 
+    SCM max_points
+);
+
+void init_adaptive_sweep(void) {
+    __extension__
+    scm_c_define_gsubr("adaptive-sweep", 4, 2, 0, (scm_t_subr) adaptive_sweep);
+}
+
+static void *grow_array(void *array, size_t count, size_t *capacity, size_t size, const char *what) {
+    *capacity = *capacity == 0 ? 2 * INITIAL_POINTS : 2 * *capacity;
+    void *grown = scm_gc_malloc_pointerless(*capacity * size, what);
+    if (count > 0) {
+        memcpy(grown, array, count * size);
+    }
+    return grown;
+}
+
+static double complex evaluate_point(AdaptiveSweep *sweep, double log_frequency) {
+    double angular_frequency = pow(10.0, log_frequency);
+    double complex gain = flat_filter_voltage_gain(angular_frequency, sweep->filter);
+    if (sweep->count == sweep->capacity) {
+        sweep->points = grow_array(
+            sweep->points, sweep->count, &sweep->capacity, sizeof(SweepPoint), "adaptive sweep points"
+        );
+    }
+    sweep->points[sweep->count++] = (SweepPoint) {angular_frequency, gain};
+    sweep->evaluations++;
+    return gain;
+}
+
+static double magnitude_db(double complex gain) {
+    return 20.0 * log10(cabs(gain));
+}
+
+/*
+ * Largest of the magnitude and phase midpoint errors, each over its
+ * tolerance. Phase is accumulated over the two halves, each measured as
+ * the smaller turn between its ends, so an interval may turn through more
+ * than half a revolution without wrapping.
+ */
+static double interval_error(const AdaptiveSweep *sweep, const SweepInterval *interval) {
+    double start_db = magnitude_db(interval->start_gain);
+    double middle_db = magnitude_db(interval->middle_gain);
+    double end_db = magnitude_db(interval->end_gain);
+    bool start_finite = isfinite(start_db);
+    bool middle_finite = isfinite(middle_db);
+    bool end_finite = isfinite(end_db);
+    if (!start_finite && !middle_finite && !end_finite) {
+        return 0;
+    }
+    if (!start_finite || !middle_finite || !end_finite) {
+        return INFINITY;
+    }
+    double magnitude_error = 
+        fabs(middle_db - 0.5 * (start_db + end_db)) / sweep->magnitude_tolerance;
+
+    double first_turn = carg(interval->middle_gain / interval->start_gain) * DEGREES_PER_RADIAN;
+    double second_turn = carg(interval->end_gain / interval->middle_gain) * DEGREES_PER_RADIAN;
+    if (fabs(first_turn) > MAX_HALF_INTERVAL_TURN || fabs(second_turn) > MAX_HALF_INTERVAL_TURN) {
+        return INFINITY;
+    }
+    double total_turn = first_turn + second_turn;
+    double phase_error = fabs(first_turn - 0.5 * total_turn) / sweep->phase_tolerance;
+    return magnitude_error > phase_error ? magnitude_error : phase_error;
+}
+
+static void push_interval(AdaptiveSweep *sweep, const SweepInterval *interval) {
+    if (sweep->heap_count == sweep->heap_capacity) {
+        sweep->heap = grow_array(
+            sweep->heap, sweep->heap_count, &sweep->heap_capacity, sizeof(SweepInterval), "sweep intervals"
+        );
+    }
+    size_t child = sweep->heap_count++;
+    while (child > 0 && sweep->heap[(child - 1) / 2].error < interval->error) {
+        sweep->heap[child] = sweep->heap[(child - 1) / 2];
+        child = (child - 1) / 2;
+    }
+    sweep->heap[child] = *interval;
+}
+
+static SweepInterval pop_interval(AdaptiveSweep *sweep) {
+    SweepInterval top = sweep->heap[0];
+    SweepInterval last = sweep->heap[--sweep->heap_count];
+    size_t parent = 0;
+    for (;;) {
+        size_t child = 2 * parent + 1;
+        if (child >= sweep->heap_count) {
+            break;
+        }
+        if (child + 1 < sweep->heap_count && sweep->heap[child + 1].error > sweep->heap[child].error) {
+            child++;
+        }
+        if (!(sweep->heap[child].error > last.error)) {
+            break;
+        }
+        sweep->heap[parent] = sweep->heap[child];
+        parent = child;
+    }
+    if (sweep->heap_count > 0) {
+        sweep->heap[parent] = last;
+    }
+    return top;
+}
+
+/* Queues an interval whose three points are known if it needs refining. */
+static void queue_interval(
+    AdaptiveSweep *sweep, 
+    double start_log, 
+    double complex start_gain, 
+    double complex middle_gain, 
+    double end_log, 
+    double complex end_gain, 
+    int depth
+) {
+    SweepInterval interval;
+    interval.start_log = start_log;
+    interval.end_log = end_log;
+    interval.middle_log = 0.5 * (start_log + end_log);
+    interval.start_gain = start_gain;
+    interval.middle_gain = middle_gain;
+    interval.end_gain = end_gain;
+    interval.depth = depth;
+    interval.error = interval_error(sweep, &interval);
+    if (interval.error > 1 && depth < MAX_BISECTION_DEPTH) {
+        push_interval(sweep, &interval);
+    }
+}
+
+static void split_interval(AdaptiveSweep *sweep, const SweepInterval *interval) {
+    double first_log = 0.5 * (interval->start_log + interval->middle_log);
+    double second_log = 0.5 * (interval->middle_log + interval->end_log);
+    double complex first_gain = evaluate_point(sweep, first_log);
+    double complex second_gain = evaluate_point(sweep, second_log);
+    queue_interval(
+        sweep, interval->start_log, interval->start_gain, first_gain, 
+        interval->middle_log, interval->middle_gain, interval->depth + 1
+    );
+    queue_interval(
+        sweep, interval->middle_log, interval->middle_gain, second_gain, 
+        interval->end_log, interval->end_gain, interval->depth + 1
+    );
+}
+
+static int compare_sweep_points(const void *first, const void *second) {
+    double frequency1 = ((const SweepPoint *) first)->angular_frequency;
+    double frequency2 = ((const SweepPoint *) second)->angular_frequency;
+    return (frequency1 > frequency2) - (frequency1 < frequency2);
+}
+
+SCM adaptive_sweep(
+    SCM stages, 
+    SCM min_angular_frequency, 
+    SCM max_angular_frequency, 
+    SCM magnitude_tolerance, 
+    SCM phase_tolerance, 
+    SCM max_points
+) {
+    double min_frequency = scm_to_double(min_angular_frequency);
+    double max_frequency = scm_to_double(max_angular_frequency);
+    if (!(min_frequency > 0)) {
+        scm_out_of_range("adaptive-sweep", min_angular_frequency);
+    }
+    if (!(max_frequency > min_frequency)) {
+        scm_out_of_range("adaptive-sweep", max_angular_frequency);
+    }
+
+    AdaptiveSweep sweep = {0};
+    sweep.filter = compile_filter(stages);
+    sweep.magnitude_tolerance = scm_to_double(magnitude_tolerance);
+    sweep.phase_tolerance = SCM_UNBNDP(phase_tolerance) ? 
+        DEFAULT_PHASE_TOLERANCE : scm_to_double(phase_tolerance);
+    sweep.max_points = SCM_UNBNDP(max_points) ? DEFAULT_MAX_POINTS : scm_to_size_t(max_points);
+    if (sweep.max_points < INITIAL_POINTS) {
+        scm_out_of_range("adaptive-sweep", max_points);
+    }
+
+    double logs[INITIAL_POINTS];
+    double complex gains[INITIAL_POINTS];
+    double min_log = log10(min_frequency);
+    double max_log = log10(max_frequency);
+    for (size_t i = 0; i < INITIAL_POINTS; i++) {
+        logs[i] = min_log + (max_log - min_log) * i / (INITIAL_POINTS - 1);
+        gains[i] = evaluate_point(&sweep, logs[i]);
+    }
+    /* Every other grid point is the midpoint of a coarse interval. */
+    for (size_t i = 0; i + 2 < INITIAL_POINTS; i += 2) {
+        queue_interval(&sweep, logs[i], gains[i], gains[i + 1], logs[i + 2], gains[i + 2], 0);
+    }
+
+    while (sweep.heap_count > 0 && sweep.evaluations + 2 <= sweep.max_points) {
+        SweepInterval interval = pop_interval(&sweep);
+        split_interval(&sweep, &interval);
+    }
+
+    qsort(sweep.points, sweep.count, sizeof(SweepPoint), compare_sweep_points);
+    double *angular_frequencies = scm_gc_malloc_pointerless(
+        sweep.count * sizeof(double), "adaptive sweep frequencies"
+    );
+    double complex *sorted_gains = scm_gc_malloc_pointerless(
+        sweep.count * sizeof(double complex), "adaptive sweep gains"
+    );
+    for (size_t i = 0; i < sweep.count; i++) {
+        angular_frequencies[i] = sweep.points[i].angular_frequency;
+        sorted_gains[i] = sweep.points[i].gain;
+    }
+    return scm_cons(
+        real_vector_from_array(angular_frequencies, sweep.count), 
+        complex_vector_from_array(sorted_gains, sweep.count)
+    );
+}
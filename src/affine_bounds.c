@@ -0,0 +1,355 @@
+#include <complex.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "affine_bounds.h"
+#include "flat_filter.h"
+#include "numeric_vector.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+/*
+ * Worst-case response bounds by affine arithmetic. Every connected
+ * component gets a real noise symbol e in [-1, 1] and its value becomes
+ * value * (1 + tolerance * e). A quantity is carried as
+ *
+ *     center + sum of terms[i] * e[i] + disk of the given radius,
+ *
+ * with complex center and terms, so correlations between the two
+ * occurrences of one component (e.g. in a1 * Z and later a1 * Y) cancel
+ * instead of widening the result the way plain interval arithmetic would.
+ * Products and reciprocals put their nonlinear part into the radius with a
+ * guaranteed bound, and every operation widens the radius by a few ulps of
+ * its operands to cover rounding, so the enclosures are certified.
+ *
+ * Bounds are on the same gain as network_voltage_gain, which is the first
+ * element of the cascade; only the first row of the ABCD product is kept.
+ */
+
+#define BOUNDS_CHUNK 16
+#define ROUNDING_ULPS 8
+
+typedef struct {
+    double complex center;
+    double complex *terms;
+    double radius;
+} AffineForm;
+
+typedef struct {
+    const FlatFilter *filter;
+    const double *tolerances;
+    const double *angular_frequencies;
+    size_t frequency_count;
+    size_t symbol_count;
+    size_t form_count;
+    AffineForm *forms;
+    double complex *terms;
+    double *bounds;
+} BoundsSweep;
+
+typedef struct {
+    const BoundsSweep *sweep;
+    AffineForm *forms;
+    size_t next_form;
+    double angular_frequency;
+} BoundsContext;
+
+SCM response_bounds(SCM stages, SCM angular_frequencies, SCM tolerances);
+
+void init_affine_bounds(void) {
+    __extension__
+    scm_c_define_gsubr("response-bounds", 3, 0, 0, (scm_t_subr) response_bounds);
+}
+
+static double term_magnitude(const AffineForm *x, size_t count) {
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += cabs(x->terms[i]);
+    }
+    return sum;
+}
+
+/* Widens x to cover the rounding of the operation that produced it. */
+static void round_outward(AffineForm *x, size_t count) {
+    double scale = cabs(x->center) + term_magnitude(x, count) + x->radius;
+    x->radius += ROUNDING_ULPS * DBL_EPSILON * scale + DBL_MIN;
+}
+
+static void set_constant(AffineForm *x, double complex value, size_t count) {
+    x->center = value;
+    memset(x->terms, 0, count * sizeof(double complex));
+    x->radius = 0;
+}
+
+static void set_unbounded(AffineForm *x, size_t count) {
+    set_constant(x, 0, count);
+    x->radius = INFINITY;
+}
+
+static void add_forms(AffineForm *result, const AffineForm *x, const AffineForm *y, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result->terms[i] = x->terms[i] + y->terms[i];
+    }
+    result->center = x->center + y->center;
+    result->radius = x->radius + y->radius;
+    round_outward(result, count);
+}
+
+/*
+ * Product of two magnitude bounds. A zero bound is exact, so it zeroes the
+ * product even against an unbounded one: the initial a12 = 0 times the
+ * unbounded admittance of a leading shunt near resonance is 0, not NaN.
+ */
+static double bound_product(double x, double y) {
+    return x == 0 || y == 0 ? 0 : x * y;
+}
+
+static void multiply_forms(AffineForm *result, const AffineForm *x, const AffineForm *y, size_t count) {
+    double complex x_center = x->center;
+    double complex y_center = y->center;
+    double x_spread = term_magnitude(x, count) + x->radius;
+    double y_spread = term_magnitude(y, count) + y->radius;
+    double radius = 
+        bound_product(cabs(x_center), y->radius) + 
+        bound_product(cabs(y_center), x->radius) + 
+        bound_product(x_spread, y_spread);
+    for (size_t i = 0; i < count; i++) {
+        result->terms[i] = x_center * y->terms[i] + y_center * x->terms[i];
+    }
+    result->center = x_center * y_center;
+    result->radius = radius;
+    round_outward(result, count);
+}
+
+/*
+ * 1 / (c + d) = 1 / c - d / c^2 + d^2 / (c^2 (c + d)), and with
+ * rho = |d| / |c| < 1 the last term is at most rho^2 / ((1 - rho) |c|).
+ */
+static void reciprocal_form(AffineForm *result, const AffineForm *x, size_t count) {
+    double complex center = x->center;
+    double magnitude = cabs(center);
+    double spread = term_magnitude(x, count) + x->radius;
+    double rho = spread / magnitude;
+    if (!(rho < 1) || !isfinite(rho)) {
+        set_unbounded(result, count);
+        return;
+    }
+
+    double complex inverse = 1.0 / center;
+    double complex inverse_square = inverse * inverse;
+    double radius = x->radius / (magnitude * magnitude) + rho * rho / ((1 - rho) * magnitude);
+    for (size_t i = 0; i < count; i++) {
+        result->terms[i] = -x->terms[i] * inverse_square;
+    }
+    result->center = inverse;
+    result->radius = radius;
+    round_outward(result, count);
+}
+
+static AffineForm *push_form(BoundsContext *context) {
+    return &context->forms[context->next_form++];
+}
+
+/* Fills impedance and returns true, or returns false for an open circuit. */
+static bool node_bounds(BoundsContext *context, size_t *node_index, AffineForm *impedance) {
+    const BoundsSweep *sweep = context->sweep;
+    const FlatFilter *filter = sweep->filter;
+    const FlatNode *node = &filter->nodes[(*node_index)++];
+    size_t count = sweep->symbol_count;
+    double w = context->angular_frequency;
+
+    if (node->kind == COMPONENT_NODE) {
+        const FlatComponent *component = &filter->components[node->operand];
+        if (!component->is_connected) {
+            return false;
+        }
+        double complex scale = component->kind == RESISTOR_COMPONENT ? 1 : I * w;
+        set_constant(impedance, scale * component->value, count);
+        impedance->terms[node->operand] = scale * component->value * sweep->tolerances[node->operand];
+        round_outward(impedance, count);
+        if (component->kind == CAPACITOR_COMPONENT) {
+            reciprocal_form(impedance, impedance, count);
+        }
+        return true;
+    }
+
+    size_t saved_form = context->next_form;
+    AffineForm *child = push_form(context);
+    bool closed = false;
+    bool open = false;
+    set_constant(impedance, 0, count);
+    for (size_t i = 0; i < node->operand; i++) {
+        if (!node_bounds(context, node_index, child)) {
+            open = true;
+            continue;
+        }
+        closed = true;
+        if (node->kind == PARALLEL_NODE) {
+            reciprocal_form(child, child, count);
+        }
+        add_forms(impedance, impedance, child, count);
+    }
+    context->next_form = saved_form;
+
+    if (node->kind == SERIES_NODE) {
+        return !open;
+    }
+    if (!closed) {
+        return false;
+    }
+    reciprocal_form(impedance, impedance, count);
+    return true;
+}
+
+static void frequency_bounds(BoundsContext *context, size_t frequency) {
+    const BoundsSweep *sweep = context->sweep;
+    const FlatFilter *filter = sweep->filter;
+    size_t count = sweep->symbol_count;
+    context->next_form = 0;
+    context->angular_frequency = sweep->angular_frequencies[frequency];
+
+    AffineForm *a11 = push_form(context);
+    AffineForm *a12 = push_form(context);
+    AffineForm *impedance = push_form(context);
+    AffineForm *product = push_form(context);
+    set_constant(a11, 1, count);
+    set_constant(a12, 0, count);
+    for (size_t s = 0; s < filter->stage_count; s++) {
+        size_t node_index = filter->stages[s].first_node;
+        bool closed = node_bounds(context, &node_index, impedance);
+        if (filter->stages[s].kind == SERIES_STAGE) {
+            if (!closed) {
+                set_unbounded(a11, count);
+                set_unbounded(a12, count);
+                continue;
+            }
+            multiply_forms(product, a11, impedance, count);
+            add_forms(a12, product, a12, count);
+        }
+        else if (closed) {
+            reciprocal_form(impedance, impedance, count);
+            multiply_forms(product, a12, impedance, count);
+            add_forms(a11, a11, product, count);
+        }
+    }
+
+    /* Rectangle from the real noise symbols, then magnitude bounds from both it and the disk. */
+    double real_spread = a11->radius;
+    double imaginary_spread = a11->radius;
+    for (size_t i = 0; i < count; i++) {
+        real_spread += fabs(creal(a11->terms[i]));
+        imaginary_spread += fabs(cimag(a11->terms[i]));
+    }
+    double real_min = creal(a11->center) - real_spread;
+    double real_max = creal(a11->center) + real_spread;
+    double imaginary_min = cimag(a11->center) - imaginary_spread;
+    double imaginary_max = cimag(a11->center) + imaginary_spread;
+
+    double disk_spread = term_magnitude(a11, count) + a11->radius;
+    double magnitude_max = fmin(
+        cabs(a11->center) + disk_spread, 
+        hypot(fmax(fabs(real_min), fabs(real_max)), fmax(fabs(imaginary_min), fabs(imaginary_max)))
+    );
+    double nearest_real = real_min > 0 ? real_min : (real_max < 0 ? -real_max : 0);
+    double nearest_imaginary = imaginary_min > 0 ? imaginary_min : (imaginary_max < 0 ? -imaginary_max : 0);
+    double magnitude_min = fmax(
+        fmax(cabs(a11->center) - disk_spread, 0), 
+        hypot(nearest_real, nearest_imaginary)
+    );
+
+    double *bounds = &sweep->bounds[6 * frequency];
+    bounds[0] = real_min;
+    bounds[1] = real_max;
+    bounds[2] = imaginary_min;
+    bounds[3] = imaginary_max;
+    bounds[4] = magnitude_min;
+    bounds[5] = magnitude_max;
+}
+
+static void bounds_chunk(size_t chunk, void *context) {
+    BoundsSweep *sweep = context;
+    BoundsContext bounds_context;
+    bounds_context.sweep = sweep;
+    bounds_context.forms = &sweep->forms[chunk * sweep->form_count];
+    size_t end = (chunk + 1) * BOUNDS_CHUNK;
+    end = end < sweep->frequency_count ? end : sweep->frequency_count;
+    for (size_t f = chunk * BOUNDS_CHUNK; f < end; f++) {
+        frequency_bounds(&bounds_context, f);
+    }
+}
+
+/*
+ * tolerances is one relative tolerance for every component or a vector
+ * with one per component, in the order the stages list them. Returns
+ * ((real-min . f64vector) (real-max . f64vector) (imaginary-min . f64vector)
+ * (imaginary-max . f64vector) (magnitude-min . f64vector)
+ * (magnitude-max . f64vector)), each with one bound per frequency.
+ */
+SCM response_bounds(SCM stages, SCM angular_frequencies, SCM tolerances) {
+    const char *subr = "response-bounds";
+    BoundsSweep sweep;
+    FlatFilter *filter = compile_filter(stages);
+    sweep.filter = filter;
+    sweep.symbol_count = filter->component_count;
+    sweep.angular_frequencies = double_array_from_vector(
+        angular_frequencies, &sweep.frequency_count, SCM_ARG2, subr
+    );
+
+    double *component_tolerances = scm_gc_malloc_pointerless(
+        (sweep.symbol_count + 1) * sizeof(double), "tolerances"
+    );
+    if (scm_is_real(tolerances)) {
+        for (size_t i = 0; i < sweep.symbol_count; i++) {
+            component_tolerances[i] = scm_to_double(tolerances);
+        }
+    }
+    else {
+        size_t tolerance_count;
+        double *values = double_array_from_vector(tolerances, &tolerance_count, SCM_ARG3, subr);
+        if (tolerance_count != sweep.symbol_count) {
+            scm_misc_error(subr, "Expected one tolerance per component.", SCM_EOL);
+        }
+        memcpy(component_tolerances, values, tolerance_count * sizeof(double));
+    }
+    for (size_t i = 0; i < sweep.symbol_count; i++) {
+        if (!(component_tolerances[i] >= 0 && component_tolerances[i] < 1)) {
+            scm_out_of_range(subr, tolerances);
+        }
+    }
+    sweep.tolerances = component_tolerances;
+
+    size_t chunk_count = (sweep.frequency_count + BOUNDS_CHUNK - 1) / BOUNDS_CHUNK;
+    sweep.form_count = 2 * filter->node_count + 4;
+    size_t total_forms = chunk_count * sweep.form_count;
+    sweep.forms = scm_gc_malloc((total_forms + 1) * sizeof(AffineForm), "affine forms");
+    sweep.terms = scm_gc_malloc_pointerless(
+        (total_forms * sweep.symbol_count + 1) * sizeof(double complex), "affine terms"
+    );
+    for (size_t i = 0; i < total_forms; i++) {
+        sweep.forms[i].terms = &sweep.terms[i * sweep.symbol_count];
+    }
+    sweep.bounds = scm_gc_malloc_pointerless((6 * sweep.frequency_count + 1) * sizeof(double), "bounds");
+
+    TRACE_BEGIN("bounds");
+    parallel_for(chunk_count, bounds_chunk, &sweep);
+    TRACE_END("bounds");
+
+    static const char *const names[] = {
+        "real-min", "real-max", "imaginary-min", "imaginary-max", "magnitude-min", "magnitude-max"
+    };
+    double *column = scm_gc_malloc_pointerless((sweep.frequency_count + 1) * sizeof(double), "bounds");
+    SCM result = SCM_EOL;
+    for (size_t b = 6; b-- > 0;) {
+        for (size_t f = 0; f < sweep.frequency_count; f++) {
+            column[f] = sweep.bounds[6 * f + b];
+        }
+        result = scm_cons(
+            scm_cons(scm_from_utf8_symbol(names[b]), real_vector_from_array(column, sweep.frequency_count)), 
+            result
+        );
+    }
+    return result;
+}
@@ -0,0 +1,304 @@
+#include <complex.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <libguile.h>
+
+#include "batch_sweep.h"
+#include "flat_filter.h"
+#include "numeric_vector.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "two_port_network.h"
+
+/*
+ * The filters x frequencies result is cut into tiles of a few candidates by
+ * FREQUENCY_TILE frequencies. Inside a tile every stage impedance is
+ * evaluated across the whole frequency block before moving on, so the jw
+ * terms, the candidate's nodes and the block of accumulating matrices stay
+ * in L1/L2 while they are reused. Per frequency the arithmetic is the same,
+ * in the same order, as flat_filter_voltage_gain.
+ */
+
+#define FREQUENCY_TILE 64
+#define CANDIDATE_TILE_BYTES (16 * 1024)
+#define MAX_CANDIDATE_TILE 32
+
+typedef struct {
+    FlatFilter **filters;
+    size_t filter_count;
+    size_t frequency_count;
+    double complex *angular_terms;
+    size_t *candidate_tile_starts;
+    size_t candidate_tile_count;
+    size_t frequency_tile_count;
+    double complex *gains;
+    TwoPortNetwork *networks;
+    atomic_bool out_of_memory;
+} BatchSweep;
+
+SCM batch_voltage_gains(SCM filters, SCM angular_frequencies);
+
+void init_batch_sweep(void) {
+    __extension__
+    scm_c_define_gsubr("batch-voltage-gains", 2, 0, 0, (scm_t_subr) batch_voltage_gains);
+}
+
+static double complex component_impedance_term(
+    double complex angular_term, 
+    const FlatComponent *component
+) {
+    if (!component->is_connected) {
+        return INFINITY;
+    }
+
+    switch (component->kind) {
+        case RESISTOR_COMPONENT:
+            return component->value;
+        case CAPACITOR_COMPONENT:
+            return 1.0 / (angular_term * component->value);
+        case INDUCTOR_COMPONENT:
+            return angular_term * component->value;
+    }
+    return NAN;
+}
+
+static void block_node_impedances(
+    const FlatFilter *filter, 
+    size_t *node_index, 
+    const double complex *angular_terms, 
+    size_t count, 
+    double complex *impedances, 
+    double complex *scratch
+) {
+    const FlatNode *node = &filter->nodes[(*node_index)++];
+
+    if (node->kind == COMPONENT_NODE) {
+        const FlatComponent *component = &filter->components[node->operand];
+        for (size_t f = 0; f < count; f++) {
+            impedances[f] = component_impedance_term(angular_terms[f], component);
+        }
+        return;
+    }
+
+    for (size_t f = 0; f < count; f++) {
+        impedances[f] = 0;
+    }
+    for (size_t i = 0; i < node->operand; i++) {
+        block_node_impedances(
+            filter, node_index, angular_terms, count, scratch, scratch + FREQUENCY_TILE
+        );
+        if (node->kind == SERIES_NODE) {
+            for (size_t f = 0; f < count; f++) {
+                impedances[f] += scratch[f];
+            }
+        }
+        else {
+            for (size_t f = 0; f < count; f++) {
+                impedances[f] += 1.0 / scratch[f];
+            }
+        }
+    }
+    if (node->kind == PARALLEL_NODE) {
+        for (size_t f = 0; f < count; f++) {
+            impedances[f] = 1.0 / impedances[f];
+        }
+    }
+}
+
+static size_t load_depth(const FlatFilter *filter, size_t *node_index) {
+    const FlatNode *node = &filter->nodes[(*node_index)++];
+    size_t depth = 0;
+    if (node->kind != COMPONENT_NODE) {
+        for (size_t i = 0; i < node->operand; i++) {
+            size_t child_depth = load_depth(filter, node_index);
+            depth = child_depth > depth ? child_depth : depth;
+        }
+    }
+    return depth + 1;
+}
+
+static size_t filter_load_depth(const FlatFilter *filter) {
+    size_t depth = 0;
+    for (size_t i = 0; i < filter->stage_count; i++) {
+        size_t node_index = filter->stages[i].first_node;
+        size_t stage_depth = load_depth(filter, &node_index);
+        depth = stage_depth > depth ? stage_depth : depth;
+    }
+    return depth;
+}
+
+static void sweep_tile(size_t tile, void *context) {
+    BatchSweep *sweep = context;
+    size_t candidate_tile = tile / sweep->frequency_tile_count;
+    size_t first_frequency = (tile % sweep->frequency_tile_count) * FREQUENCY_TILE;
+    size_t count = sweep->frequency_count - first_frequency;
+    count = count < FREQUENCY_TILE ? count : FREQUENCY_TILE;
+    const double complex *angular_terms = &sweep->angular_terms[first_frequency];
+
+    TwoPortNetwork accumulated[FREQUENCY_TILE];
+    double complex impedances[FREQUENCY_TILE];
+    double complex *scratch = NULL;
+    size_t scratch_depth = 0;
+
+    for (
+        size_t m = sweep->candidate_tile_starts[candidate_tile]; 
+        m < sweep->candidate_tile_starts[candidate_tile + 1]; 
+        m++
+    ) {
+        const FlatFilter *filter = sweep->filters[m];
+        size_t depth = filter_load_depth(filter);
+        if (depth > scratch_depth) {
+            free(scratch);
+            scratch = malloc(depth * FREQUENCY_TILE * sizeof(double complex));
+            scratch_depth = depth;
+            if (scratch == NULL) {
+                atomic_store(&sweep->out_of_memory, true);
+                return;
+            }
+        }
+
+        for (size_t f = 0; f < count; f++) {
+            identity_network(&accumulated[f]);
+        }
+        for (size_t i = 0; i < filter->stage_count; i++) {
+            size_t node_index = filter->stages[i].first_node;
+            block_node_impedances(filter, &node_index, angular_terms, count, impedances, scratch);
+
+            for (size_t f = 0; f < count; f++) {
+                TwoPortNetwork work_area;
+                if (filter->stages[i].kind == SERIES_STAGE) {
+                    series_connected_network(&work_area, impedances[f]);
+                }
+                else {
+                    shunt_connected_network(&work_area, impedances[f]);
+                }
+                cascade_network(&accumulated[f], &accumulated[f], &work_area);
+            }
+        }
+
+        size_t offset = m * sweep->frequency_count + first_frequency;
+        for (size_t f = 0; f < count; f++) {
+            if (sweep->gains != NULL) {
+                sweep->gains[offset + f] = network_voltage_gain(&accumulated[f]);
+            }
+            else {
+                sweep->networks[offset + f] = accumulated[f];
+            }
+        }
+    }
+    free(scratch);
+}
+
+static void run_batch_sweep(BatchSweep *sweep, const double *angular_frequencies) {
+    if (sweep->filter_count == 0 || sweep->frequency_count == 0) {
+        return;
+    }
+
+    /* Same expression as the I * angular_frequency in the scalar kernels. */
+    sweep->angular_terms = malloc(sweep->frequency_count * sizeof(double complex));
+    sweep->candidate_tile_starts = malloc((sweep->filter_count + 1) * sizeof(size_t));
+    if (sweep->angular_terms == NULL || sweep->candidate_tile_starts == NULL) {
+        free(sweep->angular_terms);
+        free(sweep->candidate_tile_starts);
+        scm_memory_error("batch-sweep");
+    }
+    for (size_t f = 0; f < sweep->frequency_count; f++) {
+        sweep->angular_terms[f] = I * angular_frequencies[f];
+    }
+
+    sweep->candidate_tile_count = 0;
+    size_t tile_bytes = 0;
+    size_t tile_size = 0;
+    for (size_t m = 0; m < sweep->filter_count; m++) {
+        const FlatFilter *filter = sweep->filters[m];
+        size_t filter_bytes = 
+            filter->component_count * sizeof(FlatComponent) + 
+            filter->node_count * sizeof(FlatNode) + 
+            filter->stage_count * sizeof(FlatStage);
+        if (tile_size == 0 || tile_bytes + filter_bytes > CANDIDATE_TILE_BYTES || tile_size == MAX_CANDIDATE_TILE) {
+            sweep->candidate_tile_starts[sweep->candidate_tile_count++] = m;
+            tile_bytes = 0;
+            tile_size = 0;
+        }
+        tile_bytes += filter_bytes;
+        tile_size++;
+    }
+    sweep->candidate_tile_starts[sweep->candidate_tile_count] = sweep->filter_count;
+    sweep->frequency_tile_count = (sweep->frequency_count + FREQUENCY_TILE - 1) / FREQUENCY_TILE;
+
+    parallel_for(
+        sweep->candidate_tile_count * sweep->frequency_tile_count, 
+        sweep_tile, 
+        sweep
+    );
+    free(sweep->angular_terms);
+    free(sweep->candidate_tile_starts);
+    if (atomic_load(&sweep->out_of_memory)) {
+        scm_memory_error("batch-sweep");
+    }
+}
+
+/* Fills gains[m * frequency_count + f] for every filter m and frequency f. */
+void batch_filter_gains(
+    FlatFilter **filters, 
+    size_t filter_count, 
+    const double *angular_frequencies, 
+    size_t frequency_count, 
+    double complex *gains
+) {
+    BatchSweep sweep = {0};
+    sweep.filters = filters;
+    sweep.filter_count = filter_count;
+    sweep.frequency_count = frequency_count;
+    sweep.gains = gains;
+    run_batch_sweep(&sweep, angular_frequencies);
+}
+
+/* Same layout as batch_filter_gains, keeping the whole ABCD matrices. */
+void batch_filter_networks(
+    FlatFilter **filters, 
+    size_t filter_count, 
+    const double *angular_frequencies, 
+    size_t frequency_count, 
+    TwoPortNetwork *networks
+) {
+    BatchSweep sweep = {0};
+    sweep.filters = filters;
+    sweep.filter_count = filter_count;
+    sweep.frequency_count = frequency_count;
+    sweep.networks = networks;
+    run_batch_sweep(&sweep, angular_frequencies);
+}
+
+FlatFilter **compile_filters(SCM filters, int position, const char *subr) {
+    SCM_ASSERT_TYPE(scm_is_vector(filters), filters, position, subr, "Vector of stage vectors");
+
+    size_t filter_count = SCM_SIMPLE_VECTOR_LENGTH(filters);
+    FlatFilter **flat_filters = scm_gc_malloc(
+        (filter_count + 1) * sizeof(FlatFilter *), "flat filters"
+    );
+    for (size_t i = 0; i < filter_count; i++) {
+        flat_filters[i] = compile_filter(SCM_SIMPLE_VECTOR_REF(filters, i));
+    }
+    return flat_filters;
+}
+
+/* Returns a c64vector holding one row of gains per filter. */
+SCM batch_voltage_gains(SCM filters, SCM angular_frequencies) {
+    FlatFilter **flat_filters = compile_filters(filters, SCM_ARG1, "batch-voltage-gains");
+    size_t filter_count = SCM_SIMPLE_VECTOR_LENGTH(filters);
+    size_t frequency_count;
+    double *frequencies = double_array_from_vector(
+        angular_frequencies, &frequency_count, SCM_ARG2, "batch-voltage-gains"
+    );
+
+    double complex *gains = scm_gc_malloc_pointerless(
+        (filter_count * frequency_count + 1) * sizeof(double complex), "batch gains"
+    );
+    TRACE_BEGIN("evaluate");
+    batch_filter_gains(flat_filters, filter_count, frequencies, frequency_count, gains);
+    TRACE_END("evaluate");
+    return complex_vector_from_array(gains, filter_count * frequency_count);
+}
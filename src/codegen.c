@@ -0,0 +1,499 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <complex.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <libguile.h>
+
+#include "codegen.h"
+#include "flat_filter.h"
+#include "hash.h"
+#include "numeric_vector.h"
+#include "response_target.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+/*
+ * A filter kernel is C source specialized for one topology: every load tree
+ * is unrolled into straight-line impedance arithmetic with the component
+ * formulas inlined, and the cascade keeps only the first row of the ABCD
+ * product, which is all the voltage gain needs. Values and connection flags
+ * stay parameters, so one kernel serves every candidate of the topology.
+ *
+ * Kernels are compiled with $CC (default gcc) into a cache directory,
+ * named by a hash of the topology description; the description is also
+ * compiled in and checked after dlopen. The cache is $FILTOPT_KERNEL_CACHE,
+ * else $XDG_CACHE_HOME/filtopt, else $HOME/.cache/filtopt. If any step
+ * fails the kernel falls back to the flat path.
+ *
+ * The kernel does the flat path's arithmetic in the same order, less its
+ * multiplications by one and additions of zero, and is compiled without
+ * floating-point contraction. For finite impedances its gains therefore
+ * equal the flat path's except possibly for the sign of a zero real or
+ * imaginary part, and costs, which only see magnitudes, are identical.
+ * With an open component the dropped operations can leave an infinite
+ * gain where the flat path has NaN.
+ */
+
+#define KERNEL_VERSION 2
+#define KERNEL_CHUNK 64
+#define KERNEL_SYMBOL "filtopt_gains"
+#define TOPOLOGY_SYMBOL "filtopt_topology"
+
+typedef void (*KernelFunction)(
+    const double *values, 
+    const unsigned char *connected, 
+    const double *angular_frequencies, 
+    size_t count, 
+    double complex *gains
+);
+
+typedef struct {
+    char *topology;
+    size_t component_count;
+    KernelFunction function;
+} FilterKernel;
+
+typedef struct LoadedKernel {
+    char *topology;
+    KernelFunction function;
+    struct LoadedKernel *next;
+} LoadedKernel;
+
+static pthread_mutex_t loaded_lock = PTHREAD_MUTEX_INITIALIZER;
+static LoadedKernel *loaded_kernels;
+
+extern char **environ;
+
+SCM filter_kernel_type;
+
+SCM compile_filter_kernel(SCM stages);
+SCM filter_kernel_compiled_p(SCM kernel);
+SCM kernel_voltage_gains(SCM kernel, SCM stages, SCM angular_frequencies);
+SCM kernel_filter_cost(SCM kernel, SCM stages, SCM target);
+
+void init_filter_kernel_type(void) {
+    SCM name, slots;
+    scm_t_struct_finalize finalizer;
+
+    name = scm_from_utf8_symbol("filter-kernel");
+    slots = scm_list_1(scm_from_utf8_symbol("kernel"));
+    finalizer = NULL;
+    filter_kernel_type = scm_make_foreign_object_type(name, slots, finalizer);
+
+    __extension__
+    scm_c_define_gsubr("compile-filter-kernel", 1, 0, 0, (scm_t_subr) compile_filter_kernel);
+    __extension__
+    scm_c_define_gsubr("filter-kernel-compiled?", 1, 0, 0, (scm_t_subr) filter_kernel_compiled_p);
+    __extension__
+    scm_c_define_gsubr("kernel-voltage-gains", 3, 0, 0, (scm_t_subr) kernel_voltage_gains);
+    __extension__
+    scm_c_define_gsubr("kernel-filter-cost", 3, 0, 0, (scm_t_subr) kernel_filter_cost);
+}
+
+typedef struct {
+    char *text;
+    size_t length;
+    size_t capacity;
+} TextBuffer;
+
+static void append_text(TextBuffer *buffer, const char *text) {
+    size_t length = strlen(text);
+    if (buffer->length + length + 1 > buffer->capacity) {
+        size_t capacity = 2 * (buffer->length + length + 1);
+        char *text_copy = scm_gc_malloc_pointerless(capacity, "kernel text");
+        memcpy(text_copy, buffer->text, buffer->length);
+        buffer->text = text_copy;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->text + buffer->length, text, length + 1);
+    buffer->length += length;
+}
+
+static void describe_node(const FlatFilter *filter, size_t *node_index, TextBuffer *buffer) {
+    static const char *const component_letters[] = {"R", "C", "L"};
+    const FlatNode *node = &filter->nodes[(*node_index)++];
+    if (node->kind == COMPONENT_NODE) {
+        append_text(buffer, component_letters[filter->components[node->operand].kind]);
+        return;
+    }
+    append_text(buffer, node->kind == SERIES_NODE ? "S(" : "P(");
+    for (size_t i = 0; i < node->operand; i++) {
+        if (i > 0) {
+            append_text(buffer, ",");
+        }
+        describe_node(filter, node_index, buffer);
+    }
+    append_text(buffer, ")");
+}
+
+/* Canonical text of the topology, e.g. "series:P(R,S(L,C));shunt:C;". */
+static char *describe_topology(const FlatFilter *filter) {
+    TextBuffer buffer;
+    buffer.capacity = 64;
+    buffer.length = 0;
+    buffer.text = scm_gc_malloc_pointerless(buffer.capacity, "kernel text");
+    buffer.text[0] = '\0';
+    for (size_t i = 0; i < filter->stage_count; i++) {
+        size_t node_index = filter->stages[i].first_node;
+        append_text(&buffer, filter->stages[i].kind == SERIES_STAGE ? "series:" : "shunt:");
+        describe_node(filter, &node_index, &buffer);
+        append_text(&buffer, ";");
+    }
+    return buffer.text;
+}
+
+/* Emits temporaries for one load tree and returns the index of its impedance. */
+static size_t emit_node(FILE *source, const FlatFilter *filter, size_t *node_index, size_t *temporaries) {
+    const FlatNode *node = &filter->nodes[(*node_index)++];
+    size_t *children = NULL;
+    if (node->kind != COMPONENT_NODE) {
+        children = scm_gc_malloc_pointerless(node->operand * sizeof(size_t), "kernel temporaries");
+        for (size_t i = 0; i < node->operand; i++) {
+            children[i] = emit_node(source, filter, node_index, temporaries);
+        }
+    }
+
+    size_t result = (*temporaries)++;
+    fprintf(source, "        double complex t%zu = ", result);
+    if (node->kind == COMPONENT_NODE) {
+        size_t c = node->operand;
+        switch (filter->components[c].kind) {
+            case RESISTOR_COMPONENT:
+                fprintf(source, "connected[%zu] ? (double complex) values[%zu] : INFINITY;\n", c, c);
+                break;
+            case CAPACITOR_COMPONENT:
+                fprintf(source, "connected[%zu] ? 1.0 / (I * w * values[%zu]) : INFINITY;\n", c, c);
+                break;
+            case INDUCTOR_COMPONENT:
+                fprintf(source, "connected[%zu] ? I * w * values[%zu] : INFINITY;\n", c, c);
+                break;
+        }
+    }
+    else if (node->kind == SERIES_NODE) {
+        for (size_t i = 0; i < node->operand; i++) {
+            fprintf(source, i > 0 ? " + t%zu" : "t%zu", children[i]);
+        }
+        fprintf(source, ";\n");
+    }
+    else {
+        fprintf(source, "1.0 / (");
+        for (size_t i = 0; i < node->operand; i++) {
+            fprintf(source, i > 0 ? " + 1.0 / t%zu" : "1.0 / t%zu", children[i]);
+        }
+        fprintf(source, ");\n");
+    }
+    return result;
+}
+
+static void emit_kernel(FILE *source, const FlatFilter *filter, const char *topology) {
+    fprintf(source, "#include <complex.h>\n#include <math.h>\n#include <stddef.h>\n\n");
+    fprintf(source, "const char %s[] = \"%s\";\n\n", TOPOLOGY_SYMBOL, topology);
+    fprintf(
+        source, 
+        "void %s(const double *values, const unsigned char *connected, "
+        "const double *angular_frequencies, size_t count, double complex *gains) {\n", 
+        KERNEL_SYMBOL
+    );
+    fprintf(source, "    (void) values;\n    (void) connected;\n");
+    fprintf(source, "    for (size_t f = 0; f < count; f++) {\n");
+    fprintf(source, "        double w = angular_frequencies[f];\n        (void) w;\n");
+    fprintf(source, "        double complex a11 = 1;\n        double complex a12 = 0;\n");
+    size_t temporaries = 0;
+    for (size_t i = 0; i < filter->stage_count; i++) {
+        size_t node_index = filter->stages[i].first_node;
+        size_t impedance = emit_node(source, filter, &node_index, &temporaries);
+        if (filter->stages[i].kind == SERIES_STAGE) {
+            fprintf(source, "        a12 = a11 * t%zu + a12;\n", impedance);
+        }
+        else {
+            fprintf(source, "        a11 = a11 + a12 * (1.0 / t%zu);\n", impedance);
+        }
+    }
+    fprintf(source, "        gains[f] = a11;\n    }\n}\n");
+}
+
+static char *kernel_cache_directory(void) {
+    const char *setting = getenv("FILTOPT_KERNEL_CACHE");
+    const char *base;
+    const char *suffix;
+    if (setting != NULL && *setting != '\0') {
+        base = setting;
+        suffix = "";
+    }
+    else if ((base = getenv("XDG_CACHE_HOME")) != NULL && *base != '\0') {
+        suffix = "/filtopt";
+    }
+    else if ((base = getenv("HOME")) != NULL && *base != '\0') {
+        suffix = "/.cache/filtopt";
+    }
+    else {
+        return NULL;
+    }
+
+    size_t length = strlen(base) + strlen(suffix) + 1;
+    char *directory = scm_gc_malloc_pointerless(length, "kernel cache");
+    snprintf(directory, length, "%s%s", base, suffix);
+    /* Create each missing component; existing ones are fine. */
+    for (char *slash = directory + 1; ; slash++) {
+        if (*slash == '/' || *slash == '\0') {
+            char saved = *slash;
+            *slash = '\0';
+            if (mkdir(directory, 0700) < 0 && errno != EEXIST) {
+                return NULL;
+            }
+            *slash = saved;
+            if (saved == '\0') {
+                break;
+            }
+        }
+    }
+    return directory;
+}
+
+static bool run_compiler(const char *source_path, const char *object_path) {
+    const char *compiler = getenv("CC");
+    if (compiler == NULL || *compiler == '\0') {
+        compiler = "gcc";
+    }
+    char *arguments[] = {
+        (char *) compiler, "-O2", "-std=c11", "-ffp-contract=off", "-shared", "-fPIC", 
+        "-o", (char *) object_path, (char *) source_path, "-lm", NULL
+    };
+
+    pid_t compiler_process;
+    if (posix_spawnp(&compiler_process, compiler, NULL, NULL, arguments, environ) != 0) {
+        return false;
+    }
+    int status;
+    while (waitpid(compiler_process, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static KernelFunction open_kernel(const char *object_path, const char *topology) {
+    void *handle = dlopen(object_path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        return NULL;
+    }
+    const char *compiled_topology = dlsym(handle, TOPOLOGY_SYMBOL);
+    KernelFunction function;
+    /* ISO C has no function pointer cast from void *; copy the bits. */
+    void *symbol = dlsym(handle, KERNEL_SYMBOL);
+    memcpy(&function, &symbol, sizeof(function));
+    if (compiled_topology == NULL || symbol == NULL || strcmp(compiled_topology, topology) != 0) {
+        dlclose(handle);
+        return NULL;
+    }
+    return function;
+}
+
+/* Builds or reuses the cached shared object; NULL if anything fails. */
+static KernelFunction build_kernel(const FlatFilter *filter, const char *topology) {
+    char *directory = kernel_cache_directory();
+    if (directory == NULL) {
+        return NULL;
+    }
+
+    uint64_t hash = KERNEL_VERSION;
+    for (const char *c = topology; *c != '\0'; c++) {
+        hash = hash_combine(hash, (unsigned char) *c);
+    }
+    size_t length = strlen(directory) + 64;
+    char *object_path = scm_gc_malloc_pointerless(length, "kernel path");
+    snprintf(object_path, length, "%s/kernel-%016" PRIx64 ".so", directory, hash);
+
+    KernelFunction function = open_kernel(object_path, topology);
+    if (function != NULL) {
+        return function;
+    }
+
+    /* Compile under temporary names and rename into place, so concurrent builders never see a partial object. */
+    char *source_path = scm_gc_malloc_pointerless(length, "kernel path");
+    char *temporary_path = scm_gc_malloc_pointerless(length, "kernel path");
+    snprintf(source_path, length, "%s/kernel-%016" PRIx64 "-XXXXXX", directory, hash);
+    int descriptor = mkstemp(source_path);
+    if (descriptor < 0) {
+        return NULL;
+    }
+    FILE *source = fdopen(descriptor, "w");
+    if (source == NULL) {
+        close(descriptor);
+        unlink(source_path);
+        return NULL;
+    }
+    emit_kernel(source, filter, topology);
+    bool written = fclose(source) == 0;
+
+    /* gcc picks the language from the extension, so pass the source as .c. */
+    char *c_path = scm_gc_malloc_pointerless(length + 2, "kernel path");
+    snprintf(c_path, length + 2, "%s.c", source_path);
+    snprintf(temporary_path, length, "%s.so", source_path);
+    bool built = 
+        written && 
+        rename(source_path, c_path) == 0 && 
+        run_compiler(c_path, temporary_path) && 
+        rename(temporary_path, object_path) == 0;
+    unlink(source_path);
+    unlink(c_path);
+    unlink(temporary_path);
+    return built ? open_kernel(object_path, topology) : NULL;
+}
+
+static KernelFunction find_kernel(const FlatFilter *filter, const char *topology) {
+    pthread_mutex_lock(&loaded_lock);
+    LoadedKernel *loaded = loaded_kernels;
+    while (loaded != NULL && strcmp(loaded->topology, topology) != 0) {
+        loaded = loaded->next;
+    }
+    KernelFunction function = loaded != NULL ? loaded->function : NULL;
+    pthread_mutex_unlock(&loaded_lock);
+    if (loaded != NULL) {
+        return function;
+    }
+
+    TRACE_BEGIN("compile-kernel");
+    function = build_kernel(filter, topology);
+    TRACE_END("compile-kernel");
+
+    /* Failures are remembered too, so a missing compiler is only tried once. */
+    loaded = malloc(sizeof(LoadedKernel));
+    char *topology_copy = malloc(strlen(topology) + 1);
+    if (loaded == NULL || topology_copy == NULL) {
+        free(loaded);
+        free(topology_copy);
+        return function;
+    }
+    strcpy(topology_copy, topology);
+    loaded->topology = topology_copy;
+    loaded->function = function;
+    pthread_mutex_lock(&loaded_lock);
+    loaded->next = loaded_kernels;
+    loaded_kernels = loaded;
+    pthread_mutex_unlock(&loaded_lock);
+    return function;
+}
+
+/* Always returns a kernel; it uses the flat path if compilation failed. */
+SCM compile_filter_kernel(SCM stages) {
+    FlatFilter *filter = compile_filter(stages);
+    FilterKernel *kernel = scm_gc_malloc(sizeof(FilterKernel), "filter kernel");
+    kernel->topology = describe_topology(filter);
+    kernel->component_count = filter->component_count;
+    kernel->function = find_kernel(filter, kernel->topology);
+    return scm_make_foreign_object_1(filter_kernel_type, kernel);
+}
+
+static FilterKernel *get_filter_kernel(SCM kernel) {
+    scm_assert_foreign_object_type(filter_kernel_type, kernel);
+    return scm_foreign_object_ref(kernel, 0);
+}
+
+SCM filter_kernel_compiled_p(SCM kernel) {
+    return scm_from_bool(get_filter_kernel(kernel)->function != NULL);
+}
+
+typedef struct {
+    const FilterKernel *kernel;
+    const FlatFilter *filter;
+    const double *values;
+    const unsigned char *connected;
+    const double *angular_frequencies;
+    size_t frequency_count;
+    double complex *gains;
+} KernelSweep;
+
+static void sweep_kernel_chunk(size_t chunk, void *context) {
+    KernelSweep *sweep = context;
+    size_t first = chunk * KERNEL_CHUNK;
+    size_t count = sweep->frequency_count - first;
+    count = count < KERNEL_CHUNK ? count : KERNEL_CHUNK;
+    if (sweep->kernel->function != NULL) {
+        sweep->kernel->function(
+            sweep->values, 
+            sweep->connected, 
+            sweep->angular_frequencies + first, 
+            count, 
+            sweep->gains + first
+        );
+    }
+    else {
+        for (size_t f = first; f < first + count; f++) {
+            sweep->gains[f] = flat_filter_voltage_gain(sweep->angular_frequencies[f], sweep->filter);
+        }
+    }
+}
+
+static double complex *sweep_kernel(
+    SCM kernel, 
+    SCM stages, 
+    const double *angular_frequencies, 
+    size_t frequency_count, 
+    const char *subr
+) {
+    KernelSweep sweep;
+    sweep.kernel = get_filter_kernel(kernel);
+    FlatFilter *filter = compile_filter(stages);
+    if (strcmp(describe_topology(filter), sweep.kernel->topology) != 0) {
+        scm_misc_error(subr, "Stages do not match the kernel's topology.", SCM_EOL);
+    }
+
+    size_t component_count = filter->component_count;
+    double *values = scm_gc_malloc_pointerless((component_count + 1) * sizeof(double), "kernel values");
+    unsigned char *connected = scm_gc_malloc_pointerless(component_count + 1, "kernel connections");
+    for (size_t i = 0; i < component_count; i++) {
+        values[i] = filter->components[i].value;
+        connected[i] = filter->components[i].is_connected;
+    }
+    sweep.filter = filter;
+    sweep.values = values;
+    sweep.connected = connected;
+    sweep.angular_frequencies = angular_frequencies;
+    sweep.frequency_count = frequency_count;
+    sweep.gains = scm_gc_malloc_pointerless(
+        (frequency_count + 1) * sizeof(double complex), "kernel gains"
+    );
+    parallel_for((frequency_count + KERNEL_CHUNK - 1) / KERNEL_CHUNK, sweep_kernel_chunk, &sweep);
+    return sweep.gains;
+}
+
+SCM kernel_voltage_gains(SCM kernel, SCM stages, SCM angular_frequencies) {
+    size_t count;
+    double *frequencies = double_array_from_vector(
+        angular_frequencies, &count, SCM_ARG3, "kernel-voltage-gains"
+    );
+    double complex *gains = sweep_kernel(kernel, stages, frequencies, count, "kernel-voltage-gains");
+    return complex_vector_from_array(gains, count);
+}
+
+SCM kernel_filter_cost(SCM kernel, SCM stages, SCM target) {
+    const ResponseTarget *response_target = get_response_target(target);
+    TRACE_SCOPE_BEGIN("evaluate");
+    double complex *gains = sweep_kernel(
+        kernel, 
+        stages, 
+        response_target->angular_frequencies, 
+        response_target->count, 
+        "kernel-filter-cost"
+    );
+    double cost = response_error(response_target, gains);
+    TRACE_SCOPE_END();
+    scm_remember_upto_here_1(target);
+    return scm_from_double(cost);
+}
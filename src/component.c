@@ -8,24 +8,15 @@
 #include "component.h"
 #include "preferred_value.h"
 #include "random.h"
+#include "trace.h"
 
 SCM component_type;
+SCM resistor_symbol;
+SCM capacitor_symbol;
+SCM inductor_symbol;
 
-SCM make_component(
-    SCM type, 
-    SCM value, 
-    SCM lower_limit, 
-    SCM upper_limit, 
-    SCM is_connected,
-    SCM prng
-);
-SCM get_component_value(SCM component);
-SCM get_component_type(SCM component);
-SCM get_component_lower_limit(SCM component);
-SCM get_component_upper_limit(SCM component);
-SCM get_component_is_connected(SCM component);
-SCM set_component_is_connected(SCM is_connected, SCM component);
-SCM get_component_prng(SCM component);
+_Noreturn void invalid_component_type_error(void);
+static SCM random_update_component(SCM component);
 
 
 void init_component_type(void) {
@@ -45,8 +36,12 @@ void init_component_type(void) {
     finalizer = NULL;
     component_type = scm_make_foreign_object_type(name, slots, finalizer);
 
+    resistor_symbol = scm_from_utf8_symbol("resistor");
+    capacitor_symbol = scm_from_utf8_symbol("capacitor");
+    inductor_symbol = scm_from_utf8_symbol("inductor");
+
     __extension__
-    scm_c_define_gsubr("make-component", 4, 0, 0, (scm_t_subr) make_component);
+    scm_c_define_gsubr("make-component", 4, 2, 0, (scm_t_subr) make_component);
     __extension__
     scm_c_define_gsubr("get-component-value", 1, 0, 0, (scm_t_subr) get_component_value);
     __extension__
@@ -76,6 +71,13 @@ SCM make_component(
     scm_assert_foreign_object_type(preferred_component_value_type, lower_limit);
     scm_assert_foreign_object_type(preferred_component_value_type, upper_limit);
 
+    if (SCM_UNBNDP(is_connected)) {
+        is_connected = SCM_BOOL_T;
+    }
+    if (SCM_UNBNDP(prng)) {
+        prng = SCM_BOOL_F;
+    }
+
     SCM component_fields[] = 
         {type, value, lower_limit, upper_limit, is_connected, prng};
     return scm_make_foreign_object_n(component_type, 6, (void **) component_fields);
@@ -150,32 +152,53 @@ double complex component_impedance(double angular_frequency, SCM component) {
         return INFINITY;
     }
 
-    SCM type = get_component_type(component);
     double value = evaluated_component_value(get_component_value(component));
 
-    if (scm_eq_p(type, scm_from_utf8_symbol("resistor"))) {
-        return value;
+    switch (component_kind(component)) {
+        case RESISTOR_COMPONENT:
+            return value;
+        case CAPACITOR_COMPONENT:
+            return 1.0 / (I * angular_frequency * value);
+        case INDUCTOR_COMPONENT:
+            return I * angular_frequency * value;
     }
-    else if (scm_eq_p(type, scm_from_utf8_symbol("capacitor"))) {
-        return 1.0 / (I * angular_frequency * value);
+    invalid_component_type_error();
+}
+
+ComponentKind component_kind(SCM component) {
+    SCM type = get_component_type(component);
+
+    if (scm_is_eq(type, resistor_symbol)) {
+        return RESISTOR_COMPONENT;
     }
-    else if (scm_eq_p(type, scm_from_utf8_symbol("inductor"))) {
-        return I * angular_frequency * value;
+    else if (scm_is_eq(type, capacitor_symbol)) {
+        return CAPACITOR_COMPONENT;
     }
-    else {
-        scm_error_scm(
-            scm_from_utf8_string("invalid-component-type"), 
-            SCM_BOOL_F, 
-            scm_from_utf8_string("Invalid component type."),
-            SCM_BOOL_F,
-            SCM_BOOL_F
-        );
+    else if (scm_is_eq(type, inductor_symbol)) {
+        return INDUCTOR_COMPONENT;
     }
+    invalid_component_type_error();
+}
+
+_Noreturn void invalid_component_type_error(void) {
+    scm_error_scm(
+        scm_from_utf8_string("invalid-component-type"), 
+        SCM_BOOL_F, 
+        scm_from_utf8_string("Invalid component type."),
+        SCM_BOOL_F,
+        SCM_BOOL_F
+    );
 }
 
 SCM component_random_update(SCM component) {
     scm_assert_foreign_object_type(component_type, component);
+    TRACE_SCOPE_BEGIN("propose");
+    random_update_component(component);
+    TRACE_SCOPE_END();
+    return get_component_value(component);
+}
 
+static SCM random_update_component(SCM component) {
     SCM value = get_component_value(component);
     SCM min_range = get_component_lower_limit(component);
     SCM max_range = get_component_upper_limit(component);
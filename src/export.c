@@ -0,0 +1,385 @@
+#include <complex.h>
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "batch_sweep.h"
+#include "export.h"
+#include "flat_filter.h"
+#include "numeric_vector.h"
+#include "trace.h"
+#include "two_port_network.h"
+
+/*
+ * Touchstone and CSV export straight from the batch sweep. Candidates are
+ * swept in blocks that keep the network buffer near EXPORT_BLOCK_BYTES, and
+ * numbers are formatted by hand into a large buffer that is written out
+ * whole, instead of going through printf once per number. Values are
+ * written with nine significant digits; the last digit can differ by one
+ * from printf's rounding, well inside what the downstream tools read.
+ */
+
+#define EXPORT_BLOCK_BYTES (32 * 1024 * 1024)
+#define WRITE_BUFFER_BYTES (1024 * 1024)
+#define NUMBER_BYTES 32
+#define SIGNIFICANT_DIGITS 9
+
+static const double TWO_PI = 6.28318530717958647692;
+
+typedef struct {
+    FILE *file;
+    const char *path;
+    const char *subr;
+    char *buffer;
+    size_t length;
+} TextWriter;
+
+SCM export_touchstone(SCM filters, SCM angular_frequencies, SCM reference_impedance, SCM paths);
+SCM export_csv(SCM filters, SCM angular_frequencies, SCM path);
+
+void init_export(void) {
+    __extension__
+    scm_c_define_gsubr("export-touchstone", 4, 0, 0, (scm_t_subr) export_touchstone);
+    __extension__
+    scm_c_define_gsubr("export-csv", 3, 0, 0, (scm_t_subr) export_csv);
+}
+
+static _Noreturn void writer_error(TextWriter *writer) {
+    int error = errno;
+    if (writer->file != NULL) {
+        fclose(writer->file);
+        writer->file = NULL;
+    }
+    errno = error;
+    scm_syserror_msg(
+        writer->subr, 
+        "Cannot write ~A: ~A", 
+        scm_list_2(scm_from_utf8_string(writer->path), scm_strerror(scm_from_int(error))), 
+        error
+    );
+}
+
+static void open_writer(TextWriter *writer, const char *path, const char *subr, char *buffer) {
+    writer->path = path;
+    writer->subr = subr;
+    writer->buffer = buffer;
+    writer->length = 0;
+    writer->file = fopen(path, "w");
+    if (writer->file == NULL) {
+        writer_error(writer);
+    }
+}
+
+static void flush_writer(TextWriter *writer) {
+    if (fwrite(writer->buffer, 1, writer->length, writer->file) != writer->length) {
+        writer_error(writer);
+    }
+    writer->length = 0;
+}
+
+static void close_writer(TextWriter *writer) {
+    flush_writer(writer);
+    if (fclose(writer->file) != 0) {
+        writer->file = NULL;
+        writer_error(writer);
+    }
+    writer->file = NULL;
+}
+
+/* Makes room for at least size more bytes and returns where they go. */
+static char *reserve_text(TextWriter *writer, size_t size) {
+    if (writer->length + size > WRITE_BUFFER_BYTES) {
+        flush_writer(writer);
+    }
+    return writer->buffer + writer->length;
+}
+
+static void write_text(TextWriter *writer, const char *text) {
+    size_t length = strlen(text);
+    memcpy(reserve_text(writer, length), text, length);
+    writer->length += length;
+}
+
+static double power_of_ten(int exponent) {
+    static const double exact[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    if (exponent >= 0 && exponent <= 22) {
+        return exact[exponent];
+    }
+    return pow(10, exponent);
+}
+
+/* value * 10^shift, split so subnormal and huge values do not overflow the power. */
+static double scale_by_power_of_ten(double value, int shift) {
+    while (shift > 300) {
+        value *= 1e300;
+        shift -= 300;
+    }
+    while (shift < -300) {
+        value /= 1e300;
+        shift += 300;
+    }
+    return shift >= 0 ? value * power_of_ten(shift) : value / power_of_ten(-shift);
+}
+
+/* Writes value as d.dddddddde+XX into text and returns the length. */
+static size_t format_number(double value, char *text) {
+    if (!isfinite(value)) {
+        const char *word = isnan(value) ? "nan" : (value > 0 ? "inf" : "-inf");
+        strcpy(text, word);
+        return strlen(word);
+    }
+
+    char *cursor = text;
+    if (signbit(value)) {
+        *cursor++ = '-';
+        value = -value;
+    }
+    int exponent = 0;
+    uint64_t mantissa = 0;
+    if (value != 0) {
+        exponent = (int) floor(log10(value));
+        int shift = SIGNIFICANT_DIGITS - 1 - exponent;
+        mantissa = (uint64_t) llround(scale_by_power_of_ten(value, shift));
+        /* log10 can be off by one near powers of ten; renormalize. */
+        if (mantissa >= 1000000000) {
+            exponent++;
+            mantissa = (mantissa + 5) / 10;
+        }
+        else if (mantissa < 100000000) {
+            exponent--;
+            shift++;
+            mantissa = (uint64_t) llround(scale_by_power_of_ten(value, shift));
+        }
+    }
+
+    char digits[SIGNIFICANT_DIGITS];
+    for (int i = SIGNIFICANT_DIGITS - 1; i >= 0; i--) {
+        digits[i] = (char) ('0' + mantissa % 10);
+        mantissa /= 10;
+    }
+    *cursor++ = digits[0];
+    *cursor++ = '.';
+    memcpy(cursor, digits + 1, SIGNIFICANT_DIGITS - 1);
+    cursor += SIGNIFICANT_DIGITS - 1;
+    *cursor++ = 'e';
+    *cursor++ = exponent < 0 ? '-' : '+';
+    int magnitude = exponent < 0 ? -exponent : exponent;
+    if (magnitude >= 100) {
+        *cursor++ = (char) ('0' + magnitude / 100);
+    }
+    *cursor++ = (char) ('0' + magnitude / 10 % 10);
+    *cursor++ = (char) ('0' + magnitude % 10);
+    return (size_t) (cursor - text);
+}
+
+static void write_number(TextWriter *writer, double value, char separator) {
+    char *text = reserve_text(writer, NUMBER_BYTES);
+    size_t length = format_number(value, text);
+    text[length] = separator;
+    writer->length += length + 1;
+}
+
+static void write_integer(TextWriter *writer, size_t value, char separator) {
+    char digits[24];
+    size_t count = 0;
+    do {
+        digits[count++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    char *text = reserve_text(writer, count + 1);
+    for (size_t i = 0; i < count; i++) {
+        text[i] = digits[count - 1 - i];
+    }
+    text[count] = separator;
+    writer->length += count + 1;
+}
+
+/* Calls write_block for each block of candidates with their networks. */
+typedef void (*BlockWriter)(
+    size_t first_filter, 
+    size_t filter_count, 
+    const TwoPortNetwork *networks, 
+    void *context
+);
+
+static void sweep_in_blocks(
+    FlatFilter **filters, 
+    size_t filter_count, 
+    const double *angular_frequencies, 
+    size_t frequency_count, 
+    BlockWriter write_block, 
+    void *context
+) {
+    size_t row_bytes = (frequency_count + 1) * sizeof(TwoPortNetwork);
+    size_t block = EXPORT_BLOCK_BYTES / row_bytes;
+    block = block > 0 ? block : 1;
+    block = block < filter_count ? block : filter_count;
+    TwoPortNetwork *networks = scm_gc_malloc_pointerless(
+        (block * frequency_count + 1) * sizeof(TwoPortNetwork), "export networks"
+    );
+    for (size_t first = 0; first < filter_count; first += block) {
+        size_t count = filter_count - first < block ? filter_count - first : block;
+        TRACE_BEGIN("evaluate");
+        batch_filter_networks(filters + first, count, angular_frequencies, frequency_count, networks);
+        TRACE_END("evaluate");
+        write_block(first, count, networks, context);
+    }
+}
+
+typedef struct {
+    SCM paths;
+    const double *angular_frequencies;
+    size_t frequency_count;
+    double reference_impedance;
+    char *buffer;
+} TouchstoneExport;
+
+static void write_touchstone_block(
+    size_t first_filter, 
+    size_t filter_count, 
+    const TwoPortNetwork *networks, 
+    void *context
+) {
+    TouchstoneExport *export = context;
+    double z0 = export->reference_impedance;
+    for (size_t i = 0; i < filter_count; i++) {
+        char *path = scm_to_locale_string(SCM_SIMPLE_VECTOR_REF(export->paths, first_filter + i));
+        scm_dynwind_begin(0);
+        scm_dynwind_free(path);
+
+        TextWriter writer;
+        open_writer(&writer, path, "export-touchstone", export->buffer);
+        write_text(&writer, "! Two-port S-parameters from the ABCD cascade\n# HZ S RI R ");
+        write_number(&writer, z0, '\n');
+        for (size_t f = 0; f < export->frequency_count; f++) {
+            const TwoPortNetwork *network = &networks[i * export->frequency_count + f];
+            double complex a = network->element11;
+            double complex b = network->element12 / z0;
+            double complex c = network->element21 * z0;
+            double complex d = network->element22;
+            double complex denominator = a + b + c + d;
+            double complex s11 = (a + b - c - d) / denominator;
+            double complex s21 = 2.0 / denominator;
+            double complex s12 = 2.0 * (a * d - network->element12 * network->element21) / denominator;
+            double complex s22 = (-a + b - c + d) / denominator;
+
+            write_number(&writer, export->angular_frequencies[f] / TWO_PI, ' ');
+            double complex parameters[4] = {s11, s21, s12, s22};
+            for (size_t p = 0; p < 4; p++) {
+                write_number(&writer, creal(parameters[p]), ' ');
+                write_number(&writer, cimag(parameters[p]), p == 3 ? '\n' : ' ');
+            }
+        }
+        close_writer(&writer);
+        scm_dynwind_end();
+    }
+}
+
+/*
+ * Writes one Touchstone .s2p file per filter, in Hz with real/imaginary
+ * S-parameters normalized to the given real reference impedance.
+ */
+SCM export_touchstone(SCM filters, SCM angular_frequencies, SCM reference_impedance, SCM paths) {
+    const char *subr = "export-touchstone";
+    FlatFilter **flat_filters = compile_filters(filters, SCM_ARG1, subr);
+    size_t filter_count = SCM_SIMPLE_VECTOR_LENGTH(filters);
+    SCM_ASSERT_TYPE(
+        scm_is_vector(paths) && SCM_SIMPLE_VECTOR_LENGTH(paths) == filter_count, 
+        paths, 
+        SCM_ARG4, 
+        subr, 
+        "Vector of file names, one per filter");
+    for (size_t i = 0; i < filter_count; i++) {
+        SCM_ASSERT_TYPE(scm_is_string(SCM_SIMPLE_VECTOR_REF(paths, i)), paths, SCM_ARG4, subr, "Vector of file names, one per filter");
+    }
+
+    TouchstoneExport export;
+    export.paths = paths;
+    export.angular_frequencies = double_array_from_vector(
+        angular_frequencies, &export.frequency_count, SCM_ARG2, subr
+    );
+    export.reference_impedance = scm_to_double(reference_impedance);
+    if (!(export.reference_impedance > 0) || isinf(export.reference_impedance)) {
+        scm_out_of_range(subr, reference_impedance);
+    }
+    export.buffer = scm_gc_malloc_pointerless(WRITE_BUFFER_BYTES, "export buffer");
+
+    sweep_in_blocks(
+        flat_filters, 
+        filter_count, 
+        export.angular_frequencies, 
+        export.frequency_count, 
+        write_touchstone_block, 
+        &export
+    );
+    scm_remember_upto_here_1(paths);
+    return SCM_UNSPECIFIED;
+}
+
+typedef struct {
+    TextWriter *writer;
+    const double *angular_frequencies;
+    size_t frequency_count;
+} CsvExport;
+
+static void write_csv_block(
+    size_t first_filter, 
+    size_t filter_count, 
+    const TwoPortNetwork *networks, 
+    void *context
+) {
+    CsvExport *export = context;
+    for (size_t i = 0; i < filter_count; i++) {
+        for (size_t f = 0; f < export->frequency_count; f++) {
+            TwoPortNetwork network = networks[i * export->frequency_count + f];
+            double complex gain = network_voltage_gain(&network);
+            write_integer(export->writer, first_filter + i, ',');
+            write_number(export->writer, export->angular_frequencies[f] / TWO_PI, ',');
+            write_number(export->writer, creal(gain), ',');
+            write_number(export->writer, cimag(gain), ',');
+            write_number(export->writer, 20 * log10(cabs(gain)), '\n');
+        }
+    }
+}
+
+/*
+ * Writes every filter's gains to one CSV file with the columns
+ * candidate, frequency_hz, real, imaginary, magnitude_db.
+ */
+SCM export_csv(SCM filters, SCM angular_frequencies, SCM path) {
+    const char *subr = "export-csv";
+    FlatFilter **flat_filters = compile_filters(filters, SCM_ARG1, subr);
+    size_t filter_count = SCM_SIMPLE_VECTOR_LENGTH(filters);
+    CsvExport export;
+    export.angular_frequencies = double_array_from_vector(
+        angular_frequencies, &export.frequency_count, SCM_ARG2, subr
+    );
+    SCM_ASSERT_TYPE(scm_is_string(path), path, SCM_ARG3, subr, "File name");
+
+    char *file_name = scm_to_locale_string(path);
+    scm_dynwind_begin(0);
+    scm_dynwind_free(file_name);
+    TextWriter writer;
+    open_writer(&writer, file_name, subr, scm_gc_malloc_pointerless(WRITE_BUFFER_BYTES, "export buffer"));
+    export.writer = &writer;
+    write_text(&writer, "candidate,frequency_hz,real,imaginary,magnitude_db\n");
+    sweep_in_blocks(
+        flat_filters, 
+        filter_count, 
+        export.angular_frequencies, 
+        export.frequency_count, 
+        write_csv_block, 
+        &export
+    );
+    close_writer(&writer);
+    scm_dynwind_end();
+    return SCM_UNSPECIFIED;
+}
@@ -0,0 +1,164 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <complex.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fft.h"
+
+/*
+ * Recursive decimation-in-time transform over the prime factors of the
+ * length: radix 2 butterflies, with a direct DFT for every other factor.
+ * A plan holds the factorization and the forward twiddles for one length;
+ * plans are built on first use and kept for the life of the process in a
+ * list guarded by a mutex.
+ */
+
+#define MAX_FACTORS 64
+
+static const double TWO_PI = 6.28318530717958647692;
+
+typedef struct FftPlan {
+    size_t count;
+    size_t factor_count;
+    size_t factors[MAX_FACTORS];
+    size_t max_radix;
+    double complex *twiddles;
+    struct FftPlan *next;
+} FftPlan;
+
+static pthread_mutex_t plan_lock = PTHREAD_MUTEX_INITIALIZER;
+static FftPlan *plans;
+
+static FftPlan *make_plan(size_t count) {
+    FftPlan *plan = malloc(sizeof(FftPlan));
+    if (plan == NULL) {
+        return NULL;
+    }
+    plan->twiddles = malloc(count * sizeof(double complex));
+    if (plan->twiddles == NULL) {
+        free(plan);
+        return NULL;
+    }
+    plan->count = count;
+    for (size_t k = 0; k < count; k++) {
+        plan->twiddles[k] = cexp(-I * TWO_PI * (double) k / (double) count);
+    }
+
+    plan->factor_count = 0;
+    plan->max_radix = 1;
+    size_t remaining = count;
+    for (size_t radix = 2; remaining > 1;) {
+        if (remaining % radix == 0) {
+            plan->factors[plan->factor_count++] = radix;
+            plan->max_radix = radix > plan->max_radix ? radix : plan->max_radix;
+            remaining /= radix;
+        }
+        else {
+            radix = radix * radix > remaining ? remaining : radix + 1;
+        }
+    }
+    return plan;
+}
+
+static FftPlan *get_plan(size_t count) {
+    pthread_mutex_lock(&plan_lock);
+    FftPlan *plan = plans;
+    while (plan != NULL && plan->count != count) {
+        plan = plan->next;
+    }
+    if (plan == NULL) {
+        plan = make_plan(count);
+        if (plan != NULL) {
+            plan->next = plans;
+            plans = plan;
+        }
+    }
+    pthread_mutex_unlock(&plan_lock);
+    return plan;
+}
+
+static void butterfly(
+    const FftPlan *plan, 
+    double complex *output, 
+    size_t stride, 
+    size_t radix, 
+    size_t span, 
+    double complex *scratch
+) {
+    if (radix == 2) {
+        for (size_t u = 0; u < span; u++) {
+            double complex term = output[u + span] * plan->twiddles[u * stride];
+            output[u + span] = output[u] - term;
+            output[u] += term;
+        }
+        return;
+    }
+
+    for (size_t u = 0; u < span; u++) {
+        for (size_t q = 0; q < radix; q++) {
+            scratch[q] = output[q * span + u];
+        }
+        for (size_t k = 0; k < radix; k++) {
+            size_t index = u + k * span;
+            double complex sum = scratch[0];
+            for (size_t q = 1; q < radix; q++) {
+                sum += scratch[q] * plan->twiddles[(q * index * stride) % plan->count];
+            }
+            output[index] = sum;
+        }
+    }
+}
+
+static void transform(
+    const FftPlan *plan, 
+    double complex *output, 
+    const double complex *input, 
+    size_t stride, 
+    const size_t *factors, 
+    double complex *scratch
+) {
+    size_t radix = factors[0];
+    size_t span = plan->count / (stride * radix);
+    if (span == 1) {
+        for (size_t j = 0; j < radix; j++) {
+            output[j] = input[j * stride];
+        }
+    }
+    else {
+        for (size_t j = 0; j < radix; j++) {
+            transform(plan, output + j * span, input + j * stride, stride * radix, factors + 1, scratch);
+        }
+    }
+    butterfly(plan, output, stride, radix, span, scratch);
+}
+
+bool fft(double complex *values, size_t count, bool inverse) {
+    if (count <= 1) {
+        return true;
+    }
+    FftPlan *plan = get_plan(count);
+    if (plan == NULL) {
+        return false;
+    }
+    double complex *work = malloc((count + plan->max_radix) * sizeof(double complex));
+    if (work == NULL) {
+        return false;
+    }
+
+    /* The inverse is the conjugate of the forward transform of the conjugate. */
+    for (size_t i = 0; i < count; i++) {
+        work[i] = inverse ? conj(values[i]) : values[i];
+    }
+    transform(plan, values, work, 1, plan->factors, work + count);
+    if (inverse) {
+        for (size_t i = 0; i < count; i++) {
+            values[i] = conj(values[i]);
+        }
+    }
+    free(work);
+    return true;
+}
@@ -1,22 +1,19 @@
 #include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
 
 #include "load.h"
 #include "two_port_network.h"
 #include "filter.h"
+#include "trace.h"
 
 SCM filter_stage_type;
 
 SCM series_filter_symbol;
 SCM shunt_filter_symbol;
-SCM make_shunt_filter_stage(SCM load);
 
-void init_filter_stage_type(void);
-SCM make_series_filter_stage(SCM load);
-SCM make_shunt_filter_stage(SCM load);
 SCM filter_voltage_gain(SCM angular_frequency, SCM stages);
-SCM get_filter_stage_type(SCM filter_stage);
-SCM get_filter_stage_load(SCM filter_stage);
+void get_long_filter_network(TwoPortNetwork *network, double angular_frequency, SCM stages);
 
 void init_filter_stage_type(void) {
     SCM name, slots;
@@ -82,10 +79,10 @@ void filter_stage_network(TwoPortNetwork *network, double angular_frequency, SCM
 
     double complex impedance = load_impedance(angular_frequency, load);
 
-    if (scm_eq_p(type, series_filter_symbol)) {
+    if (scm_is_eq(type, series_filter_symbol)) {
         series_connected_network(network, impedance);
     }
-    else if (scm_eq_p(type, shunt_filter_symbol)) {
+    else if (scm_is_eq(type, shunt_filter_symbol)) {
         shunt_connected_network(network, impedance);
     }
     else {
@@ -100,9 +97,15 @@ void filter_stage_network(TwoPortNetwork *network, double angular_frequency, SCM
 }
 
 void get_filter_network(TwoPortNetwork *network, double angular_frequency, SCM stages) {
+    size_t stage_count = SCM_SIMPLE_VECTOR_LENGTH(stages);
+    if (stage_count >= parallel_cascade_crossover()) {
+        get_long_filter_network(network, angular_frequency, stages);
+        return;
+    }
+
     identity_network(network);
     TwoPortNetwork work_area;
-    for (size_t i = 0; i < SCM_SIMPLE_VECTOR_LENGTH(stages); i++) {
+    for (size_t i = 0; i < stage_count; i++) {
         SCM stage = SCM_SIMPLE_VECTOR_REF(stages, i);
         scm_assert_foreign_object_type(filter_stage_type, stage);
         filter_stage_network(&work_area, angular_frequency, stage);
@@ -110,9 +113,66 @@ void get_filter_network(TwoPortNetwork *network, double angular_frequency, SCM s
     }
 }
 
+typedef struct {
+    TwoPortNetwork *networks;
+    size_t capacity;
+} StageNetworkBuffer;
+
+static pthread_key_t stage_buffer_key;
+static pthread_once_t stage_buffer_once = PTHREAD_ONCE_INIT;
+
+static void free_stage_buffer(void *buffer) {
+    free(((StageNetworkBuffer *) buffer)->networks);
+    free(buffer);
+}
+
+static void create_stage_buffer_key(void) {
+    pthread_key_create(&stage_buffer_key, free_stage_buffer);
+}
+
+/* Per-thread scratch for stage matrices, kept between calls and freed at thread exit. */
+static TwoPortNetwork *stage_network_buffer(size_t count) {
+    pthread_once(&stage_buffer_once, create_stage_buffer_key);
+    StageNetworkBuffer *buffer = pthread_getspecific(stage_buffer_key);
+    if (buffer == NULL) {
+        buffer = calloc(1, sizeof(StageNetworkBuffer));
+        if (buffer == NULL || pthread_setspecific(stage_buffer_key, buffer) != 0) {
+            free(buffer);
+            scm_memory_error("get-filter-network");
+        }
+    }
+    if (count > buffer->capacity) {
+        TwoPortNetwork *grown = realloc(buffer->networks, count * sizeof(TwoPortNetwork));
+        if (grown == NULL) {
+            scm_memory_error("get-filter-network");
+        }
+        buffer->networks = grown;
+        buffer->capacity = count;
+    }
+    return buffer->networks;
+}
+
+/*
+ * Stage matrices are built on the calling thread, which owns the Guile
+ * objects; only the pure matrix product is split across threads. An error
+ * while building them leaves the per-thread buffer in place for reuse.
+ */
+void get_long_filter_network(TwoPortNetwork *network, double angular_frequency, SCM stages) {
+    size_t stage_count = SCM_SIMPLE_VECTOR_LENGTH(stages);
+    TwoPortNetwork *stage_networks = stage_network_buffer(stage_count);
+    for (size_t i = 0; i < stage_count; i++) {
+        SCM stage = SCM_SIMPLE_VECTOR_REF(stages, i);
+        scm_assert_foreign_object_type(filter_stage_type, stage);
+        filter_stage_network(&stage_networks[i], angular_frequency, stage);
+    }
+    parallel_cascade_networks(network, stage_networks, stage_count);
+}
+
 SCM filter_voltage_gain(SCM angular_frequency, SCM stages) {
     TwoPortNetwork filter_network;
+    TRACE_SCOPE_BEGIN("evaluate");
     get_filter_network(&filter_network, scm_to_double(angular_frequency), stages);
+    TRACE_SCOPE_END();
     double complex complex_gain = network_voltage_gain(&filter_network);
     SCM real_part = scm_from_double(creal(complex_gain));
     SCM imag_part = scm_from_double(cimag(complex_gain));
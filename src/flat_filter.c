@@ -0,0 +1,260 @@
+#include <assert.h>
+#include <complex.h>
+#include <math.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "component.h"
+#include "filter.h"
+#include "flat_filter.h"
+#include "load.h"
+#include "preferred_value.h"
+
+static void count_load(SCM load, FlatFilter *filter) {
+    SCM type = get_load_type(load);
+    SCM elements = get_load_elements(load);
+
+    filter->node_count++;
+    if (scm_is_eq(type, component_load_symbol)) {
+        filter->component_count++;
+    }
+    else if (scm_is_eq(type, series_load_symbol) || scm_is_eq(type, parallel_load_symbol)) {
+        for (size_t i = 0; i < SCM_SIMPLE_VECTOR_LENGTH(elements); i++) {
+            count_load(SCM_SIMPLE_VECTOR_REF(elements, i), filter);
+        }
+    }
+    else {
+        invalid_load_type_error();
+    }
+}
+
+void flatten_component(SCM component, FlatComponent *flat_component) {
+    flat_component->kind = component_kind(component);
+    flat_component->lower_rank = 
+        preferred_component_value_rank(get_component_lower_limit(component));
+    flat_component->upper_rank = 
+        preferred_component_value_rank(get_component_upper_limit(component));
+    flat_component->is_connected = scm_is_true(get_component_is_connected(component));
+    set_flat_component_rank(
+        flat_component, 
+        preferred_component_value_rank(get_component_value(component))
+    );
+}
+
+static void flatten_load(SCM load, FlatFilter *filter) {
+    SCM type = get_load_type(load);
+    SCM elements = get_load_elements(load);
+    FlatNode *node = &filter->nodes[filter->node_count++];
+
+    if (scm_is_eq(type, component_load_symbol)) {
+        node->kind = COMPONENT_NODE;
+        node->operand = filter->component_count++;
+        flatten_component(elements, &filter->components[node->operand]);
+    }
+    else {
+        node->kind = scm_is_eq(type, series_load_symbol) ? SERIES_NODE : PARALLEL_NODE;
+        node->operand = SCM_SIMPLE_VECTOR_LENGTH(elements);
+        for (size_t i = 0; i < node->operand; i++) {
+            flatten_load(SCM_SIMPLE_VECTOR_REF(elements, i), filter);
+        }
+    }
+}
+
+static FlatFilter *allocate_flat_filter(
+    size_t component_count, 
+    size_t node_count, 
+    size_t stage_count
+) {
+    /* One pointerless block: the header only points into itself. */
+    size_t size = 
+        sizeof(FlatFilter) + 
+        component_count * sizeof(FlatComponent) + 
+        node_count * sizeof(FlatNode) + 
+        stage_count * sizeof(FlatStage);
+    FlatFilter *filter = scm_gc_malloc_pointerless(size, "flat filter");
+
+    filter->component_count = component_count;
+    filter->node_count = node_count;
+    filter->stage_count = stage_count;
+    filter->components = (FlatComponent *) (filter + 1);
+    filter->nodes = (FlatNode *) (filter->components + component_count);
+    filter->stages = (FlatStage *) (filter->nodes + node_count);
+    return filter;
+}
+
+FlatFilter *compile_filter(SCM stages) {
+    SCM_ASSERT_TYPE(
+        scm_is_vector(stages), 
+        stages, 
+        0, 
+        "compile-filter", 
+        "Vector of filter stages");
+
+    FlatFilter sizes = {0};
+    size_t stage_count = SCM_SIMPLE_VECTOR_LENGTH(stages);
+    for (size_t i = 0; i < stage_count; i++) {
+        count_load(get_filter_stage_load(SCM_SIMPLE_VECTOR_REF(stages, i)), &sizes);
+    }
+
+    FlatFilter *filter = allocate_flat_filter(
+        sizes.component_count, 
+        sizes.node_count, 
+        stage_count
+    );
+    filter->component_count = 0;
+    filter->node_count = 0;
+    for (size_t i = 0; i < stage_count; i++) {
+        SCM stage = SCM_SIMPLE_VECTOR_REF(stages, i);
+        SCM type = get_filter_stage_type(stage);
+        FlatStage *flat_stage = &filter->stages[i];
+
+        if (scm_is_eq(type, series_filter_symbol)) {
+            flat_stage->kind = SERIES_STAGE;
+        }
+        else if (scm_is_eq(type, shunt_filter_symbol)) {
+            flat_stage->kind = SHUNT_STAGE;
+        }
+        else {
+            scm_error_scm(
+                scm_from_utf8_string("invalid-stage-type"), 
+                SCM_BOOL_F, 
+                scm_from_utf8_string("Invalid filter stage type."),
+                SCM_BOOL_F,
+                SCM_BOOL_F
+            );
+        }
+        flat_stage->first_node = filter->node_count;
+        flatten_load(get_filter_stage_load(stage), filter);
+        flat_stage->node_count = filter->node_count - flat_stage->first_node;
+    }
+    return filter;
+}
+
+FlatFilter *copy_flat_filter(const FlatFilter *filter) {
+    FlatFilter *copy = allocate_flat_filter(
+        filter->component_count, 
+        filter->node_count, 
+        filter->stage_count
+    );
+    memcpy(copy->components, filter->components, filter->component_count * sizeof(FlatComponent));
+    memcpy(copy->nodes, filter->nodes, filter->node_count * sizeof(FlatNode));
+    memcpy(copy->stages, filter->stages, filter->stage_count * sizeof(FlatStage));
+    return copy;
+}
+
+static void store_load_state(SCM load, const FlatFilter *filter, size_t *component) {
+    SCM type = get_load_type(load);
+    SCM elements = get_load_elements(load);
+
+    if (scm_is_eq(type, component_load_symbol)) {
+        const FlatComponent *flat_component = &filter->components[(*component)++];
+        set_preferred_component_value_rank(
+            get_component_value(elements), 
+            flat_component->rank
+        );
+        set_component_is_connected(
+            scm_from_bool(flat_component->is_connected), 
+            elements
+        );
+    }
+    else {
+        for (size_t i = 0; i < SCM_SIMPLE_VECTOR_LENGTH(elements); i++) {
+            store_load_state(SCM_SIMPLE_VECTOR_REF(elements, i), filter, component);
+        }
+    }
+}
+
+/* Writes the ranks and connection flags back into the stages it came from. */
+void store_flat_filter_state(const FlatFilter *filter, SCM stages) {
+    size_t component = 0;
+    for (size_t i = 0; i < SCM_SIMPLE_VECTOR_LENGTH(stages); i++) {
+        store_load_state(
+            get_filter_stage_load(SCM_SIMPLE_VECTOR_REF(stages, i)), 
+            filter, 
+            &component
+        );
+    }
+    assert(component == filter->component_count);
+}
+
+void set_flat_component_rank(FlatComponent *component, int rank) {
+    component->rank = rank;
+    component->value = preferred_value_from_rank(rank);
+}
+
+double complex flat_component_impedance(double angular_frequency, const FlatComponent *component) {
+    if (!component->is_connected) {
+        return INFINITY;
+    }
+
+    switch (component->kind) {
+        case RESISTOR_COMPONENT:
+            return component->value;
+        case CAPACITOR_COMPONENT:
+            return 1.0 / (I * angular_frequency * component->value);
+        case INDUCTOR_COMPONENT:
+            return I * angular_frequency * component->value;
+    }
+    return NAN;
+}
+
+static double complex node_impedance(
+    double angular_frequency, 
+    const FlatFilter *filter, 
+    size_t *node_index
+) {
+    const FlatNode *node = &filter->nodes[(*node_index)++];
+
+    if (node->kind == COMPONENT_NODE) {
+        return flat_component_impedance(angular_frequency, &filter->components[node->operand]);
+    }
+    else if (node->kind == SERIES_NODE) {
+        double complex sum_impedance = 0;
+        for (size_t i = 0; i < node->operand; i++) {
+            sum_impedance += node_impedance(angular_frequency, filter, node_index);
+        }
+        return sum_impedance;
+    }
+    else {
+        double complex intermediate_impedance = 0;
+        for (size_t i = 0; i < node->operand; i++) {
+            intermediate_impedance += 1.0 / node_impedance(angular_frequency, filter, node_index);
+        }
+        return 1.0 / intermediate_impedance;
+    }
+}
+
+double complex flat_stage_impedance(double angular_frequency, const FlatFilter *filter, size_t stage) {
+    size_t node_index = filter->stages[stage].first_node;
+    return node_impedance(angular_frequency, filter, &node_index);
+}
+
+void flat_stage_network(
+    TwoPortNetwork *network, 
+    double angular_frequency, 
+    const FlatFilter *filter, 
+    size_t stage
+) {
+    double complex impedance = flat_stage_impedance(angular_frequency, filter, stage);
+    if (filter->stages[stage].kind == SERIES_STAGE) {
+        series_connected_network(network, impedance);
+    }
+    else {
+        shunt_connected_network(network, impedance);
+    }
+}
+
+void flat_filter_network(TwoPortNetwork *network, double angular_frequency, const FlatFilter *filter) {
+    identity_network(network);
+    TwoPortNetwork work_area;
+    for (size_t i = 0; i < filter->stage_count; i++) {
+        flat_stage_network(&work_area, angular_frequency, filter, i);
+        cascade_network(network, network, &work_area);
+    }
+}
+
+double complex flat_filter_voltage_gain(double angular_frequency, const FlatFilter *filter) {
+    TwoPortNetwork network;
+    flat_filter_network(&network, angular_frequency, filter);
+    return network_voltage_gain(&network);
+}
@@ -1,15 +1,53 @@
+#include "adaptive_sweep.h"
+#include "affine_bounds.h"
+#include "batch_sweep.h"
+#include "codegen.h"
 #include "component.h"
+#include "export.h"
 #include "filter.h"
+#include "island.h"
 #include "load.h"
+#include "load_pool.h"
+#include "neighborhood.h"
+#include "netlist.h"
+#include "nodal.h"
+#include "pareto_archive.h"
 #include "preferred_value.h"
+#include "random.h"
+#include "relaxation.h"
+#include "response_target.h"
+#include "screening.h"
+#include "state_cache.h"
+#include "step_response.h"
+#include "surrogate.h"
+#include "topology.h"
+#include "trace.h"
 #include "two_port_network.h"
 #include <libguile.h>
 
 void init_filtopt() {
+    init_trace();
     init_component_type();
     init_preferred_component_value_type();
     init_load_type();
     init_filter_stage_type();
+    init_rng();
+    init_response_target_type();
+    init_topology();
+    init_load_pool_type();
+    init_batch_sweep();
+    init_adaptive_sweep();
+    init_screening();
+    init_state_cache_type();
+    init_neighborhood();
+    init_pareto_archive_type();
+    init_island_search();
+    init_nodal_circuit_type();
+    init_step_response();
+    init_surrogate_type();
+    init_filter_kernel_type();
+    init_affine_bounds();
+    init_export();
+    init_netlist();
+    init_relaxation();
 }
-
-
@@ -0,0 +1,345 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <math.h>
+#include <signal.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <libguile.h>
+
+#include "flat_filter.h"
+#include "island.h"
+#include "mtwister.h"
+#include "response_target.h"
+
+/*
+ * Island-model annealing. Each island is a forked worker process running
+ * its own simulated annealing over a flat copy of the stages, so islands
+ * share neither a GC heap nor a Guile runtime. Every migration interval an
+ * island sends its best state to the next island in a ring and adopts the
+ * best migrant in its own inbox if that beats its current state.
+ *
+ * Everything the workers touch is set up before forking: the flat filters
+ * come from the GC heap and are only read or written through their
+ * copy-on-write pages, and all shared state lives in one shm_open segment.
+ * Each inbox has exactly one producer and one consumer, so it is a
+ * lock-free single-producer single-consumer ring. Workers never call into
+ * Guile, never use the thread pool and leave with _exit.
+ */
+
+#define MIGRATION_SLOTS 8
+#define TOGGLE_PROBABILITY 0.1
+#define INITIAL_TEMPERATURE_FRACTION 0.1
+#define FINAL_TEMPERATURE_FRACTION 1e-4
+#define DEFAULT_MIGRATION_INTERVAL 200
+#define DEFAULT_SEED 5489
+
+_Static_assert(ATOMIC_LONG_LOCK_FREE == 2, "Shared rings need address-free atomics.");
+
+typedef struct {
+    alignas(64) atomic_size_t head; /* Next slot to read, written by the consumer. */
+    alignas(64) atomic_size_t tail; /* Next slot to write, written by the producer. */
+    uint64_t migrants_adopted;
+} IslandHeader;
+
+/* A migrant slot is a cost followed by int32 ranks and connection bytes. */
+typedef struct {
+    unsigned char *segment;
+    size_t segment_size;
+    size_t island_count;
+    size_t island_size;
+    size_t slot_size;
+    size_t component_count;
+    uint64_t iterations;
+    uint64_t migration_interval;
+    unsigned long seed;
+    FlatFilter **filters;
+    const ResponseTarget *target;
+} IslandSearch;
+
+SCM island_search(SCM stages, SCM target, SCM islands, SCM iterations, SCM interval, SCM seed);
+
+void init_island_search(void) {
+    __extension__
+    scm_c_define_gsubr("island-search", 4, 2, 0, (scm_t_subr) island_search);
+}
+
+static IslandHeader *island_header(const IslandSearch *search, size_t island) {
+    return (IslandHeader *) (search->segment + island * search->island_size);
+}
+
+static unsigned char *island_best(const IslandSearch *search, size_t island) {
+    return (unsigned char *) (island_header(search, island) + 1);
+}
+
+static unsigned char *inbox_slot(const IslandSearch *search, size_t island, size_t slot) {
+    return island_best(search, island) + (1 + slot % MIGRATION_SLOTS) * search->slot_size;
+}
+
+static double slot_cost(const unsigned char *slot) {
+    double cost;
+    memcpy(&cost, slot, sizeof(double));
+    return cost;
+}
+
+static void save_state(unsigned char *slot, const FlatFilter *filter, double cost) {
+    memcpy(slot, &cost, sizeof(double));
+    int32_t *ranks = (int32_t *) (slot + sizeof(double));
+    unsigned char *connections = (unsigned char *) (ranks + filter->component_count);
+    for (size_t i = 0; i < filter->component_count; i++) {
+        ranks[i] = filter->components[i].rank;
+        connections[i] = filter->components[i].is_connected;
+    }
+}
+
+static void load_state(FlatFilter *filter, const unsigned char *slot) {
+    const int32_t *ranks = (const int32_t *) (slot + sizeof(double));
+    const unsigned char *connections = (const unsigned char *) (ranks + filter->component_count);
+    for (size_t i = 0; i < filter->component_count; i++) {
+        set_flat_component_rank(&filter->components[i], ranks[i]);
+        filter->components[i].is_connected = connections[i];
+    }
+}
+
+/* Drops the migrant if the receiving island has not kept up. */
+static bool send_migrant(IslandSearch *search, size_t island, const unsigned char *state) {
+    IslandHeader *inbox = island_header(search, island);
+    size_t tail = atomic_load_explicit(&inbox->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&inbox->head, memory_order_acquire);
+    if (tail - head == MIGRATION_SLOTS) {
+        return false;
+    }
+    memcpy(inbox_slot(search, island, tail), state, search->slot_size);
+    atomic_store_explicit(&inbox->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+/* Drains the inbox, adopting the best migrant if it beats cost. Returns the new cost. */
+static double receive_migrants(IslandSearch *search, size_t island, FlatFilter *filter, double cost) {
+    IslandHeader *inbox = island_header(search, island);
+    size_t head = atomic_load_explicit(&inbox->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&inbox->tail, memory_order_acquire);
+    const unsigned char *best = NULL;
+    for (; head != tail; head++) {
+        const unsigned char *slot = inbox_slot(search, island, head);
+        if (slot_cost(slot) < (best == NULL ? cost : slot_cost(best))) {
+            best = slot;
+        }
+    }
+    if (best != NULL) {
+        load_state(filter, best);
+        cost = slot_cost(best);
+        inbox->migrants_adopted++;
+    }
+    atomic_store_explicit(&inbox->head, head, memory_order_release);
+    return cost;
+}
+
+static void run_island(IslandSearch *search, size_t island) {
+    FlatFilter *filter = search->filters[island];
+    unsigned char *best = island_best(search, island);
+    MTRand prng = seedRand(search->seed + island);
+
+    double cost = flat_filter_cost(filter, search->target);
+    save_state(best, filter, cost);
+    double temperature = INITIAL_TEMPERATURE_FRACTION * cost;
+    if (!(temperature > 0)) {
+        temperature = DBL_MIN;
+    }
+    double cooling = pow(
+        FINAL_TEMPERATURE_FRACTION / INITIAL_TEMPERATURE_FRACTION, 
+        1.0 / (double) search->iterations
+    );
+
+    for (uint64_t iteration = 1; iteration <= search->iterations; iteration++) {
+        FlatComponent *component = &filter->components[genRandLong(&prng) % filter->component_count];
+        int old_rank = component->rank;
+        bool toggle = 
+            !component->is_connected || 
+            component->lower_rank == component->upper_rank || 
+            genRand(&prng) < TOGGLE_PROBABILITY;
+        if (toggle) {
+            component->is_connected = !component->is_connected;
+        }
+        else {
+            int rank = old_rank + (genRandLong(&prng) & 1 ? 1 : -1);
+            if (rank < component->lower_rank || rank > component->upper_rank) {
+                rank = 2 * old_rank - rank;
+            }
+            set_flat_component_rank(component, rank);
+        }
+
+        double candidate_cost = flat_filter_cost(filter, search->target);
+        if (
+            candidate_cost <= cost || 
+            genRand(&prng) < exp((cost - candidate_cost) / temperature)
+        ) {
+            cost = candidate_cost;
+            if (cost < slot_cost(best)) {
+                save_state(best, filter, cost);
+            }
+        }
+        else if (toggle) {
+            component->is_connected = !component->is_connected;
+        }
+        else {
+            set_flat_component_rank(component, old_rank);
+        }
+        temperature *= cooling;
+
+        if (iteration % search->migration_interval == 0 && search->island_count > 1) {
+            send_migrant(search, (island + 1) % search->island_count, best);
+            cost = receive_migrants(search, island, filter, cost);
+            if (cost < slot_cost(best)) {
+                save_state(best, filter, cost);
+            }
+        }
+    }
+}
+
+static void discard_islands(IslandSearch *search, pid_t *workers, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        kill(workers[i], SIGKILL);
+        while (waitpid(workers[i], NULL, 0) < 0 && errno == EINTR);
+    }
+    munmap(search->segment, search->segment_size);
+}
+
+static void map_segment(IslandSearch *search) {
+    static atomic_uint segment_counter;
+    char name[64];
+    snprintf(
+        name, 
+        sizeof(name), 
+        "/filtopt-islands-%ld-%u", 
+        (long) getpid(), 
+        atomic_fetch_add(&segment_counter, 1)
+    );
+
+    int descriptor = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (descriptor < 0) {
+        scm_syserror("island-search");
+    }
+    /* The mapping outlives the name; forked workers inherit it. */
+    shm_unlink(name);
+    if (ftruncate(descriptor, search->segment_size) < 0) {
+        int error = errno;
+        close(descriptor);
+        errno = error;
+        scm_syserror("island-search");
+    }
+    void *segment = mmap(
+        NULL, search->segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0
+    );
+    int error = errno;
+    close(descriptor);
+    if (segment == MAP_FAILED) {
+        errno = error;
+        scm_syserror("island-search");
+    }
+    search->segment = segment;
+    memset(search->segment, 0, search->segment_size);
+}
+
+/*
+ * Returns ((cost . best-cost) (island . index) (migrants . adopted)) and
+ * leaves the stages in the best state found by any island.
+ */
+SCM island_search(SCM stages, SCM target, SCM islands, SCM iterations, SCM interval, SCM seed) {
+    FlatFilter *filter = compile_filter(stages);
+    IslandSearch search;
+    search.target = get_response_target(target);
+    search.island_count = scm_to_size_t(islands);
+    search.iterations = scm_to_uint64(iterations);
+    search.migration_interval = SCM_UNBNDP(interval) ? 
+        DEFAULT_MIGRATION_INTERVAL : 
+        scm_to_uint64(interval);
+    search.seed = SCM_UNBNDP(seed) ? DEFAULT_SEED : scm_to_ulong(seed);
+    search.component_count = filter->component_count;
+    if (search.island_count == 0) {
+        scm_out_of_range("island-search", islands);
+    }
+    if (search.iterations == 0) {
+        scm_out_of_range("island-search", iterations);
+    }
+    if (search.migration_interval == 0) {
+        scm_out_of_range("island-search", interval);
+    }
+    if (filter->component_count == 0) {
+        return scm_list_3(
+            scm_cons(scm_from_utf8_symbol("cost"), scm_from_double(flat_filter_cost(filter, search.target))), 
+            scm_cons(scm_from_utf8_symbol("island"), scm_from_size_t(0)), 
+            scm_cons(scm_from_utf8_symbol("migrants"), scm_from_size_t(0))
+        );
+    }
+
+    search.slot_size = sizeof(double) + filter->component_count * (sizeof(int32_t) + 1);
+    search.slot_size = (search.slot_size + 7) & ~(size_t) 7;
+    search.island_size = sizeof(IslandHeader) + (1 + MIGRATION_SLOTS) * search.slot_size;
+    search.island_size = (search.island_size + 63) & ~(size_t) 63;
+    search.segment_size = search.island_count * search.island_size;
+    search.filters = scm_gc_malloc(search.island_count * sizeof(FlatFilter *), "island filters");
+    for (size_t i = 0; i < search.island_count; i++) {
+        search.filters[i] = copy_flat_filter(filter);
+    }
+    pid_t *workers = scm_gc_malloc_pointerless(search.island_count * sizeof(pid_t), "island workers");
+
+    map_segment(&search);
+    fflush(NULL);
+    for (size_t i = 0; i < search.island_count; i++) {
+        workers[i] = fork();
+        if (workers[i] < 0) {
+            int error = errno;
+            discard_islands(&search, workers, i);
+            errno = error;
+            scm_syserror("island-search");
+        }
+        if (workers[i] == 0) {
+            run_island(&search, i);
+            _exit(0);
+        }
+    }
+
+    bool failed = false;
+    for (size_t i = 0; i < search.island_count; i++) {
+        int status = 0;
+        pid_t waited;
+        while ((waited = waitpid(workers[i], &status, 0)) < 0 && errno == EINTR);
+        /* A worker that cannot be waited for (ECHILD, ...) has no status to trust. */
+        failed |= waited < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    if (failed) {
+        munmap(search.segment, search.segment_size);
+        scm_misc_error("island-search", "An island worker failed.", SCM_EOL);
+    }
+
+    size_t best_island = 0;
+    uint64_t adopted = 0;
+    for (size_t i = 0; i < search.island_count; i++) {
+        if (slot_cost(island_best(&search, i)) < slot_cost(island_best(&search, best_island))) {
+            best_island = i;
+        }
+        adopted += island_header(&search, i)->migrants_adopted;
+    }
+    double best_cost = slot_cost(island_best(&search, best_island));
+    load_state(filter, island_best(&search, best_island));
+    munmap(search.segment, search.segment_size);
+    store_flat_filter_state(filter, stages);
+    scm_remember_upto_here_1(target);
+
+    return scm_list_3(
+        scm_cons(scm_from_utf8_symbol("cost"), scm_from_double(best_cost)), 
+        scm_cons(scm_from_utf8_symbol("island"), scm_from_size_t(best_island)), 
+        scm_cons(scm_from_utf8_symbol("migrants"), scm_from_uint64(adopted))
+    );
+}
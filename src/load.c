@@ -6,17 +6,15 @@
 
 #include "load.h"
 #include "component.h"
+#include "trace.h"
 
 SCM load_type;
 SCM component_load_symbol;
 SCM series_load_symbol;
 SCM parallel_load_symbol;
 
-SCM make_component_load(SCM component);
-SCM make_series_load(SCM loads);
-SCM make_parallel_load(SCM loads);
 SCM scm_load_impedance(SCM angular_frequency, SCM load);
-void invalid_load_type_error(void);
+static SCM copy_load(SCM load);
 
 
 void init_load_type(void) {
@@ -116,6 +114,13 @@ SCM load_random_update(SCM load) {
 }
 
 SCM duplicate_load(SCM load) {
+    TRACE_SCOPE_BEGIN("duplicate-load");
+    SCM duplicated_load = copy_load(load);
+    TRACE_SCOPE_END();
+    return duplicated_load;
+}
+
+static SCM copy_load(SCM load) {
     scm_assert_foreign_object_type(load_type, load);
     SCM type = get_load_type(load);
     SCM elements = get_load_elements(load);
@@ -137,7 +142,7 @@ SCM duplicate_load(SCM load) {
             SCM_SIMPLE_VECTOR_SET(
                 next_loads, 
                 i, 
-                duplicate_load(SCM_SIMPLE_VECTOR_REF(elements, i))
+                copy_load(SCM_SIMPLE_VECTOR_REF(elements, i))
             );
         }
         if (is_series_load) {
@@ -155,7 +160,7 @@ SCM duplicate_load(SCM load) {
 
 }
 
-void invalid_load_type_error(void) {
+_Noreturn void invalid_load_type_error(void) {
     scm_error_scm(
         scm_from_utf8_string("invalid-load-type"), 
         SCM_BOOL_F, 
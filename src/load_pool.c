@@ -0,0 +1,557 @@
+#include <complex.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "component.h"
+#include "filter.h"
+#include "flat_filter.h"
+#include "hash.h"
+#include "load.h"
+#include "load_pool.h"
+#include "numeric_vector.h"
+#include "preferred_value.h"
+#include "two_port_network.h"
+
+/*
+ * A load pool hash-conses load trees: structurally identical subtrees (same
+ * node type, same children, same component kind, value rank and connection)
+ * share one entry, whose impedance over the pool's frequency grid is
+ * computed at most once. Entries are reference counted and freed when the
+ * last filter or parent entry referring to them is released.
+ *
+ * Interning snapshots the component values; a filter whose components are
+ * changed afterwards must be interned again.
+ *
+ * Pooled filters that are collected without load-pool-release! give their
+ * references back from their finalizer. Finalizers run on another thread
+ * and in no particular order, so a finalized filter only queues its stage
+ * loads under the pool's lock; the queue is drained by the next pool
+ * operation. The pool's storage is freed once the pool and every filter
+ * interned into it have been finalized.
+ */
+
+#define NO_LOAD SIZE_MAX
+
+typedef struct {
+    uint64_t hash;
+    FlatNodeKind kind;
+    FlatComponent component;
+    size_t child_count;
+    size_t *children;
+    size_t reference_count;
+    double complex *impedances;
+} PooledLoad;
+
+typedef struct {
+    size_t frequency_count;
+    double *angular_frequencies;
+    PooledLoad *loads;
+    size_t load_count;
+    size_t load_capacity;
+    size_t live_count;
+    size_t *free_loads;
+    size_t free_count;
+    size_t *table;
+    size_t table_capacity;
+    pthread_mutex_t lock;
+    size_t filter_count; /* Pooled filters not yet finalized. */
+    bool is_finalized;
+    size_t *pending_releases;
+    size_t pending_count;
+    size_t pending_capacity;
+} LoadPool;
+
+typedef struct {
+    size_t stage_count;
+    FlatStageKind *stage_kinds;
+    size_t *stage_loads;
+    bool is_released;
+} PooledFilter;
+
+SCM load_pool_type;
+SCM pooled_filter_type;
+
+SCM make_load_pool(SCM angular_frequencies);
+SCM load_pool_intern(SCM pool, SCM stages);
+SCM load_pool_release(SCM pooled_filter);
+SCM load_pool_size(SCM pool);
+SCM pooled_voltage_gains(SCM pooled_filters);
+void finalize_load_pool(SCM pool);
+void finalize_pooled_filter(SCM pooled_filter);
+
+void init_load_pool_type(void) {
+    SCM name, slots;
+
+    name = scm_from_utf8_symbol("load-pool");
+    slots = scm_list_1(scm_from_utf8_symbol("pool"));
+    load_pool_type = scm_make_foreign_object_type(name, slots, finalize_load_pool);
+
+    name = scm_from_utf8_symbol("pooled-filter");
+    slots = scm_list_2(scm_from_utf8_symbol("pool"), scm_from_utf8_symbol("filter"));
+    pooled_filter_type = scm_make_foreign_object_type(name, slots, finalize_pooled_filter);
+
+    __extension__
+    scm_c_define_gsubr("make-load-pool", 1, 0, 0, (scm_t_subr) make_load_pool);
+    __extension__
+    scm_c_define_gsubr("load-pool-intern", 2, 0, 0, (scm_t_subr) load_pool_intern);
+    __extension__
+    scm_c_define_gsubr("load-pool-release!", 1, 0, 0, (scm_t_subr) load_pool_release);
+    __extension__
+    scm_c_define_gsubr("load-pool-size", 1, 0, 0, (scm_t_subr) load_pool_size);
+    __extension__
+    scm_c_define_gsubr("pooled-voltage-gains", 1, 0, 0, (scm_t_subr) pooled_voltage_gains);
+}
+
+static void *checked_realloc(void *memory, size_t size) {
+    void *resized = realloc(memory, size);
+    if (resized == NULL) {
+        scm_memory_error("load-pool");
+    }
+    return resized;
+}
+
+SCM make_load_pool(SCM angular_frequencies) {
+    size_t frequency_count;
+    double *frequencies = double_array_from_vector(
+        angular_frequencies, &frequency_count, SCM_ARG1, "make-load-pool"
+    );
+
+    LoadPool *pool = scm_gc_malloc(sizeof(LoadPool), "load pool");
+    memset(pool, 0, sizeof(LoadPool));
+    pool->frequency_count = frequency_count;
+    pool->angular_frequencies = frequencies;
+    pool->table_capacity = 64;
+    pool->table = checked_realloc(NULL, pool->table_capacity * sizeof(size_t));
+    for (size_t i = 0; i < pool->table_capacity; i++) {
+        pool->table[i] = NO_LOAD;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    return scm_make_foreign_object_1(load_pool_type, pool);
+}
+
+static LoadPool *get_load_pool(SCM pool) {
+    scm_assert_foreign_object_type(load_pool_type, pool);
+    return scm_foreign_object_ref(pool, 0);
+}
+
+static void free_load_pool_storage(LoadPool *pool) {
+    for (size_t i = 0; i < pool->load_count; i++) {
+        free(pool->loads[i].children);
+        free(pool->loads[i].impedances);
+    }
+    free(pool->loads);
+    free(pool->free_loads);
+    free(pool->table);
+    free(pool->pending_releases);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+void finalize_load_pool(SCM pool_object) {
+    LoadPool *pool = scm_foreign_object_ref(pool_object, 0);
+    pthread_mutex_lock(&pool->lock);
+    pool->is_finalized = true;
+    bool is_unused = pool->filter_count == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (is_unused) {
+        free_load_pool_storage(pool);
+    }
+}
+
+static bool pooled_loads_equal(const PooledLoad *load1, const PooledLoad *load2) {
+    if (load1->hash != load2->hash || load1->kind != load2->kind) {
+        return false;
+    }
+    if (load1->kind == COMPONENT_NODE) {
+        return 
+            load1->component.kind == load2->component.kind && 
+            load1->component.rank == load2->component.rank && 
+            load1->component.is_connected == load2->component.is_connected;
+    }
+    return 
+        load1->child_count == load2->child_count && 
+        memcmp(load1->children, load2->children, load1->child_count * sizeof(size_t)) == 0;
+}
+
+static uint64_t pooled_load_hash(const PooledLoad *load) {
+    uint64_t hash = hash_combine(0, load->kind);
+    if (load->kind == COMPONENT_NODE) {
+        hash = hash_combine(hash, load->component.kind);
+        hash = hash_combine(hash, (uint64_t) (int64_t) load->component.rank);
+        hash = hash_combine(hash, load->component.is_connected);
+    }
+    else {
+        for (size_t i = 0; i < load->child_count; i++) {
+            hash = hash_combine(hash, load->children[i]);
+        }
+    }
+    return hash;
+}
+
+/* Linear probing; returns the table slot holding an equal load or the empty slot. */
+static size_t find_table_slot(LoadPool *pool, const PooledLoad *load) {
+    size_t mask = pool->table_capacity - 1;
+    for (size_t slot = load->hash & mask; ; slot = (slot + 1) & mask) {
+        size_t id = pool->table[slot];
+        if (id == NO_LOAD || pooled_loads_equal(&pool->loads[id], load)) {
+            return slot;
+        }
+    }
+}
+
+static bool grow_table(LoadPool *pool) {
+    size_t old_capacity = pool->table_capacity;
+    size_t *old_table = pool->table;
+
+    size_t *table = malloc(2 * old_capacity * sizeof(size_t));
+    if (table == NULL) {
+        return false;
+    }
+    pool->table = table;
+    pool->table_capacity = 2 * old_capacity;
+    for (size_t i = 0; i < pool->table_capacity; i++) {
+        pool->table[i] = NO_LOAD;
+    }
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_table[i] != NO_LOAD) {
+            pool->table[find_table_slot(pool, &pool->loads[old_table[i]])] = old_table[i];
+        }
+    }
+    free(old_table);
+    return true;
+}
+
+/* Backward-shift deletion keeps probe sequences intact without tombstones. */
+static void remove_from_table(LoadPool *pool, size_t id) {
+    size_t mask = pool->table_capacity - 1;
+    size_t slot = pool->loads[id].hash & mask;
+    while (pool->table[slot] != id) {
+        slot = (slot + 1) & mask;
+    }
+
+    size_t next = slot;
+    for (;;) {
+        pool->table[slot] = NO_LOAD;
+        for (;;) {
+            next = (next + 1) & mask;
+            if (pool->table[next] == NO_LOAD) {
+                return;
+            }
+            size_t home = pool->loads[pool->table[next]].hash & mask;
+            bool movable = slot <= next ? 
+                (home <= slot || home > next) : 
+                (home <= slot && home > next);
+            if (movable) {
+                break;
+            }
+        }
+        pool->table[slot] = pool->table[next];
+        slot = next;
+    }
+}
+
+/* Returns a free load id, or NO_LOAD when memory runs out. */
+static size_t allocate_pooled_load(LoadPool *pool) {
+    if (pool->free_count > 0) {
+        return pool->free_loads[--pool->free_count];
+    }
+    if (pool->load_count == pool->load_capacity) {
+        size_t capacity = pool->load_capacity == 0 ? 64 : 2 * pool->load_capacity;
+        PooledLoad *loads = realloc(pool->loads, capacity * sizeof(PooledLoad));
+        if (loads == NULL) {
+            return NO_LOAD;
+        }
+        pool->loads = loads;
+        size_t *free_loads = realloc(pool->free_loads, capacity * sizeof(size_t));
+        if (free_loads == NULL) {
+            return NO_LOAD;
+        }
+        pool->free_loads = free_loads;
+        pool->load_capacity = capacity;
+    }
+    return pool->load_count++;
+}
+
+static void release_pooled_load(LoadPool *pool, size_t id) {
+    PooledLoad *load = &pool->loads[id];
+    if (--load->reference_count > 0) {
+        return;
+    }
+
+    remove_from_table(pool, id);
+    for (size_t i = 0; i < load->child_count; i++) {
+        release_pooled_load(pool, load->children[i]);
+    }
+    free(load->children);
+    free(load->impedances);
+    load->children = NULL;
+    load->impedances = NULL;
+    pool->free_loads[pool->free_count++] = id;
+    pool->live_count--;
+}
+
+static void release_pooled_loads(LoadPool *pool, const size_t *ids, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        release_pooled_load(pool, ids[i]);
+    }
+}
+
+/* Gives back the references queued by finalized pooled filters. */
+static void drain_pending_releases(LoadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    release_pooled_loads(pool, pool->pending_releases, pool->pending_count);
+    pool->pending_count = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Returns the id of the pooled copy of the load at *node_index, holding one
+ * new reference to it. The filter has already been validated by
+ * compile_filter, so the only failure is running out of memory: then every
+ * reference taken here is given back and NO_LOAD is returned.
+ */
+static size_t intern_load(LoadPool *pool, const FlatFilter *filter, size_t *node_index) {
+    const FlatNode *node = &filter->nodes[(*node_index)++];
+    PooledLoad key = {0};
+    key.kind = node->kind;
+
+    if (node->kind == COMPONENT_NODE) {
+        key.component = filter->components[node->operand];
+    }
+    else {
+        key.child_count = node->operand;
+        key.children = malloc((key.child_count + 1) * sizeof(size_t));
+        if (key.children == NULL) {
+            return NO_LOAD;
+        }
+        for (size_t i = 0; i < key.child_count; i++) {
+            key.children[i] = intern_load(pool, filter, node_index);
+            if (key.children[i] == NO_LOAD) {
+                release_pooled_loads(pool, key.children, i);
+                free(key.children);
+                return NO_LOAD;
+            }
+        }
+    }
+    key.hash = pooled_load_hash(&key);
+
+    size_t slot = find_table_slot(pool, &key);
+    size_t id = pool->table[slot];
+    if (id != NO_LOAD) {
+        release_pooled_loads(pool, key.children, key.child_count);
+        free(key.children);
+        pool->loads[id].reference_count++;
+        return id;
+    }
+
+    /* The table is grown before inserting so that it stays at most half full. */
+    bool has_room = true;
+    if (2 * (pool->live_count + 1) > pool->table_capacity) {
+        has_room = grow_table(pool);
+        slot = find_table_slot(pool, &key);
+    }
+    id = has_room ? allocate_pooled_load(pool) : NO_LOAD;
+    if (id == NO_LOAD) {
+        release_pooled_loads(pool, key.children, key.child_count);
+        free(key.children);
+        return NO_LOAD;
+    }
+
+    key.reference_count = 1;
+    pool->loads[id] = key;
+    pool->table[slot] = id;
+    pool->live_count++;
+    return id;
+}
+
+/* Same arithmetic, in the same order, as load_impedance. */
+static const double complex *pooled_load_impedances(LoadPool *pool, size_t id) {
+    if (pool->loads[id].impedances != NULL) {
+        return pool->loads[id].impedances;
+    }
+    for (size_t i = 0; i < pool->loads[id].child_count; i++) {
+        pooled_load_impedances(pool, pool->loads[id].children[i]);
+    }
+
+    PooledLoad *load = &pool->loads[id];
+    double complex *impedances = checked_realloc(
+        NULL, (pool->frequency_count + 1) * sizeof(double complex)
+    );
+    for (size_t f = 0; f < pool->frequency_count; f++) {
+        double angular_frequency = pool->angular_frequencies[f];
+        if (load->kind == COMPONENT_NODE) {
+            impedances[f] = flat_component_impedance(angular_frequency, &load->component);
+        }
+        else if (load->kind == SERIES_NODE) {
+            double complex sum_impedance = 0;
+            for (size_t i = 0; i < load->child_count; i++) {
+                sum_impedance += pool->loads[load->children[i]].impedances[f];
+            }
+            impedances[f] = sum_impedance;
+        }
+        else {
+            double complex intermediate_impedance = 0;
+            for (size_t i = 0; i < load->child_count; i++) {
+                intermediate_impedance += 1.0 / pool->loads[load->children[i]].impedances[f];
+            }
+            impedances[f] = 1.0 / intermediate_impedance;
+        }
+    }
+    load->impedances = impedances;
+    return impedances;
+}
+
+SCM load_pool_intern(SCM pool_object, SCM stages) {
+    LoadPool *pool = get_load_pool(pool_object);
+    SCM_ASSERT_TYPE(
+        scm_is_vector(stages), 
+        stages, 
+        SCM_ARG2, 
+        "load-pool-intern", 
+        "Vector of filter stages");
+
+    /* Compiling first validates the whole filter before any reference is taken. */
+    FlatFilter *flat_filter = compile_filter(stages);
+    size_t stage_count = flat_filter->stage_count;
+    PooledFilter *filter = scm_gc_malloc(sizeof(PooledFilter), "pooled filter");
+    filter->stage_count = stage_count;
+    filter->is_released = false;
+    filter->stage_kinds = scm_gc_malloc_pointerless(
+        (stage_count + 1) * sizeof(FlatStageKind), "pooled stage kinds"
+    );
+    filter->stage_loads = scm_gc_malloc_pointerless(
+        (stage_count + 1) * sizeof(size_t), "pooled stage loads"
+    );
+
+    drain_pending_releases(pool);
+    for (size_t i = 0; i < stage_count; i++) {
+        size_t node_index = flat_filter->stages[i].first_node;
+        filter->stage_kinds[i] = flat_filter->stages[i].kind;
+        filter->stage_loads[i] = intern_load(pool, flat_filter, &node_index);
+        if (filter->stage_loads[i] == NO_LOAD) {
+            release_pooled_loads(pool, filter->stage_loads, i);
+            scm_memory_error("load-pool-intern");
+        }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->filter_count++;
+    pthread_mutex_unlock(&pool->lock);
+    return scm_make_foreign_object_2(pooled_filter_type, pool_object, filter);
+}
+
+/*
+ * Runs on the finalizer thread, possibly after the pool's own finalizer, so
+ * it only queues the filter's references for the next pool operation.
+ */
+void finalize_pooled_filter(SCM pooled_filter) {
+    LoadPool *pool = scm_foreign_object_ref(scm_foreign_object_ref(pooled_filter, 0), 0);
+    PooledFilter *filter = scm_foreign_object_ref(pooled_filter, 1);
+
+    pthread_mutex_lock(&pool->lock);
+    if (!filter->is_released && !pool->is_finalized) {
+        size_t needed = pool->pending_count + filter->stage_count;
+        if (needed > pool->pending_capacity) {
+            size_t capacity = 2 * needed;
+            size_t *pending = realloc(pool->pending_releases, capacity * sizeof(size_t));
+            if (pending != NULL) {
+                pool->pending_releases = pending;
+                pool->pending_capacity = capacity;
+            }
+        }
+        /* Without memory for the queue the loads just stay pooled. */
+        if (needed <= pool->pending_capacity) {
+            memcpy(
+                &pool->pending_releases[pool->pending_count], 
+                filter->stage_loads, 
+                filter->stage_count * sizeof(size_t)
+            );
+            pool->pending_count = needed;
+        }
+    }
+    filter->is_released = true;
+    pool->filter_count--;
+    bool is_unused = pool->is_finalized && pool->filter_count == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (is_unused) {
+        free_load_pool_storage(pool);
+    }
+}
+
+static PooledFilter *get_pooled_filter(SCM pooled_filter, const char *subr) {
+    scm_assert_foreign_object_type(pooled_filter_type, pooled_filter);
+    PooledFilter *filter = scm_foreign_object_ref(pooled_filter, 1);
+    if (filter->is_released) {
+        scm_misc_error(subr, "Pooled filter ~S was already released.", scm_list_1(pooled_filter));
+    }
+    return filter;
+}
+
+SCM load_pool_release(SCM pooled_filter) {
+    PooledFilter *filter = get_pooled_filter(pooled_filter, "load-pool-release!");
+    LoadPool *pool = get_load_pool(scm_foreign_object_ref(pooled_filter, 0));
+    drain_pending_releases(pool);
+    release_pooled_loads(pool, filter->stage_loads, filter->stage_count);
+    filter->is_released = true;
+    return SCM_UNSPECIFIED;
+}
+
+SCM load_pool_size(SCM pool_object) {
+    LoadPool *pool = get_load_pool(pool_object);
+    drain_pending_releases(pool);
+    return scm_from_size_t(pool->live_count);
+}
+
+/* Returns a c64vector of gains, one row of the pool's frequency grid per filter. */
+SCM pooled_voltage_gains(SCM pooled_filters) {
+    SCM_ASSERT_TYPE(
+        scm_is_vector(pooled_filters) && SCM_SIMPLE_VECTOR_LENGTH(pooled_filters) > 0, 
+        pooled_filters, 
+        SCM_ARG1, 
+        "pooled-voltage-gains", 
+        "Non-empty vector of pooled filters");
+
+    size_t filter_count = SCM_SIMPLE_VECTOR_LENGTH(pooled_filters);
+    get_pooled_filter(SCM_SIMPLE_VECTOR_REF(pooled_filters, 0), "pooled-voltage-gains");
+    SCM pool_object = scm_foreign_object_ref(SCM_SIMPLE_VECTOR_REF(pooled_filters, 0), 0);
+    LoadPool *pool = get_load_pool(pool_object);
+    size_t frequency_count = pool->frequency_count;
+    double complex *gains = scm_gc_malloc_pointerless(
+        (filter_count * frequency_count + 1) * sizeof(double complex), "pooled gains"
+    );
+
+    for (size_t m = 0; m < filter_count; m++) {
+        SCM pooled_filter = SCM_SIMPLE_VECTOR_REF(pooled_filters, m);
+        PooledFilter *filter = get_pooled_filter(pooled_filter, "pooled-voltage-gains");
+        if (!scm_is_eq(scm_foreign_object_ref(pooled_filter, 0), pool_object)) {
+            scm_misc_error(
+                "pooled-voltage-gains", 
+                "Pooled filters must all belong to the same pool.", 
+                SCM_EOL
+            );
+        }
+        for (size_t i = 0; i < filter->stage_count; i++) {
+            pooled_load_impedances(pool, filter->stage_loads[i]);
+        }
+
+        for (size_t f = 0; f < frequency_count; f++) {
+            TwoPortNetwork network, work_area;
+            identity_network(&network);
+            for (size_t i = 0; i < filter->stage_count; i++) {
+                double complex impedance = pool->loads[filter->stage_loads[i]].impedances[f];
+                if (filter->stage_kinds[i] == SERIES_STAGE) {
+                    series_connected_network(&work_area, impedance);
+                }
+                else {
+                    shunt_connected_network(&work_area, impedance);
+                }
+                cascade_network(&network, &network, &work_area);
+            }
+            gains[m * frequency_count + f] = network_voltage_gain(&network);
+        }
+    }
+    return complex_vector_from_array(gains, filter_count * frequency_count);
+}
@@ -0,0 +1,265 @@
+#include <complex.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "flat_filter.h"
+#include "neighborhood.h"
+#include "response_target.h"
+#include "thread_pool.h"
+#include "two_port_network.h"
+
+/*
+ * Scores every candidate that differs from the current one in a single
+ * component: each rank within the radius (and within the component's
+ * limits) and toggling its connection. With the prefix products
+ * P[s] = A[0] ... A[s - 1] and suffix products S[s] = A[s] ... A[n - 1] of
+ * the stage matrices at every target frequency, changing a component in
+ * stage s only needs that stage re-evaluated and P[s] * A'[s] * S[s + 1].
+ * The reassociated products round differently from a full cascade, so the
+ * costs agree with flat_filter_cost to rounding, not bit for bit.
+ */
+
+typedef struct {
+    const FlatFilter *filter;
+    const ResponseTarget *target;
+    TwoPortNetwork *prefixes;
+    TwoPortNetwork *suffixes;
+    size_t *component_stages;
+    NeighborMove *moves;
+    size_t move_count;
+    size_t chunk_count;
+    FlatFilter *chunk_filters;
+} NeighborhoodScan;
+
+SCM scm_scan_neighborhood(SCM stages, SCM target, SCM radius);
+SCM scm_apply_neighbor_move(SCM stages, SCM component, SCM change);
+
+void init_neighborhood(void) {
+    __extension__
+    scm_c_define_gsubr("scan-neighborhood", 3, 0, 0, (scm_t_subr) scm_scan_neighborhood);
+    __extension__
+    scm_c_define_gsubr("apply-neighbor-move!", 3, 0, 0, (scm_t_subr) scm_apply_neighbor_move);
+}
+
+/* Products are stored as [frequency][stage boundary], stage_count + 1 per frequency. */
+static void compute_partial_products(size_t frequency, void *context) {
+    NeighborhoodScan *scan = context;
+    const FlatFilter *filter = scan->filter;
+    size_t stage_count = filter->stage_count;
+    double angular_frequency = scan->target->angular_frequencies[frequency];
+    TwoPortNetwork *prefixes = &scan->prefixes[frequency * (stage_count + 1)];
+    TwoPortNetwork *suffixes = &scan->suffixes[frequency * (stage_count + 1)];
+
+    identity_network(&prefixes[0]);
+    identity_network(&suffixes[stage_count]);
+    for (size_t i = 0; i < stage_count; i++) {
+        /* Stash each stage matrix in the suffix slot until the backward pass. */
+        flat_stage_network(&suffixes[i], angular_frequency, filter, i);
+        cascade_network(&prefixes[i + 1], &prefixes[i], &suffixes[i]);
+    }
+    for (size_t i = stage_count; i-- > 0;) {
+        cascade_network(&suffixes[i], &suffixes[i], &suffixes[i + 1]);
+    }
+}
+
+static double neighbor_cost(NeighborhoodScan *scan, const FlatFilter *filter, size_t stage) {
+    const ResponseTarget *target = scan->target;
+    size_t stage_count = filter->stage_count;
+    double error = 0;
+
+    for (size_t f = 0; f < target->count; f++) {
+        TwoPortNetwork stage_network, network;
+        flat_stage_network(&stage_network, target->angular_frequencies[f], filter, stage);
+        cascade_network(&network, &scan->prefixes[f * (stage_count + 1) + stage], &stage_network);
+        cascade_network(&network, &network, &scan->suffixes[f * (stage_count + 1) + stage + 1]);
+        error += response_point_error(target, f, network_voltage_gain(&network));
+    }
+    return error / target->total_weight;
+}
+
+static void score_move_chunk(size_t chunk, void *context) {
+    NeighborhoodScan *scan = context;
+    FlatFilter *filter = &scan->chunk_filters[chunk];
+    size_t begin = chunk * scan->move_count / scan->chunk_count;
+    size_t end = (chunk + 1) * scan->move_count / scan->chunk_count;
+
+    for (size_t i = begin; i < end; i++) {
+        NeighborMove *move = &scan->moves[i];
+        FlatComponent original = filter->components[move->component];
+        apply_neighbor_move(filter, move);
+        move->cost = neighbor_cost(scan, filter, scan->component_stages[move->component]);
+        filter->components[move->component] = original;
+    }
+}
+
+static int compare_moves(const void *first, const void *second) {
+    double cost1 = ((const NeighborMove *) first)->cost;
+    double cost2 = ((const NeighborMove *) second)->cost;
+    if (isnan(cost1) || isnan(cost2)) {
+        return isnan(cost1) - isnan(cost2);
+    }
+    return (cost1 > cost2) - (cost1 < cost2);
+}
+
+void apply_neighbor_move(FlatFilter *filter, const NeighborMove *move) {
+    FlatComponent *component = &filter->components[move->component];
+    if (move->toggles_connection) {
+        component->is_connected = !component->is_connected;
+    }
+    else {
+        set_flat_component_rank(component, component->rank + move->rank_delta);
+    }
+}
+
+static size_t list_moves(const FlatFilter *filter, int radius, NeighborMove *moves) {
+    size_t count = 0;
+    for (size_t i = 0; i < filter->component_count; i++) {
+        const FlatComponent *component = &filter->components[i];
+        if (component->is_connected) {
+            for (int delta = -radius; delta <= radius; delta++) {
+                int rank = component->rank + delta;
+                if (delta != 0 && rank >= component->lower_rank && rank <= component->upper_rank) {
+                    if (moves != NULL) {
+                        moves[count] = (NeighborMove) {i, delta, false, NAN};
+                    }
+                    count++;
+                }
+            }
+        }
+        if (moves != NULL) {
+            moves[count] = (NeighborMove) {i, 0, true, NAN};
+        }
+        count++;
+    }
+    return count;
+}
+
+/*
+ * Fills *moves with every single-component neighbor of filter, sorted by
+ * increasing cost, and returns how many there are.
+ */
+size_t scan_neighborhood(
+    const FlatFilter *filter, 
+    const ResponseTarget *target, 
+    int radius, 
+    NeighborMove **moves
+) {
+    NeighborhoodScan scan;
+    size_t stage_count = filter->stage_count;
+    scan.filter = filter;
+    scan.target = target;
+
+    scan.move_count = list_moves(filter, radius, NULL);
+    scan.moves = scm_gc_malloc_pointerless(
+        (scan.move_count + 1) * sizeof(NeighborMove), "neighbor moves"
+    );
+    list_moves(filter, radius, scan.moves);
+    *moves = scan.moves;
+    if (target->count == 0) {
+        for (size_t i = 0; i < scan.move_count; i++) {
+            scan.moves[i].cost = 0;
+        }
+        return scan.move_count;
+    }
+
+    scan.component_stages = scm_gc_malloc_pointerless(
+        (filter->component_count + 1) * sizeof(size_t), "component stages"
+    );
+    for (size_t i = 0; i < stage_count; i++) {
+        const FlatStage *stage = &filter->stages[i];
+        for (size_t j = stage->first_node; j < stage->first_node + stage->node_count; j++) {
+            if (filter->nodes[j].kind == COMPONENT_NODE) {
+                scan.component_stages[filter->nodes[j].operand] = i;
+            }
+        }
+    }
+
+    size_t product_count = target->count * (stage_count + 1);
+    scan.prefixes = scm_gc_malloc_pointerless(product_count * sizeof(TwoPortNetwork), "prefixes");
+    scan.suffixes = scm_gc_malloc_pointerless(product_count * sizeof(TwoPortNetwork), "suffixes");
+    parallel_for(target->count, compute_partial_products, &scan);
+
+    /* Each chunk of moves edits its own copy of the components. */
+    scan.chunk_count = thread_pool_size() + 1;
+    if (scan.chunk_count > scan.move_count) {
+        scan.chunk_count = scan.move_count;
+    }
+    scan.chunk_filters = scm_gc_malloc(
+        (scan.chunk_count + 1) * sizeof(FlatFilter), "neighborhood filters"
+    );
+    for (size_t i = 0; i < scan.chunk_count; i++) {
+        scan.chunk_filters[i] = *filter;
+        scan.chunk_filters[i].components = scm_gc_malloc_pointerless(
+            (filter->component_count + 1) * sizeof(FlatComponent), "neighborhood components"
+        );
+        memcpy(
+            scan.chunk_filters[i].components, 
+            filter->components, 
+            filter->component_count * sizeof(FlatComponent)
+        );
+    }
+    parallel_for(scan.chunk_count, score_move_chunk, &scan);
+
+    qsort(scan.moves, scan.move_count, sizeof(NeighborMove), compare_moves);
+    return scan.move_count;
+}
+
+static SCM move_change(const NeighborMove *move) {
+    if (move->toggles_connection) {
+        return scm_from_utf8_symbol("toggle");
+    }
+    return scm_from_int(move->rank_delta);
+}
+
+/*
+ * Returns a vector of (cost component-index change) lists, cheapest first.
+ * Components are numbered in the order they appear in the stages; change is
+ * a rank offset or the symbol toggle.
+ */
+SCM scm_scan_neighborhood(SCM stages, SCM target, SCM radius) {
+    FlatFilter *filter = compile_filter(stages);
+    NeighborMove *moves;
+    size_t move_count = scan_neighborhood(
+        filter, get_response_target(target), scm_to_int(radius), &moves
+    );
+
+    SCM ranked = scm_c_make_vector(move_count, SCM_BOOL_F);
+    for (size_t i = 0; i < move_count; i++) {
+        SCM_SIMPLE_VECTOR_SET(ranked, i, scm_list_3(
+            scm_from_double(moves[i].cost), 
+            scm_from_size_t(moves[i].component), 
+            move_change(&moves[i])
+        ));
+    }
+    scm_remember_upto_here_1(target);
+    return ranked;
+}
+
+/*
+ * Applies one move as returned by scan-neighborhood to stages in place.
+ * A rank change that would leave the component's limits is out of range.
+ */
+SCM scm_apply_neighbor_move(SCM stages, SCM component, SCM change) {
+    FlatFilter *filter = compile_filter(stages);
+    NeighborMove move = {0, 0, false, NAN};
+    move.component = scm_to_size_t(component);
+    if (move.component >= filter->component_count) {
+        scm_out_of_range("apply-neighbor-move!", component);
+    }
+    if (scm_is_eq(change, scm_from_utf8_symbol("toggle"))) {
+        move.toggles_connection = true;
+    }
+    else {
+        move.rank_delta = scm_to_int(change);
+        const FlatComponent *moved = &filter->components[move.component];
+        long rank = (long) moved->rank + move.rank_delta;
+        if (rank < moved->lower_rank || rank > moved->upper_rank) {
+            scm_out_of_range("apply-neighbor-move!", change);
+        }
+    }
+    apply_neighbor_move(filter, &move);
+    store_flat_filter_state(filter, stages);
+    return stages;
+}
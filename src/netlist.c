@@ -0,0 +1,541 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "component.h"
+#include "filter.h"
+#include "load.h"
+#include "netlist.h"
+#include "preferred_value.h"
+#include "trace.h"
+
+/*
+ * Whole filters are described either as s-expressions,
+ *
+ *     ((series (resistor 100 10 1e4))
+ *      (shunt (parallel (capacitor 1e-6 1e-9 1e-3) (inductor 1e-3 1e-6 1 #f))))
+ *
+ * where component values are snapped to the nearest preferred value and the
+ * limits to the floor and ceiling preferred values, or as a bytevector:
+ *
+ *     "FLT1" u32 filter-count
+ *     filter:    u32 stage-count, stage...
+ *     stage:     u8 kind (0 series, 1 shunt), load
+ *     load:      u8 tag (0 resistor, 1 capacitor, 2 inductor, 3 series, 4 parallel)
+ *     component: i16 value-rank, i16 lower-rank, i16 upper-rank, u8 connected
+ *     composite: u16 child-count, load...
+ *
+ * with every integer little-endian. Both are first parsed and validated into
+ * one flat prefix-order array of entries, so a malformed description is
+ * rejected before any foreign object is allocated and the objects are then
+ * built in a single pass without going back through Scheme. Only parsing is
+ * batched: every component, load and stage is still its own foreign object
+ * made by the usual constructors, not carved out of one allocation.
+ *
+ * A component is rejected unless lower <= value <= upper and every one of
+ * its ranks stands for a normal positive double (an i16 rank can reach
+ * 10^1365, which overflows to infinity).
+ */
+
+#define NETLIST_MAGIC "FLT1"
+#define NETLIST_MAGIC_LENGTH 4
+#define MAX_NETLIST_DEPTH 256
+#define INITIAL_NETLIST_CAPACITY 64
+
+typedef enum {
+    NETLIST_FILTER,
+    NETLIST_SERIES_STAGE,
+    NETLIST_SHUNT_STAGE,
+    NETLIST_RESISTOR,
+    NETLIST_CAPACITOR,
+    NETLIST_INDUCTOR,
+    NETLIST_SERIES_LOAD,
+    NETLIST_PARALLEL_LOAD
+} NetlistTag;
+
+typedef struct {
+    uint8_t tag;
+    bool is_connected;
+    uint32_t child_count;
+    int value_rank;
+    int lower_rank;
+    int upper_rank;
+} NetlistEntry;
+
+typedef struct {
+    NetlistEntry *entries;
+    size_t count;
+    size_t capacity;
+    size_t filter_count;
+} Netlist;
+
+typedef struct {
+    const uint8_t *bytes;
+    size_t length;
+    size_t position;
+} NetlistReader;
+
+typedef struct {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+} NetlistWriter;
+
+SCM build_filters(SCM descriptions);
+SCM encode_filters(SCM filters);
+SCM decode_filters(SCM bytevector);
+
+void init_netlist(void) {
+    __extension__
+    scm_c_define_gsubr("build-filters", 1, 0, 0, (scm_t_subr) build_filters);
+    __extension__
+    scm_c_define_gsubr("encode-filters", 1, 0, 0, (scm_t_subr) encode_filters);
+    __extension__
+    scm_c_define_gsubr("decode-filters", 1, 0, 0, (scm_t_subr) decode_filters);
+}
+
+static NetlistEntry *append_entry(Netlist *netlist, NetlistTag tag) {
+    if (netlist->count == netlist->capacity) {
+        size_t capacity =
+            netlist->capacity == 0 ? INITIAL_NETLIST_CAPACITY : 2 * netlist->capacity;
+        NetlistEntry *entries = scm_gc_malloc_pointerless(
+            capacity * sizeof(NetlistEntry), "netlist entries"
+        );
+        if (netlist->count > 0) {
+            memcpy(entries, netlist->entries, netlist->count * sizeof(NetlistEntry));
+        }
+        netlist->entries = entries;
+        netlist->capacity = capacity;
+    }
+    NetlistEntry *entry = &netlist->entries[netlist->count++];
+    memset(entry, 0, sizeof(NetlistEntry));
+    entry->tag = tag;
+    return entry;
+}
+
+static double positive_value(SCM value, SCM description, const char *subr) {
+    SCM_ASSERT_TYPE(
+        scm_is_real(value), description, SCM_ARG1, subr, "Component with real values"
+    );
+    double number = scm_to_double(value);
+    if (!(number > 0) || !isfinite(number)) {
+        scm_out_of_range(subr, value);
+    }
+    return number;
+}
+
+static bool is_valid_rank(int rank) {
+    return isnormal(preferred_value_from_rank(rank));
+}
+
+static bool has_valid_ranks(const NetlistEntry *entry) {
+    return 
+        is_valid_rank(entry->value_rank) && 
+        is_valid_rank(entry->lower_rank) && 
+        is_valid_rank(entry->upper_rank) && 
+        entry->lower_rank <= entry->value_rank && 
+        entry->value_rank <= entry->upper_rank;
+}
+
+static void parse_load_description(
+    Netlist *netlist,
+    SCM description,
+    size_t depth,
+    const char *subr
+) {
+    long length = scm_ilength(description);
+    SCM_ASSERT_TYPE(
+        length >= 1 && scm_is_symbol(scm_car(description)) && depth < MAX_NETLIST_DEPTH,
+        description,
+        SCM_ARG1,
+        subr,
+        "Load description"
+    );
+    SCM head = scm_car(description);
+
+    NetlistTag tag;
+    if (scm_is_eq(head, resistor_symbol)) {
+        tag = NETLIST_RESISTOR;
+    }
+    else if (scm_is_eq(head, capacitor_symbol)) {
+        tag = NETLIST_CAPACITOR;
+    }
+    else if (scm_is_eq(head, inductor_symbol)) {
+        tag = NETLIST_INDUCTOR;
+    }
+    else if (scm_is_eq(head, series_load_symbol)) {
+        tag = NETLIST_SERIES_LOAD;
+    }
+    else if (scm_is_eq(head, parallel_load_symbol)) {
+        tag = NETLIST_PARALLEL_LOAD;
+    }
+    else {
+        scm_wrong_type_arg_msg(subr, SCM_ARG1, description, "Load description");
+    }
+
+    if (tag == NETLIST_SERIES_LOAD || tag == NETLIST_PARALLEL_LOAD) {
+        SCM_ASSERT_TYPE(
+            length >= 2 && length - 1 <= UINT16_MAX,
+            description,
+            SCM_ARG1,
+            subr,
+            "Composite load with at least one element"
+        );
+        NetlistEntry *entry = append_entry(netlist, tag);
+        entry->child_count = (uint32_t) (length - 1);
+        for (SCM rest = scm_cdr(description); !scm_is_null(rest); rest = scm_cdr(rest)) {
+            parse_load_description(netlist, scm_car(rest), depth + 1, subr);
+        }
+        return;
+    }
+
+    SCM_ASSERT_TYPE(
+        length == 4 || (length == 5 && scm_is_bool(scm_list_ref(description, scm_from_int(4)))),
+        description,
+        SCM_ARG1,
+        subr,
+        "Component as (type value lower-limit upper-limit [connected])"
+    );
+    SCM values = scm_cdr(description);
+    double value = positive_value(scm_car(values), description, subr);
+    double lower_limit = positive_value(scm_cadr(values), description, subr);
+    double upper_limit = positive_value(scm_caddr(values), description, subr);
+
+    NetlistEntry *entry = append_entry(netlist, tag);
+    entry->value_rank = nearest_preferred_value_rank(value);
+    entry->lower_rank = floor_preferred_value_rank(lower_limit);
+    entry->upper_rank = ceiling_preferred_value_rank(upper_limit);
+    entry->is_connected = length == 4 || scm_is_true(scm_list_ref(description, scm_from_int(4)));
+    if (!has_valid_ranks(entry)) {
+        scm_out_of_range(subr, description);
+    }
+}
+
+static void parse_filter_description(Netlist *netlist, SCM description, const char *subr) {
+    long length = scm_ilength(description);
+    SCM_ASSERT_TYPE(length >= 0, description, SCM_ARG1, subr, "List of stage descriptions");
+
+    append_entry(netlist, NETLIST_FILTER)->child_count = (uint32_t) length;
+    netlist->filter_count++;
+    for (SCM rest = description; !scm_is_null(rest); rest = scm_cdr(rest)) {
+        SCM stage = scm_car(rest);
+        SCM_ASSERT_TYPE(
+            scm_ilength(stage) == 2 && (
+                scm_is_eq(scm_car(stage), series_filter_symbol) ||
+                scm_is_eq(scm_car(stage), shunt_filter_symbol)
+            ),
+            stage,
+            SCM_ARG1,
+            subr,
+            "Stage as (series load) or (shunt load)"
+        );
+        append_entry(
+            netlist,
+            scm_is_eq(scm_car(stage), series_filter_symbol) ?
+                NETLIST_SERIES_STAGE : NETLIST_SHUNT_STAGE
+        );
+        parse_load_description(netlist, scm_cadr(stage), 0, subr);
+    }
+}
+
+static SCM build_component_type(NetlistTag tag) {
+    switch (tag) {
+        case NETLIST_RESISTOR:
+            return resistor_symbol;
+        case NETLIST_CAPACITOR:
+            return capacitor_symbol;
+        default:
+            return inductor_symbol;
+    }
+}
+
+static SCM build_load(const Netlist *netlist, size_t *index) {
+    const NetlistEntry *entry = &netlist->entries[(*index)++];
+
+    if (entry->tag == NETLIST_SERIES_LOAD || entry->tag == NETLIST_PARALLEL_LOAD) {
+        SCM elements = scm_c_make_vector(entry->child_count, SCM_BOOL_F);
+        for (size_t i = 0; i < entry->child_count; i++) {
+            SCM_SIMPLE_VECTOR_SET(elements, i, build_load(netlist, index));
+        }
+        return entry->tag == NETLIST_SERIES_LOAD ?
+            make_series_load(elements) : make_parallel_load(elements);
+    }
+
+    return make_component_load(make_component(
+        build_component_type(entry->tag),
+        make_preferred_component_value_from_rank(entry->value_rank),
+        make_preferred_component_value_from_rank(entry->lower_rank),
+        make_preferred_component_value_from_rank(entry->upper_rank),
+        scm_from_bool(entry->is_connected),
+        SCM_BOOL_F
+    ));
+}
+
+/* Builds the vector of stage vectors described by a validated netlist. */
+static SCM build_netlist(const Netlist *netlist) {
+    SCM filters = scm_c_make_vector(netlist->filter_count, SCM_BOOL_F);
+    size_t index = 0;
+    for (size_t f = 0; f < netlist->filter_count; f++) {
+        const NetlistEntry *filter = &netlist->entries[index++];
+        SCM stages = scm_c_make_vector(filter->child_count, SCM_BOOL_F);
+        for (size_t i = 0; i < filter->child_count; i++) {
+            bool is_series = netlist->entries[index++].tag == NETLIST_SERIES_STAGE;
+            SCM load = build_load(netlist, &index);
+            SCM_SIMPLE_VECTOR_SET(
+                stages,
+                i,
+                is_series ? make_series_filter_stage(load) : make_shunt_filter_stage(load)
+            );
+        }
+        SCM_SIMPLE_VECTOR_SET(filters, f, stages);
+    }
+    return filters;
+}
+
+/* Takes a list or vector of filter descriptions and returns a vector of stage vectors. */
+SCM build_filters(SCM descriptions) {
+    SCM_ASSERT_TYPE(
+        scm_is_vector(descriptions) || scm_ilength(descriptions) >= 0,
+        descriptions,
+        SCM_ARG1,
+        "build-filters",
+        "List or vector of filter descriptions"
+    );
+
+    TRACE_SCOPE_BEGIN("build-filters");
+    Netlist netlist = {0};
+    if (scm_is_vector(descriptions)) {
+        for (size_t i = 0; i < SCM_SIMPLE_VECTOR_LENGTH(descriptions); i++) {
+            parse_filter_description(
+                &netlist, SCM_SIMPLE_VECTOR_REF(descriptions, i), "build-filters"
+            );
+        }
+    }
+    else {
+        for (SCM rest = descriptions; !scm_is_null(rest); rest = scm_cdr(rest)) {
+            parse_filter_description(&netlist, scm_car(rest), "build-filters");
+        }
+    }
+    SCM filters = build_netlist(&netlist);
+    TRACE_SCOPE_END();
+    return filters;
+}
+
+static _Noreturn void malformed_netlist_error(const NetlistReader *reader, const char *message) {
+    scm_misc_error(
+        "decode-filters",
+        "Malformed netlist at byte ~A: ~A",
+        scm_list_2(scm_from_size_t(reader->position), scm_from_utf8_string(message))
+    );
+}
+
+static const uint8_t *read_bytes(NetlistReader *reader, size_t count) {
+    if (reader->length - reader->position < count) {
+        malformed_netlist_error(reader, "unexpected end of data.");
+    }
+    const uint8_t *bytes = &reader->bytes[reader->position];
+    reader->position += count;
+    return bytes;
+}
+
+static uint8_t read_u8(NetlistReader *reader) {
+    return read_bytes(reader, 1)[0];
+}
+
+static uint16_t read_u16(NetlistReader *reader) {
+    const uint8_t *bytes = read_bytes(reader, 2);
+    return (uint16_t) (bytes[0] | bytes[1] << 8);
+}
+
+static int read_i16(NetlistReader *reader) {
+    uint16_t bits = read_u16(reader);
+    return bits < 0x8000 ? (int) bits : (int) bits - 0x10000;
+}
+
+static uint32_t read_u32(NetlistReader *reader) {
+    const uint8_t *bytes = read_bytes(reader, 4);
+    return
+        (uint32_t) bytes[0] |
+        (uint32_t) bytes[1] << 8 |
+        (uint32_t) bytes[2] << 16 |
+        (uint32_t) bytes[3] << 24;
+}
+
+static void read_load(Netlist *netlist, NetlistReader *reader, size_t depth) {
+    if (depth >= MAX_NETLIST_DEPTH) {
+        malformed_netlist_error(reader, "loads are nested too deeply.");
+    }
+
+    uint8_t tag = read_u8(reader);
+    if (tag > 4) {
+        malformed_netlist_error(reader, "unknown load tag.");
+    }
+    if (tag >= 3) {
+        uint16_t child_count = read_u16(reader);
+        if (child_count == 0) {
+            malformed_netlist_error(reader, "composite load without elements.");
+        }
+        append_entry(
+            netlist, tag == 3 ? NETLIST_SERIES_LOAD : NETLIST_PARALLEL_LOAD
+        )->child_count = child_count;
+        for (uint16_t i = 0; i < child_count; i++) {
+            read_load(netlist, reader, depth + 1);
+        }
+        return;
+    }
+
+    NetlistEntry *entry = append_entry(netlist, NETLIST_RESISTOR + tag);
+    entry->value_rank = read_i16(reader);
+    entry->lower_rank = read_i16(reader);
+    entry->upper_rank = read_i16(reader);
+    if (!has_valid_ranks(entry)) {
+        malformed_netlist_error(reader, "component ranks out of range or out of order.");
+    }
+    uint8_t is_connected = read_u8(reader);
+    if (is_connected > 1) {
+        malformed_netlist_error(reader, "connected flag is not 0 or 1.");
+    }
+    entry->is_connected = is_connected;
+}
+
+SCM decode_filters(SCM bytevector) {
+    SCM_ASSERT_TYPE(
+        scm_is_bytevector(bytevector), bytevector, SCM_ARG1, "decode-filters", "Bytevector"
+    );
+
+    TRACE_SCOPE_BEGIN("decode-filters");
+    NetlistReader reader;
+    reader.bytes = (const uint8_t *) SCM_BYTEVECTOR_CONTENTS(bytevector);
+    reader.length = SCM_BYTEVECTOR_LENGTH(bytevector);
+    reader.position = 0;
+
+    if (memcmp(read_bytes(&reader, NETLIST_MAGIC_LENGTH), NETLIST_MAGIC, NETLIST_MAGIC_LENGTH) != 0) {
+        reader.position = 0;
+        malformed_netlist_error(&reader, "missing " NETLIST_MAGIC " header.");
+    }
+
+    Netlist netlist = {0};
+    uint32_t filter_count = read_u32(&reader);
+    for (uint32_t f = 0; f < filter_count; f++) {
+        uint32_t stage_count = read_u32(&reader);
+        append_entry(&netlist, NETLIST_FILTER)->child_count = stage_count;
+        netlist.filter_count++;
+        for (uint32_t i = 0; i < stage_count; i++) {
+            uint8_t kind = read_u8(&reader);
+            if (kind > 1) {
+                malformed_netlist_error(&reader, "unknown stage kind.");
+            }
+            append_entry(&netlist, kind == 0 ? NETLIST_SERIES_STAGE : NETLIST_SHUNT_STAGE);
+            read_load(&netlist, &reader, 0);
+        }
+    }
+    if (reader.position != reader.length) {
+        malformed_netlist_error(&reader, "trailing data.");
+    }
+
+    SCM filters = build_netlist(&netlist);
+    TRACE_SCOPE_END();
+    scm_remember_upto_here_1(bytevector);
+    return filters;
+}
+
+static uint8_t *reserve_bytes(NetlistWriter *writer, size_t count) {
+    if (writer->capacity - writer->length < count) {
+        size_t capacity = writer->capacity == 0 ? 256 : writer->capacity;
+        while (capacity - writer->length < count) {
+            capacity *= 2;
+        }
+        uint8_t *bytes = scm_gc_malloc_pointerless(capacity, "netlist bytes");
+        if (writer->length > 0) {
+            memcpy(bytes, writer->bytes, writer->length);
+        }
+        writer->bytes = bytes;
+        writer->capacity = capacity;
+    }
+    uint8_t *bytes = &writer->bytes[writer->length];
+    writer->length += count;
+    return bytes;
+}
+
+static void write_u8(NetlistWriter *writer, uint8_t value) {
+    reserve_bytes(writer, 1)[0] = value;
+}
+
+static void write_u16(NetlistWriter *writer, uint16_t value) {
+    uint8_t *bytes = reserve_bytes(writer, 2);
+    bytes[0] = (uint8_t) value;
+    bytes[1] = (uint8_t) (value >> 8);
+}
+
+static void write_u32(NetlistWriter *writer, uint32_t value) {
+    uint8_t *bytes = reserve_bytes(writer, 4);
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+static void write_rank(NetlistWriter *writer, SCM preferred_value) {
+    int rank = preferred_component_value_rank(preferred_value);
+    if (rank < INT16_MIN || rank > INT16_MAX) {
+        scm_out_of_range("encode-filters", preferred_value);
+    }
+    write_u16(writer, (uint16_t) rank);
+}
+
+static void write_load(NetlistWriter *writer, SCM load) {
+    SCM type = get_load_type(load);
+    SCM elements = get_load_elements(load);
+
+    if (scm_is_eq(type, component_load_symbol)) {
+        write_u8(writer, (uint8_t) component_kind(elements));
+        write_rank(writer, get_component_value(elements));
+        write_rank(writer, get_component_lower_limit(elements));
+        write_rank(writer, get_component_upper_limit(elements));
+        write_u8(writer, scm_is_true(get_component_is_connected(elements)));
+    }
+    else if (scm_is_eq(type, series_load_symbol) || scm_is_eq(type, parallel_load_symbol)) {
+        size_t count = SCM_SIMPLE_VECTOR_LENGTH(elements);
+        if (count == 0 || count > UINT16_MAX) {
+            scm_out_of_range("encode-filters", load);
+        }
+        write_u8(writer, scm_is_eq(type, series_load_symbol) ? 3 : 4);
+        write_u16(writer, (uint16_t) count);
+        for (size_t i = 0; i < count; i++) {
+            write_load(writer, SCM_SIMPLE_VECTOR_REF(elements, i));
+        }
+    }
+    else {
+        invalid_load_type_error();
+    }
+}
+
+/* Encodes a vector of stage vectors in the bytevector form read by decode-filters. */
+SCM encode_filters(SCM filters) {
+    SCM_ASSERT_TYPE(
+        scm_is_vector(filters), filters, SCM_ARG1, "encode-filters", "Vector of stage vectors"
+    );
+
+    TRACE_SCOPE_BEGIN("encode-filters");
+    NetlistWriter writer = {0};
+    memcpy(reserve_bytes(&writer, NETLIST_MAGIC_LENGTH), NETLIST_MAGIC, NETLIST_MAGIC_LENGTH);
+    write_u32(&writer, (uint32_t) SCM_SIMPLE_VECTOR_LENGTH(filters));
+    for (size_t f = 0; f < SCM_SIMPLE_VECTOR_LENGTH(filters); f++) {
+        SCM stages = SCM_SIMPLE_VECTOR_REF(filters, f);
+        SCM_ASSERT_TYPE(
+            scm_is_vector(stages), filters, SCM_ARG1, "encode-filters", "Vector of stage vectors"
+        );
+        write_u32(&writer, (uint32_t) SCM_SIMPLE_VECTOR_LENGTH(stages));
+        for (size_t i = 0; i < SCM_SIMPLE_VECTOR_LENGTH(stages); i++) {
+            SCM stage = SCM_SIMPLE_VECTOR_REF(stages, i);
+            write_u8(&writer, scm_is_eq(get_filter_stage_type(stage), series_filter_symbol) ? 0 : 1);
+            write_load(&writer, get_filter_stage_load(stage));
+        }
+    }
+    TRACE_SCOPE_END();
+
+    SCM bytevector = scm_c_make_bytevector(writer.length);
+    memcpy(SCM_BYTEVECTOR_CONTENTS(bytevector), writer.bytes, writer.length);
+    return bytevector;
+}
@@ -0,0 +1,444 @@
+#include <complex.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "component.h"
+#include "flat_filter.h"
+#include "nodal.h"
+#include "numeric_vector.h"
+#include "response_target.h"
+#include "thread_pool.h"
+
+#define NO_ENTRY SIZE_MAX
+#define FREQUENCY_CHUNK 32
+
+SCM nodal_circuit_type;
+
+SCM make_nodal_circuit(SCM netlist, SCM input_node, SCM output_node);
+SCM nodal_voltage_gains(SCM circuit, SCM angular_frequencies);
+SCM nodal_filter_cost(SCM circuit, SCM target);
+SCM nodal_circuit_statistics(SCM circuit);
+
+void init_nodal_circuit_type(void) {
+    SCM name, slots;
+    scm_t_struct_finalize finalizer;
+
+    name = scm_from_utf8_symbol("nodal-circuit");
+    slots = scm_list_2(scm_from_utf8_symbol("circuit"), scm_from_utf8_symbol("components"));
+    finalizer = NULL;
+    nodal_circuit_type = scm_make_foreign_object_type(name, slots, finalizer);
+
+    __extension__
+    scm_c_define_gsubr("make-nodal-circuit", 3, 0, 0, (scm_t_subr) make_nodal_circuit);
+    __extension__
+    scm_c_define_gsubr("nodal-voltage-gains", 2, 0, 0, (scm_t_subr) nodal_voltage_gains);
+    __extension__
+    scm_c_define_gsubr("nodal-filter-cost", 2, 0, 0, (scm_t_subr) nodal_filter_cost);
+    __extension__
+    scm_c_define_gsubr("nodal-circuit-statistics", 1, 0, 0, (scm_t_subr) nodal_circuit_statistics);
+}
+
+NodalCircuit *get_nodal_circuit(SCM circuit) {
+    scm_assert_foreign_object_type(nodal_circuit_type, circuit);
+    return scm_foreign_object_ref(circuit, 0);
+}
+
+/* Snapshot of the components' current values, in netlist order. */
+FlatComponent *flatten_nodal_components(SCM circuit) {
+    NodalCircuit *nodal_circuit = get_nodal_circuit(circuit);
+    SCM components = scm_foreign_object_ref(circuit, 1);
+    FlatComponent *flat_components = scm_gc_malloc_pointerless(
+        (nodal_circuit->element_count + 1) * sizeof(FlatComponent), "nodal components"
+    );
+    for (size_t i = 0; i < nodal_circuit->element_count; i++) {
+        flatten_component(SCM_SIMPLE_VECTOR_REF(components, i), &flat_components[i]);
+    }
+    return flat_components;
+}
+
+typedef struct {
+    size_t node_a;
+    size_t node_b;
+} NodePair;
+
+/*
+ * Minimum-degree elimination on a dense adjacency matrix. Fills order with
+ * the unknowns in pivot order and adjacency with the filled graph.
+ */
+static void minimum_degree_order(size_t count, unsigned char *adjacency, size_t *order) {
+    bool *eliminated = scm_gc_calloc(count + 1, "eliminated unknowns");
+    size_t *neighbors = scm_gc_malloc_pointerless((count + 1) * sizeof(size_t), "neighbors");
+
+    for (size_t step = 0; step < count; step++) {
+        size_t pivot = NO_ENTRY;
+        size_t pivot_degree = SIZE_MAX;
+        for (size_t u = 0; u < count; u++) {
+            if (eliminated[u]) {
+                continue;
+            }
+            size_t degree = 0;
+            for (size_t v = 0; v < count; v++) {
+                degree += !eliminated[v] && adjacency[u * count + v];
+            }
+            if (degree < pivot_degree) {
+                pivot = u;
+                pivot_degree = degree;
+            }
+        }
+
+        size_t neighbor_count = 0;
+        for (size_t v = 0; v < count; v++) {
+            if (!eliminated[v] && adjacency[pivot * count + v]) {
+                neighbors[neighbor_count++] = v;
+            }
+        }
+        for (size_t i = 0; i < neighbor_count; i++) {
+            for (size_t j = 0; j < neighbor_count; j++) {
+                if (i != j) {
+                    adjacency[neighbors[i] * count + neighbors[j]] = 1;
+                }
+            }
+        }
+        eliminated[pivot] = true;
+        order[step] = pivot;
+    }
+}
+
+static size_t netlist_node(SCM node, size_t *node_count) {
+    size_t index = scm_to_size_t(node);
+    if (index + 1 > *node_count) {
+        *node_count = index + 1;
+    }
+    return index;
+}
+
+/*
+ * Orders the unknowns and builds the stamp and elimination schedules.
+ * Returns NULL if the output node is not connected to any unknown.
+ */
+static NodalCircuit *analyze_netlist(
+    const NodePair *pairs, 
+    size_t element_count, 
+    size_t node_count, 
+    size_t input, 
+    size_t output
+) {
+    /* Number the nodes that are neither ground nor the input. */
+    size_t *unknowns = scm_gc_malloc_pointerless(node_count * sizeof(size_t), "node unknowns");
+    for (size_t node = 0; node < node_count; node++) {
+        unknowns[node] = NO_ENTRY;
+    }
+    size_t unknown_count = 0;
+    for (size_t i = 0; i < element_count; i++) {
+        size_t nodes[2] = {pairs[i].node_a, pairs[i].node_b};
+        for (size_t j = 0; j < 2; j++) {
+            if (nodes[j] != 0 && nodes[j] != input && unknowns[nodes[j]] == NO_ENTRY) {
+                unknowns[nodes[j]] = unknown_count++;
+            }
+        }
+    }
+    if (unknowns[output] == NO_ENTRY) {
+        return NULL;
+    }
+
+    size_t n = unknown_count;
+    unsigned char *adjacency = scm_gc_calloc(n * n + 1, "nodal adjacency");
+    for (size_t i = 0; i < element_count; i++) {
+        size_t u = unknowns[pairs[i].node_a];
+        size_t v = unknowns[pairs[i].node_b];
+        if (u != NO_ENTRY && v != NO_ENTRY && u != v) {
+            adjacency[u * n + v] = 1;
+            adjacency[v * n + u] = 1;
+        }
+    }
+    size_t *order = scm_gc_malloc_pointerless((n + 1) * sizeof(size_t), "pivot order");
+    minimum_degree_order(n, adjacency, order);
+    size_t *pivot_of = scm_gc_malloc_pointerless((n + 1) * sizeof(size_t), "pivots");
+    for (size_t k = 0; k < n; k++) {
+        pivot_of[order[k]] = k;
+    }
+
+    /* Lay out the filled lower triangle in pivot order, column by column. */
+    NodalCircuit *circuit = scm_gc_malloc(sizeof(NodalCircuit), "nodal circuit");
+    circuit->element_count = element_count;
+    circuit->unknown_count = n;
+    circuit->output = pivot_of[unknowns[output]];
+    size_t *positions = malloc((n * n + 1) * sizeof(size_t));
+    if (positions == NULL) {
+        scm_memory_error("make-nodal-circuit");
+    }
+    circuit->diagonal = scm_gc_malloc_pointerless((n + 1) * sizeof(size_t), "nodal diagonal");
+    circuit->column_starts = scm_gc_malloc_pointerless((n + 1) * sizeof(size_t), "nodal columns");
+    size_t entry_count = 0;
+    for (size_t k = 0; k < n; k++) {
+        circuit->diagonal[k] = entry_count++;
+        positions[k * n + k] = circuit->diagonal[k];
+        for (size_t i = k + 1; i < n; i++) {
+            if (adjacency[order[i] * n + order[k]]) {
+                entry_count++;
+            }
+        }
+    }
+    circuit->entry_count = entry_count;
+    size_t strict_count = entry_count - n;
+    circuit->column_rows = scm_gc_malloc_pointerless((strict_count + 1) * sizeof(size_t), "nodal rows");
+    circuit->column_entries = scm_gc_malloc_pointerless((strict_count + 1) * sizeof(size_t), "nodal entries");
+    size_t strict = 0;
+    for (size_t k = 0; k < n; k++) {
+        circuit->column_starts[k] = strict;
+        for (size_t i = k + 1; i < n; i++) {
+            if (adjacency[order[i] * n + order[k]]) {
+                circuit->column_rows[strict] = i;
+                circuit->column_entries[strict] = circuit->diagonal[k] + 1 + (strict - circuit->column_starts[k]);
+                positions[i * n + k] = circuit->column_entries[strict];
+                strict++;
+            }
+        }
+    }
+    circuit->column_starts[n] = strict;
+
+    /* Eliminating pivot k updates every (i, j) pair below it, i >= j. */
+    circuit->update_starts = scm_gc_malloc_pointerless((n + 1) * sizeof(size_t), "nodal updates");
+    size_t update_count = 0;
+    for (size_t k = 0; k < n; k++) {
+        size_t column_size = circuit->column_starts[k + 1] - circuit->column_starts[k];
+        update_count += column_size * (column_size + 1) / 2;
+    }
+    circuit->updates = scm_gc_malloc_pointerless((3 * update_count + 1) * sizeof(size_t), "nodal updates");
+    size_t update = 0;
+    for (size_t k = 0; k < n; k++) {
+        circuit->update_starts[k] = update;
+        for (size_t a = circuit->column_starts[k]; a < circuit->column_starts[k + 1]; a++) {
+            for (size_t b = circuit->column_starts[k]; b <= a; b++) {
+                size_t i = circuit->column_rows[a];
+                size_t j = circuit->column_rows[b];
+                circuit->updates[3 * update] = positions[i * n + j];
+                circuit->updates[3 * update + 1] = circuit->column_entries[a];
+                circuit->updates[3 * update + 2] = circuit->column_entries[b];
+                update++;
+            }
+        }
+    }
+    circuit->update_starts[n] = update;
+
+    circuit->stamps = scm_gc_malloc_pointerless((element_count + 1) * sizeof(NodalStamp), "nodal stamps");
+    for (size_t e = 0; e < element_count; e++) {
+        NodalStamp *stamp = &circuit->stamps[e];
+        size_t nodes[2] = {pairs[e].node_a, pairs[e].node_b};
+        size_t pivots[2];
+        for (size_t j = 0; j < 2; j++) {
+            pivots[j] = unknowns[nodes[j]] == NO_ENTRY ? NO_ENTRY : pivot_of[unknowns[nodes[j]]];
+        }
+        stamp->diagonal[0] = NO_ENTRY;
+        stamp->diagonal[1] = NO_ENTRY;
+        stamp->off_diagonal = NO_ENTRY;
+        stamp->source_row = NO_ENTRY;
+        if (nodes[0] == nodes[1]) {
+            continue;
+        }
+        for (size_t j = 0; j < 2; j++) {
+            if (pivots[j] != NO_ENTRY) {
+                stamp->diagonal[j] = positions[pivots[j] * n + pivots[j]];
+                if (nodes[1 - j] == input) {
+                    stamp->source_row = pivots[j];
+                }
+            }
+        }
+        if (pivots[0] != NO_ENTRY && pivots[1] != NO_ENTRY) {
+            size_t row = pivots[0] > pivots[1] ? pivots[0] : pivots[1];
+            size_t column = pivots[0] > pivots[1] ? pivots[1] : pivots[0];
+            stamp->off_diagonal = positions[row * n + column];
+        }
+    }
+    free(positions);
+
+    return circuit;
+}
+
+/*
+ * netlist is a list of (node-a node-b component) entries. Node 0 is ground
+ * and input-node is driven by the source.
+ */
+SCM make_nodal_circuit(SCM netlist, SCM input_node, SCM output_node) {
+    const char *subr = "make-nodal-circuit";
+    SCM_ASSERT_TYPE(
+        scm_is_true(scm_list_p(netlist)), 
+        netlist, 
+        SCM_ARG1, 
+        subr, 
+        "List of netlist entries");
+
+    size_t element_count = scm_to_size_t(scm_length(netlist));
+    size_t node_count = 0;
+    size_t input = netlist_node(input_node, &node_count);
+    size_t output = netlist_node(output_node, &node_count);
+    if (input == 0) {
+        scm_out_of_range(subr, input_node);
+    }
+    if (output == 0 || output == input) {
+        scm_out_of_range(subr, output_node);
+    }
+
+    NodePair *pairs = scm_gc_malloc_pointerless((element_count + 1) * sizeof(NodePair), "netlist nodes");
+    SCM components = scm_c_make_vector(element_count, SCM_BOOL_F);
+    SCM entries = netlist;
+    for (size_t i = 0; i < element_count; i++, entries = scm_cdr(entries)) {
+        SCM entry = scm_car(entries);
+        SCM_ASSERT_TYPE(
+            scm_is_true(scm_list_p(entry)) && scm_to_size_t(scm_length(entry)) == 3, 
+            entry, 
+            SCM_ARG1, 
+            subr, 
+            "(node-a node-b component)");
+        pairs[i].node_a = netlist_node(scm_car(entry), &node_count);
+        pairs[i].node_b = netlist_node(scm_cadr(entry), &node_count);
+        scm_assert_foreign_object_type(component_type, scm_caddr(entry));
+        SCM_SIMPLE_VECTOR_SET(components, i, scm_caddr(entry));
+    }
+
+    NodalCircuit *circuit = analyze_netlist(pairs, element_count, node_count, input, output);
+    if (circuit == NULL) {
+        scm_misc_error(subr, "Output node ~A is not connected.", scm_list_1(output_node));
+    }
+    return scm_make_foreign_object_2(nodal_circuit_type, circuit, components);
+}
+
+/*
+ * Solves for the output node voltage. Like network_voltage_gain on a ladder
+ * it reports input over output voltage, so targets and costs carry over.
+ * values and solution are scratch space for entry_count and unknown_count
+ * complex numbers.
+ */
+double complex nodal_voltage_gain(
+    const NodalCircuit *circuit, 
+    const FlatComponent *components, 
+    double angular_frequency, 
+    double complex *values, 
+    double complex *solution
+) {
+    size_t n = circuit->unknown_count;
+    memset(values, 0, circuit->entry_count * sizeof(double complex));
+    memset(solution, 0, n * sizeof(double complex));
+
+    for (size_t e = 0; e < circuit->element_count; e++) {
+        const NodalStamp *stamp = &circuit->stamps[e];
+        double complex admittance = 1.0 / flat_component_impedance(angular_frequency, &components[e]);
+        for (size_t j = 0; j < 2; j++) {
+            if (stamp->diagonal[j] != NO_ENTRY) {
+                values[stamp->diagonal[j]] += admittance;
+            }
+        }
+        if (stamp->off_diagonal != NO_ENTRY) {
+            values[stamp->off_diagonal] -= admittance;
+        }
+        if (stamp->source_row != NO_ENTRY) {
+            solution[stamp->source_row] += admittance;
+        }
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        double complex inverse_pivot = 1.0 / values[circuit->diagonal[k]];
+        for (size_t u = circuit->update_starts[k]; u < circuit->update_starts[k + 1]; u++) {
+            const size_t *update = &circuit->updates[3 * u];
+            values[update[0]] -= values[update[1]] * values[update[2]] * inverse_pivot;
+        }
+        for (size_t e = circuit->column_starts[k]; e < circuit->column_starts[k + 1]; e++) {
+            values[circuit->column_entries[e]] *= inverse_pivot;
+        }
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        for (size_t e = circuit->column_starts[k]; e < circuit->column_starts[k + 1]; e++) {
+            solution[circuit->column_rows[e]] -= values[circuit->column_entries[e]] * solution[k];
+        }
+    }
+    for (size_t k = 0; k < n; k++) {
+        solution[k] /= values[circuit->diagonal[k]];
+    }
+    for (size_t k = n; k-- > 0;) {
+        for (size_t e = circuit->column_starts[k]; e < circuit->column_starts[k + 1]; e++) {
+            solution[k] -= values[circuit->column_entries[e]] * solution[circuit->column_rows[e]];
+        }
+    }
+    return 1.0 / solution[circuit->output];
+}
+
+typedef struct {
+    const NodalCircuit *circuit;
+    const FlatComponent *components;
+    const double *angular_frequencies;
+    size_t frequency_count;
+    double complex *gains;
+    double complex *scratch;
+} NodalSweep;
+
+static void sweep_chunk(size_t chunk, void *context) {
+    NodalSweep *sweep = context;
+    const NodalCircuit *circuit = sweep->circuit;
+    double complex *values = 
+        sweep->scratch + chunk * (circuit->entry_count + circuit->unknown_count);
+    double complex *solution = values + circuit->entry_count;
+    size_t end = (chunk + 1) * FREQUENCY_CHUNK;
+    end = end < sweep->frequency_count ? end : sweep->frequency_count;
+    for (size_t f = chunk * FREQUENCY_CHUNK; f < end; f++) {
+        sweep->gains[f] = nodal_voltage_gain(
+            circuit, sweep->components, sweep->angular_frequencies[f], values, solution
+        );
+    }
+}
+
+static double complex *sweep_nodal_circuit(
+    SCM circuit, 
+    const double *angular_frequencies, 
+    size_t frequency_count
+) {
+    NodalSweep sweep;
+    sweep.circuit = get_nodal_circuit(circuit);
+    sweep.components = flatten_nodal_components(circuit);
+    sweep.angular_frequencies = angular_frequencies;
+    sweep.frequency_count = frequency_count;
+    sweep.gains = scm_gc_malloc_pointerless(
+        (frequency_count + 1) * sizeof(double complex), "nodal gains"
+    );
+    size_t chunk_count = (frequency_count + FREQUENCY_CHUNK - 1) / FREQUENCY_CHUNK;
+    sweep.scratch = scm_gc_malloc_pointerless(
+        (chunk_count * (sweep.circuit->entry_count + sweep.circuit->unknown_count) + 1) * 
+            sizeof(double complex), 
+        "nodal scratch"
+    );
+    parallel_for(chunk_count, sweep_chunk, &sweep);
+    return sweep.gains;
+}
+
+SCM nodal_voltage_gains(SCM circuit, SCM angular_frequencies) {
+    size_t count;
+    double *frequencies = double_array_from_vector(
+        angular_frequencies, &count, SCM_ARG2, "nodal-voltage-gains"
+    );
+    return complex_vector_from_array(sweep_nodal_circuit(circuit, frequencies, count), count);
+}
+
+SCM nodal_filter_cost(SCM circuit, SCM target) {
+    const ResponseTarget *response_target = get_response_target(target);
+    double complex *gains = sweep_nodal_circuit(
+        circuit, response_target->angular_frequencies, response_target->count
+    );
+    double cost = response_error(response_target, gains);
+    scm_remember_upto_here_1(target);
+    return scm_from_double(cost);
+}
+
+SCM nodal_circuit_statistics(SCM circuit) {
+    NodalCircuit *nodal_circuit = get_nodal_circuit(circuit);
+    return scm_list_3(
+        scm_cons(scm_from_utf8_symbol("unknowns"), scm_from_size_t(nodal_circuit->unknown_count)), 
+        scm_cons(scm_from_utf8_symbol("entries"), scm_from_size_t(nodal_circuit->entry_count)), 
+        scm_cons(
+            scm_from_utf8_symbol("updates"), 
+            scm_from_size_t(nodal_circuit->update_starts[nodal_circuit->unknown_count])
+        )
+    );
+}
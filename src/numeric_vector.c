@@ -0,0 +1,43 @@
+#include <complex.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "numeric_vector.h"
+
+/* Copies a Scheme vector of reals into a fresh GC-managed array. */
+double *double_array_from_vector(SCM vector, size_t *count, int position, const char *subr) {
+    SCM_ASSERT_TYPE(scm_is_vector(vector), vector, position, subr, "Vector of real numbers");
+
+    *count = SCM_SIMPLE_VECTOR_LENGTH(vector);
+    double *values = scm_gc_malloc_pointerless(
+        (*count > 0 ? *count : 1) * sizeof(double), "numeric array"
+    );
+    for (size_t i = 0; i < *count; i++) {
+        values[i] = scm_to_double(SCM_SIMPLE_VECTOR_REF(vector, i));
+    }
+    return values;
+}
+
+SCM real_vector_from_array(const double *values, size_t count) {
+    scm_t_array_handle handle;
+    size_t length;
+    ssize_t increment;
+
+    SCM vector = scm_make_f64vector(scm_from_size_t(count), SCM_UNDEFINED);
+    double *elements = scm_f64vector_writable_elements(vector, &handle, &length, &increment);
+    memcpy(elements, values, count * sizeof(double));
+    scm_array_handle_release(&handle);
+    return vector;
+}
+
+SCM complex_vector_from_array(const double complex *values, size_t count) {
+    scm_t_array_handle handle;
+    size_t length;
+    ssize_t increment;
+
+    SCM vector = scm_make_c64vector(scm_from_size_t(count), SCM_UNDEFINED);
+    double *elements = scm_c64vector_writable_elements(vector, &handle, &length, &increment);
+    memcpy(elements, values, count * sizeof(double complex));
+    scm_array_handle_release(&handle);
+    return vector;
+}
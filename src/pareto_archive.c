@@ -0,0 +1,461 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "flat_filter.h"
+#include "neighborhood.h"
+#include "pareto_archive.h"
+#include "response_target.h"
+
+/*
+ * An archive of mutually non-dominated candidates for one stage topology,
+ * all objectives minimized. Candidates are stored compactly (objectives,
+ * an int16 rank per component and a bit per connection flag) instead of as
+ * load trees, and restored into a stage vector on demand.
+ *
+ * Live entries are kept in an array sorted by their first objective. With
+ * two objectives the non-dominated entries form a staircase (first
+ * objective increasing, second decreasing), so a dominance query is a
+ * binary search and the entries a candidate dominates are one contiguous
+ * run found by a second binary search: O(log n). With three or more
+ * objectives there is no such index; a query scans every entry whose
+ * first objective is at or below the candidate's, and an insertion also
+ * scans every entry at or above it, so both are O(n) in the worst case.
+ * Either way, an insertion shifts the tail of the sorted array, which is
+ * O(n) index moves (a memmove of up to n words).
+ *
+ * When the archive outgrows its capacity it is pruned to 90% by dropping
+ * the most crowded entries (smallest NSGA-II crowding distance); the
+ * extremes are always kept.
+ */
+
+#define PRUNE_PERCENT 90
+
+typedef struct {
+    size_t objective_count;
+    size_t component_count;
+    size_t capacity;
+    size_t entry_size;
+    unsigned char *entries;
+    size_t *order;
+    size_t count;
+    size_t *free_entries;
+    size_t free_count;
+} ParetoArchive;
+
+SCM pareto_archive_type;
+
+SCM make_pareto_archive(SCM stages, SCM objective_count, SCM capacity);
+SCM pareto_archive_insert(SCM archive, SCM stages, SCM objectives);
+SCM pareto_archive_dominated_p(SCM archive, SCM objectives);
+SCM pareto_archive_size(SCM archive);
+SCM pareto_archive_objectives(SCM archive, SCM index);
+SCM pareto_archive_restore(SCM archive, SCM index, SCM stages);
+SCM filter_objectives(SCM stages, SCM target);
+void finalize_pareto_archive(SCM archive);
+
+void init_pareto_archive_type(void) {
+    SCM name, slots;
+
+    name = scm_from_utf8_symbol("pareto-archive");
+    slots = scm_list_1(scm_from_utf8_symbol("archive"));
+    pareto_archive_type = scm_make_foreign_object_type(name, slots, finalize_pareto_archive);
+
+    __extension__
+    scm_c_define_gsubr("make-pareto-archive", 3, 0, 0, (scm_t_subr) make_pareto_archive);
+    __extension__
+    scm_c_define_gsubr("pareto-archive-insert!", 3, 0, 0, (scm_t_subr) pareto_archive_insert);
+    __extension__
+    scm_c_define_gsubr("pareto-archive-dominated?", 2, 0, 0, (scm_t_subr) pareto_archive_dominated_p);
+    __extension__
+    scm_c_define_gsubr("pareto-archive-size", 1, 0, 0, (scm_t_subr) pareto_archive_size);
+    __extension__
+    scm_c_define_gsubr("pareto-archive-objectives", 2, 0, 0, (scm_t_subr) pareto_archive_objectives);
+    __extension__
+    scm_c_define_gsubr("pareto-archive-restore!", 3, 0, 0, (scm_t_subr) pareto_archive_restore);
+    __extension__
+    scm_c_define_gsubr("filter-objectives", 2, 0, 0, (scm_t_subr) filter_objectives);
+}
+
+SCM make_pareto_archive(SCM stages, SCM objective_count, SCM capacity) {
+    FlatFilter *filter = compile_filter(stages);
+    size_t objectives = scm_to_size_t(objective_count);
+    size_t max_entries = scm_to_size_t(capacity);
+    if (objectives == 0) {
+        scm_out_of_range("make-pareto-archive", objective_count);
+    }
+    if (max_entries == 0) {
+        scm_out_of_range("make-pareto-archive", capacity);
+    }
+
+    ParetoArchive *archive = scm_gc_malloc_pointerless(sizeof(ParetoArchive), "pareto archive");
+    archive->objective_count = objectives;
+    archive->component_count = filter->component_count;
+    archive->capacity = max_entries;
+    archive->entry_size = 
+        objectives * sizeof(double) + 
+        filter->component_count * sizeof(int16_t) + 
+        (filter->component_count + 7) / 8;
+    archive->entry_size = (archive->entry_size + 7) & ~(size_t) 7;
+    archive->count = 0;
+    archive->free_count = 0;
+
+    /* One spare entry holds a candidate while it is being inserted. */
+    archive->entries = malloc((max_entries + 2) * archive->entry_size);
+    archive->order = malloc((max_entries + 2) * sizeof(size_t));
+    archive->free_entries = malloc((max_entries + 2) * sizeof(size_t));
+    if (archive->entries == NULL || archive->order == NULL || archive->free_entries == NULL) {
+        free(archive->entries);
+        free(archive->order);
+        free(archive->free_entries);
+        scm_memory_error("make-pareto-archive");
+    }
+    for (size_t i = max_entries + 2; i-- > 0;) {
+        archive->free_entries[archive->free_count++] = i;
+    }
+    return scm_make_foreign_object_1(pareto_archive_type, archive);
+}
+
+void finalize_pareto_archive(SCM archive_object) {
+    ParetoArchive *archive = scm_foreign_object_ref(archive_object, 0);
+    free(archive->entries);
+    free(archive->order);
+    free(archive->free_entries);
+}
+
+static ParetoArchive *get_pareto_archive(SCM archive) {
+    scm_assert_foreign_object_type(pareto_archive_type, archive);
+    return scm_foreign_object_ref(archive, 0);
+}
+
+static double *entry_objectives(const ParetoArchive *archive, size_t entry) {
+    return (double *) (archive->entries + entry * archive->entry_size);
+}
+
+static int16_t *entry_ranks(const ParetoArchive *archive, size_t entry) {
+    return (int16_t *) (entry_objectives(archive, entry) + archive->objective_count);
+}
+
+static unsigned char *entry_connections(const ParetoArchive *archive, size_t entry) {
+    return (unsigned char *) (entry_ranks(archive, entry) + archive->component_count);
+}
+
+static bool dominates(const double *objectives1, const double *objectives2, size_t count) {
+    bool strictly_better = false;
+    for (size_t i = 0; i < count; i++) {
+        if (objectives1[i] > objectives2[i]) {
+            return false;
+        }
+        strictly_better |= objectives1[i] < objectives2[i];
+    }
+    return strictly_better;
+}
+
+/* Compared as values, so -0.0 and 0.0 are the same objective. */
+static bool same_objectives(const double *objectives1, const double *objectives2, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (objectives1[i] != objectives2[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* First position in the order whose first objective is not below value (or above, if upper). */
+static size_t order_bound(const ParetoArchive *archive, double value, bool upper) {
+    size_t low = 0;
+    size_t high = archive->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        double first = entry_objectives(archive, archive->order[middle])[0];
+        if (upper ? first <= value : first < value) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/* First position at or after start whose second objective is below value. */
+static size_t staircase_bound(const ParetoArchive *archive, size_t start, double value) {
+    size_t low = start;
+    size_t high = archive->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (entry_objectives(archive, archive->order[middle])[1] >= value) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/* True if an archived entry dominates objectives or has exactly the same ones. */
+static bool archive_covers(const ParetoArchive *archive, const double *objectives) {
+    size_t end = order_bound(archive, objectives[0], true);
+    if (archive->objective_count == 2) {
+        /* The last entry not above in the first objective is lowest in the second. */
+        return end > 0 && entry_objectives(archive, archive->order[end - 1])[1] <= objectives[1];
+    }
+    for (size_t i = 0; i < end; i++) {
+        const double *archived = entry_objectives(archive, archive->order[i]);
+        if (
+            dominates(archived, objectives, archive->objective_count) || 
+            same_objectives(archived, objectives, archive->objective_count)
+        ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void read_objectives(const ParetoArchive *archive, SCM objectives, double *values, const char *subr) {
+    SCM_ASSERT_TYPE(
+        scm_is_vector(objectives) && 
+            SCM_SIMPLE_VECTOR_LENGTH(objectives) == archive->objective_count, 
+        objectives, 
+        SCM_ARG2, 
+        subr, 
+        "Vector with one value per objective");
+    for (size_t i = 0; i < archive->objective_count; i++) {
+        values[i] = scm_to_double(SCM_SIMPLE_VECTOR_REF(objectives, i));
+        if (isnan(values[i])) {
+            scm_out_of_range(subr, objectives);
+        }
+    }
+}
+
+typedef struct {
+    double value;
+    size_t position;
+} RankedPosition;
+
+static int compare_ranked_positions(const void *first, const void *second) {
+    const RankedPosition *position1 = first;
+    const RankedPosition *position2 = second;
+    if (position1->value != position2->value) {
+        return (position1->value > position2->value) - (position1->value < position2->value);
+    }
+    return (position1->position > position2->position) - (position1->position < position2->position);
+}
+
+static void prune_archive(ParetoArchive *archive) {
+    size_t count = archive->count;
+    size_t keep = archive->capacity * PRUNE_PERCENT / 100;
+    keep = keep > 0 ? keep : 1;
+
+    /* Crowding distances, indexed by position in the order. */
+    double *distances = calloc(count, sizeof(double));
+    RankedPosition *ranked = malloc(count * sizeof(RankedPosition));
+    if (distances == NULL || ranked == NULL) {
+        free(distances);
+        free(ranked);
+        scm_memory_error("pareto-archive-insert!");
+    }
+
+    for (size_t d = 0; d < archive->objective_count; d++) {
+        for (size_t i = 0; i < count; i++) {
+            ranked[i] = (RankedPosition) {entry_objectives(archive, archive->order[i])[d], i};
+        }
+        qsort(ranked, count, sizeof(RankedPosition), compare_ranked_positions);
+        double span = ranked[count - 1].value - ranked[0].value;
+        distances[ranked[0].position] = INFINITY;
+        distances[ranked[count - 1].position] = INFINITY;
+        for (size_t i = 1; i + 1 < count && span > 0; i++) {
+            distances[ranked[i].position] += (ranked[i + 1].value - ranked[i - 1].value) / span;
+        }
+    }
+
+    /* Drop the most crowded entries, then close the gaps in the order. */
+    for (size_t i = 0; i < count; i++) {
+        ranked[i] = (RankedPosition) {distances[i], i};
+    }
+    qsort(ranked, count, sizeof(RankedPosition), compare_ranked_positions);
+    for (size_t i = 0; i < count - keep; i++) {
+        size_t position = ranked[i].position;
+        archive->free_entries[archive->free_count++] = archive->order[position];
+        archive->order[position] = SIZE_MAX;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (archive->order[i] != SIZE_MAX) {
+            archive->order[kept++] = archive->order[i];
+        }
+    }
+    archive->count = kept;
+
+    free(distances);
+    free(ranked);
+}
+
+/* Returns #t if the candidate entered the archive, #f if it was dominated. */
+SCM pareto_archive_insert(SCM archive_object, SCM stages, SCM objectives) {
+    ParetoArchive *archive = get_pareto_archive(archive_object);
+    FlatFilter *filter = compile_filter(stages);
+    if (filter->component_count != archive->component_count) {
+        scm_misc_error(
+            "pareto-archive-insert!", 
+            "Stages do not match the archive's topology.", 
+            SCM_EOL
+        );
+    }
+
+    size_t entry = archive->free_entries[archive->free_count - 1];
+    double *values = entry_objectives(archive, entry);
+    read_objectives(archive, objectives, values, "pareto-archive-insert!");
+    if (archive_covers(archive, values)) {
+        return SCM_BOOL_F;
+    }
+
+    int16_t *ranks = entry_ranks(archive, entry);
+    unsigned char *connections = entry_connections(archive, entry);
+    memset(connections, 0, (archive->component_count + 7) / 8);
+    for (size_t i = 0; i < filter->component_count; i++) {
+        int rank = filter->components[i].rank;
+        if (rank < INT16_MIN || rank > INT16_MAX) {
+            scm_out_of_range("pareto-archive-insert!", stages);
+        }
+        ranks[i] = (int16_t) rank;
+        if (filter->components[i].is_connected) {
+            connections[i / 8] |= 1u << (i % 8);
+        }
+    }
+    archive->free_count--;
+
+    size_t position = order_bound(archive, values[0], false);
+    if (archive->objective_count == 2) {
+        /* Dominated entries: the run from position whose second objective is not below ours. */
+        size_t end = staircase_bound(archive, position, values[1]);
+        for (size_t i = position; i < end; i++) {
+            archive->free_entries[archive->free_count++] = archive->order[i];
+        }
+        memmove(
+            &archive->order[position + 1], 
+            &archive->order[end], 
+            (archive->count - end) * sizeof(size_t)
+        );
+        archive->count -= end - position;
+    }
+    else {
+        size_t kept = position;
+        for (size_t i = position; i < archive->count; i++) {
+            size_t archived = archive->order[i];
+            if (dominates(values, entry_objectives(archive, archived), archive->objective_count)) {
+                archive->free_entries[archive->free_count++] = archived;
+            }
+            else {
+                archive->order[kept++] = archived;
+            }
+        }
+        archive->count = kept;
+        memmove(
+            &archive->order[position + 1], 
+            &archive->order[position], 
+            (archive->count - position) * sizeof(size_t)
+        );
+    }
+    archive->order[position] = entry;
+    archive->count++;
+
+    if (archive->count > archive->capacity) {
+        prune_archive(archive);
+    }
+    return SCM_BOOL_T;
+}
+
+SCM pareto_archive_dominated_p(SCM archive_object, SCM objectives) {
+    ParetoArchive *archive = get_pareto_archive(archive_object);
+    double *values = scm_gc_malloc_pointerless(
+        archive->objective_count * sizeof(double), "objectives"
+    );
+    read_objectives(archive, objectives, values, "pareto-archive-dominated?");
+    return scm_from_bool(archive_covers(archive, values));
+}
+
+SCM pareto_archive_size(SCM archive) {
+    return scm_from_size_t(get_pareto_archive(archive)->count);
+}
+
+static size_t archive_entry(ParetoArchive *archive, SCM index, const char *subr) {
+    size_t position = scm_to_size_t(index);
+    if (position >= archive->count) {
+        scm_out_of_range(subr, index);
+    }
+    return archive->order[position];
+}
+
+/* Entries are numbered in increasing order of their first objective. */
+SCM pareto_archive_objectives(SCM archive_object, SCM index) {
+    ParetoArchive *archive = get_pareto_archive(archive_object);
+    size_t entry = archive_entry(archive, index, "pareto-archive-objectives");
+    SCM objectives = scm_c_make_vector(archive->objective_count, SCM_BOOL_F);
+    for (size_t i = 0; i < archive->objective_count; i++) {
+        SCM_SIMPLE_VECTOR_SET(
+            objectives, i, scm_from_double(entry_objectives(archive, entry)[i])
+        );
+    }
+    return objectives;
+}
+
+SCM pareto_archive_restore(SCM archive_object, SCM index, SCM stages) {
+    ParetoArchive *archive = get_pareto_archive(archive_object);
+    size_t entry = archive_entry(archive, index, "pareto-archive-restore!");
+    FlatFilter *filter = compile_filter(stages);
+    if (filter->component_count != archive->component_count) {
+        scm_misc_error(
+            "pareto-archive-restore!", 
+            "Stages do not match the archive's topology.", 
+            SCM_EOL
+        );
+    }
+
+    const int16_t *ranks = entry_ranks(archive, entry);
+    const unsigned char *connections = entry_connections(archive, entry);
+    for (size_t i = 0; i < filter->component_count; i++) {
+        set_flat_component_rank(&filter->components[i], ranks[i]);
+        filter->components[i].is_connected = (connections[i / 8] >> (i % 8)) & 1;
+    }
+    store_flat_filter_state(filter, stages);
+    return stages;
+}
+
+/*
+ * Returns #(response-error connected-components sensitivity). Sensitivity
+ * is the mean absolute change of the response error when a single connected
+ * component moves one rank up or down.
+ */
+SCM filter_objectives(SCM stages, SCM target) {
+    FlatFilter *filter = compile_filter(stages);
+    const ResponseTarget *response_target = get_response_target(target);
+    double cost = flat_filter_cost(filter, response_target);
+
+    size_t connected = 0;
+    for (size_t i = 0; i < filter->component_count; i++) {
+        connected += filter->components[i].is_connected;
+    }
+
+    NeighborMove *moves;
+    size_t move_count = scan_neighborhood(filter, response_target, 1, &moves);
+    double total_change = 0;
+    size_t rank_moves = 0;
+    for (size_t i = 0; i < move_count; i++) {
+        if (!moves[i].toggles_connection) {
+            total_change += fabs(moves[i].cost - cost);
+            rank_moves++;
+        }
+    }
+    scm_remember_upto_here_1(target);
+
+    return scm_vector(scm_list_3(
+        scm_from_double(cost), 
+        scm_from_size_t(connected), 
+        scm_from_double(rank_moves > 0 ? total_change / rank_moves : 0.0)
+    ));
+}
@@ -132,59 +132,101 @@ double evaluated_component_value(SCM preferred_value) {
     return pow(10.0, order_of_magnitude) * e24_values[value_index];
 }
 
+/*
+ * A rank numbers every preferred value in order:
+ * rank = 24 * order of magnitude + E24 index.
+ */
+static int rank_order_of_magnitude(int rank) {
+    return rank >= 0 ? rank / num_e24_values : -((num_e24_values - 1 - rank) / num_e24_values);
+}
+
+double preferred_value_from_rank(int rank) {
+    int order_of_magnitude = rank_order_of_magnitude(rank);
+    int value_index = rank - order_of_magnitude * num_e24_values;
+    return pow(10.0, order_of_magnitude) * e24_values[value_index];
+}
+
+int preferred_component_value_rank(SCM preferred_value) {
+    return 
+        get_preferred_component_order_of_magnitude(preferred_value) * num_e24_values + 
+        get_preferred_component_value_index(preferred_value);
+}
+
+void set_preferred_component_value_rank(SCM preferred_value, int rank) {
+    int order_of_magnitude = rank_order_of_magnitude(rank);
+    set_preferred_component_value_index(preferred_value, rank - order_of_magnitude * num_e24_values);
+    set_preferred_component_value_order_of_magnitude(preferred_value, order_of_magnitude);
+}
+
 SCM scm_evaluated_component_value(SCM preferred_value) {
     return scm_from_double(evaluated_component_value(preferred_value));
 }
 
-SCM floor_preferred_value(SCM numeric_value) {
-
-    double log_value = log10(scm_to_double(numeric_value));
+int floor_preferred_value_rank(double value) {
+    double log_value = log10(value);
     int order_of_magnitude = (int) floor(log_value);
-    int eseries_index;
+    int eseries_index = 0;
     for (int i = 0; i < num_e24_values; i++) {
         if (log_value - order_of_magnitude >= log10(e24_values[i])) {
             eseries_index = i;
         }
     }
-
-    return make_preferred_component_value(
-        eseries_index,
-        order_of_magnitude
-    );
+    return order_of_magnitude * num_e24_values + eseries_index;
 }
 
-SCM ceiling_preferred_value(SCM numeric_value) {
-
-    double log_value = log10(scm_to_double(numeric_value));
+int ceiling_preferred_value_rank(double value) {
+    double log_value = log10(value);
     int order_of_magnitude = (int) floor(log_value);
-    int eseries_index;
+    /* Above the last E24 value the ceiling is the next decade. */
+    int eseries_index = num_e24_values;
     for (int i = num_e24_values - 1; i >= 0; i--) {
         if (log_value - order_of_magnitude <= log10(e24_values[i])) {
             eseries_index = i;
         }
     }
+    return order_of_magnitude * num_e24_values + eseries_index;
+}
 
+int nearest_preferred_value_rank(double value) {
+    int floor_rank = floor_preferred_value_rank(value);
+    int ceiling_rank = ceiling_preferred_value_rank(value);
+    if (
+        fabs(preferred_value_from_rank(floor_rank) - value) <= 
+        fabs(preferred_value_from_rank(ceiling_rank) - value)
+    ) {
+        return floor_rank;
+    }
+    else {
+        return ceiling_rank;
+    }
+}
+
+SCM make_preferred_component_value_from_rank(int rank) {
+    int order_of_magnitude = rank_order_of_magnitude(rank);
     return make_preferred_component_value(
-        eseries_index,
+        rank - order_of_magnitude * num_e24_values, 
         order_of_magnitude
     );
 }
 
-SCM nearest_preferred_value(SCM value_num) {
+SCM floor_preferred_value(SCM numeric_value) {
+    return make_preferred_component_value_from_rank(
+        floor_preferred_value_rank(scm_to_double(numeric_value))
+    );
+}
 
-    SCM floor = floor_preferred_value(value_num);
-    SCM ceiling = ceiling_preferred_value(value_num);
+SCM ceiling_preferred_value(SCM numeric_value) {
+    return make_preferred_component_value_from_rank(
+        ceiling_preferred_value_rank(scm_to_double(numeric_value))
+    );
+}
 
-    if (
-        fabs(evaluated_component_value(floor) - scm_to_double(value_num)) <= 
-        fabs(evaluated_component_value(ceiling) - scm_to_double(value_num))
-    ) {
-        return floor;
-    }
-    else {
-        return ceiling;
-    }
+SCM nearest_preferred_value(SCM value_num) {
+    return make_preferred_component_value_from_rank(
+        nearest_preferred_value_rank(scm_to_double(value_num))
+    );
 }
+
 SCM increment_component_value(SCM value) {
     int current_value_index = get_preferred_component_value_index(value);
     int current_order_of_magnitude = get_preferred_component_order_of_magnitude(value);
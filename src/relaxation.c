@@ -0,0 +1,407 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "flat_filter.h"
+#include "neighborhood.h"
+#include "preferred_value.h"
+#include "relaxation.h"
+#include "response_target.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+/*
+ * Two-phase value search. The continuous phase treats the natural log of
+ * every connected component's value as a real variable, boxed by the
+ * values of its lower and upper limit ranks, and minimizes the cost with
+ * projected BFGS: central-difference gradients, evaluated one variable per
+ * task, and a backtracking line search along the projected path. The
+ * discrete phase snaps each value to its nearest preferred rank within the
+ * limits and then follows the cheapest improving rank move from
+ * scan_neighborhood until no neighbor within the radius is better.
+ * Connection flags are left as they are: the relaxation has no gradient
+ * across a topology change.
+ */
+
+#define DEFAULT_RELAXATION_ITERATIONS 100
+#define DEFAULT_REFINEMENT_RADIUS 2
+#define GRADIENT_STEP 1e-5
+#define GRADIENT_TOLERANCE 1e-6
+#define MAX_LOG_STEP 1.0
+#define ARMIJO_FRACTION 1e-4
+#define MAX_BACKTRACKS 30
+#define MIN_CURVATURE 1e-12
+#define MAX_REFINEMENT_MOVES 1000
+
+typedef struct {
+    FlatFilter *filter;
+    const ResponseTarget *target;
+    size_t variable_count;
+    size_t *variables; /* Component index of each variable. */
+    double *lower;
+    double *upper;
+    double *point;
+    double *gradient;
+    FlatFilter *task_filters;
+    size_t evaluations;
+} Relaxation;
+
+SCM relax_filter_values(SCM stages, SCM target, SCM iterations, SCM radius);
+
+void init_relaxation(void) {
+    __extension__
+    scm_c_define_gsubr("relax-filter-values", 2, 2, 0, (scm_t_subr) relax_filter_values);
+}
+
+static double clamp(double value, double lower, double upper) {
+    return value < lower ? lower : value > upper ? upper : value;
+}
+
+static void set_log_values(FlatFilter *filter, const Relaxation *relaxation, const double *point) {
+    for (size_t i = 0; i < relaxation->variable_count; i++) {
+        filter->components[relaxation->variables[i]].value = exp(point[i]);
+    }
+}
+
+static double relaxed_cost(Relaxation *relaxation, const double *point) {
+    set_log_values(relaxation->filter, relaxation, point);
+    relaxation->evaluations++;
+    return flat_filter_cost(relaxation->filter, relaxation->target);
+}
+
+/* Central difference in one variable, one-sided where it meets a bound. */
+static void gradient_term(size_t index, void *context) {
+    Relaxation *relaxation = context;
+    FlatFilter *filter = &relaxation->task_filters[index];
+    FlatComponent *component = &filter->components[relaxation->variables[index]];
+    double x = relaxation->point[index];
+    double forward = fmin(x + GRADIENT_STEP, relaxation->upper[index]);
+    double backward = fmax(x - GRADIENT_STEP, relaxation->lower[index]);
+
+    if (forward == backward) {
+        relaxation->gradient[index] = 0;
+        return;
+    }
+    component->value = exp(forward);
+    double forward_cost = flat_filter_cost(filter, relaxation->target);
+    component->value = exp(backward);
+    double backward_cost = flat_filter_cost(filter, relaxation->target);
+    component->value = exp(x);
+    relaxation->gradient[index] = (forward_cost - backward_cost) / (forward - backward);
+}
+
+static void relaxed_gradient(Relaxation *relaxation, double *gradient) {
+    for (size_t i = 0; i < relaxation->variable_count; i++) {
+        set_log_values(&relaxation->task_filters[i], relaxation, relaxation->point);
+    }
+    relaxation->gradient = gradient;
+    parallel_for(relaxation->variable_count, gradient_term, relaxation);
+    relaxation->evaluations += 2 * relaxation->variable_count;
+}
+
+/* A variable is held when it sits on a bound and descent would push it outside. */
+static bool is_held(const Relaxation *relaxation, const double *gradient, size_t i) {
+    double x = relaxation->point[i];
+    return
+        (x <= relaxation->lower[i] && gradient[i] > 0) ||
+        (x >= relaxation->upper[i] && gradient[i] < 0);
+}
+
+static double projected_gradient_norm(const Relaxation *relaxation, const double *gradient) {
+    double norm = 0;
+    for (size_t i = 0; i < relaxation->variable_count; i++) {
+        if (!is_held(relaxation, gradient, i)) {
+            norm = fmax(norm, fabs(gradient[i]));
+        }
+    }
+    return norm;
+}
+
+static void reset_inverse_hessian(double *inverse_hessian, size_t n) {
+    for (size_t i = 0; i < n * n; i++) {
+        inverse_hessian[i] = i % (n + 1) == 0 ? 1.0 : 0.0;
+    }
+}
+
+/*
+ * Fills direction with -H g over the free variables, leaving held ones at
+ * zero, and returns its slope g . direction.
+ */
+static double search_direction(
+    const Relaxation *relaxation, 
+    const double *inverse_hessian, 
+    const double *gradient, 
+    double *direction
+) {
+    size_t n = relaxation->variable_count;
+    double slope = 0;
+    for (size_t i = 0; i < n; i++) {
+        direction[i] = 0;
+        if (is_held(relaxation, gradient, i)) {
+            continue;
+        }
+        for (size_t j = 0; j < n; j++) {
+            if (!is_held(relaxation, gradient, j)) {
+                direction[i] -= inverse_hessian[i * n + j] * gradient[j];
+            }
+        }
+        slope += direction[i] * gradient[i];
+    }
+    return slope;
+}
+
+/*
+ * Backtracks along the projected path point + t * direction until the cost
+ * decreases enough. On success next_point, step and *next_cost hold the
+ * accepted point.
+ */
+static bool projected_line_search(
+    Relaxation *relaxation, 
+    double cost, 
+    const double *gradient, 
+    const double *direction, 
+    double *next_point, 
+    double *step, 
+    double *next_cost
+) {
+    size_t n = relaxation->variable_count;
+    double longest = 0;
+    for (size_t i = 0; i < n; i++) {
+        longest = fmax(longest, fabs(direction[i]));
+    }
+    double length = longest > MAX_LOG_STEP ? MAX_LOG_STEP / longest : 1.0;
+
+    for (size_t backtrack = 0; backtrack < MAX_BACKTRACKS; backtrack++, length /= 2) {
+        double decrease = 0;
+        for (size_t i = 0; i < n; i++) {
+            next_point[i] = clamp(
+                relaxation->point[i] + length * direction[i], 
+                relaxation->lower[i], 
+                relaxation->upper[i]
+            );
+            step[i] = next_point[i] - relaxation->point[i];
+            decrease += gradient[i] * step[i];
+        }
+        *next_cost = relaxed_cost(relaxation, next_point);
+        if (*next_cost < cost && *next_cost <= cost + ARMIJO_FRACTION * decrease) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* BFGS update of the inverse Hessian, skipped when the curvature condition fails. */
+static void update_inverse_hessian(
+    double *inverse_hessian, 
+    size_t n, 
+    const double *step, 
+    const double *change, 
+    double *hessian_change
+) {
+    double curvature = 0;
+    for (size_t i = 0; i < n; i++) {
+        curvature += step[i] * change[i];
+    }
+    if (!(curvature > MIN_CURVATURE)) {
+        return;
+    }
+
+    double weighted_change = 0;
+    for (size_t i = 0; i < n; i++) {
+        hessian_change[i] = 0;
+        for (size_t j = 0; j < n; j++) {
+            hessian_change[i] += inverse_hessian[i * n + j] * change[j];
+        }
+        weighted_change += change[i] * hessian_change[i];
+    }
+    double scale = (1 + weighted_change / curvature) / curvature;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            inverse_hessian[i * n + j] += 
+                scale * step[i] * step[j] - 
+                (hessian_change[i] * step[j] + step[i] * hessian_change[j]) / curvature;
+        }
+    }
+}
+
+/* Runs projected BFGS from the current point and returns the final cost. */
+static double minimize_relaxed_cost(Relaxation *relaxation, size_t max_iterations, size_t *iterations) {
+    size_t n = relaxation->variable_count;
+    double *inverse_hessian = scm_gc_malloc_pointerless((n * n + 1) * sizeof(double), "inverse hessian");
+    double *gradient = scm_gc_malloc_pointerless((n + 1) * sizeof(double), "relaxed gradient");
+    double *next_gradient = scm_gc_malloc_pointerless((n + 1) * sizeof(double), "relaxed gradient");
+    double *direction = scm_gc_malloc_pointerless((n + 1) * sizeof(double), "search direction");
+    double *next_point = scm_gc_malloc_pointerless((n + 1) * sizeof(double), "relaxed point");
+    double *step = scm_gc_malloc_pointerless((n + 1) * sizeof(double), "relaxed step");
+    double *change = scm_gc_malloc_pointerless((n + 1) * sizeof(double), "gradient change");
+    double *hessian_change = scm_gc_malloc_pointerless((n + 1) * sizeof(double), "hessian change");
+
+    reset_inverse_hessian(inverse_hessian, n);
+    double cost = relaxed_cost(relaxation, relaxation->point);
+    relaxed_gradient(relaxation, gradient);
+
+    *iterations = 0;
+    while (*iterations < max_iterations && isfinite(cost)) {
+        if (projected_gradient_norm(relaxation, gradient) < GRADIENT_TOLERANCE) {
+            break;
+        }
+        (*iterations)++;
+
+        /* When the quasi-Newton step fails, retry once from steepest descent. */
+        double next_cost;
+        bool accepted = false;
+        for (int attempt = 0; attempt < 2 && !accepted; attempt++) {
+            if (!(search_direction(relaxation, inverse_hessian, gradient, direction) < 0)) {
+                if (attempt > 0) {
+                    break;
+                }
+                reset_inverse_hessian(inverse_hessian, n);
+                search_direction(relaxation, inverse_hessian, gradient, direction);
+            }
+            accepted = projected_line_search(
+                relaxation, cost, gradient, direction, next_point, step, &next_cost
+            );
+            if (!accepted) {
+                reset_inverse_hessian(inverse_hessian, n);
+            }
+        }
+        if (!accepted) {
+            break;
+        }
+
+        memcpy(relaxation->point, next_point, n * sizeof(double));
+        cost = next_cost;
+        relaxed_gradient(relaxation, next_gradient);
+        for (size_t i = 0; i < n; i++) {
+            change[i] = next_gradient[i] - gradient[i];
+        }
+        update_inverse_hessian(inverse_hessian, n, step, change, hessian_change);
+        memcpy(gradient, next_gradient, n * sizeof(double));
+    }
+
+    set_log_values(relaxation->filter, relaxation, relaxation->point);
+    return cost;
+}
+
+/* Snaps every relaxed value to its nearest preferred rank within the limits. */
+static void snap_relaxed_values(Relaxation *relaxation) {
+    for (size_t i = 0; i < relaxation->variable_count; i++) {
+        FlatComponent *component = &relaxation->filter->components[relaxation->variables[i]];
+        int rank = nearest_preferred_value_rank(exp(relaxation->point[i]));
+        rank = rank < component->lower_rank ? component->lower_rank : rank;
+        rank = rank > component->upper_rank ? component->upper_rank : rank;
+        set_flat_component_rank(component, rank);
+    }
+}
+
+/* Follows the cheapest improving rank move until none within the radius helps. */
+static double refine_snapped_values(Relaxation *relaxation, int radius) {
+    FlatFilter *filter = relaxation->filter;
+    double cost = flat_filter_cost(filter, relaxation->target);
+    relaxation->evaluations++;
+
+    for (size_t moves_made = 0; moves_made < MAX_REFINEMENT_MOVES; moves_made++) {
+        NeighborMove *moves;
+        size_t move_count = scan_neighborhood(filter, relaxation->target, radius, &moves);
+        relaxation->evaluations += move_count;
+
+        const NeighborMove *best = NULL;
+        for (size_t i = 0; i < move_count && best == NULL; i++) {
+            if (!moves[i].toggles_connection) {
+                best = &moves[i];
+            }
+        }
+        if (best == NULL || !(best->cost < cost)) {
+            break;
+        }
+
+        /* Scanned costs are reassociated, so confirm the move with a full evaluation. */
+        int previous_rank = filter->components[best->component].rank;
+        apply_neighbor_move(filter, best);
+        double next_cost = flat_filter_cost(filter, relaxation->target);
+        relaxation->evaluations++;
+        if (!(next_cost < cost)) {
+            set_flat_component_rank(&filter->components[best->component], previous_rank);
+            break;
+        }
+        cost = next_cost;
+    }
+    return cost;
+}
+
+/*
+ * Optimizes the component values of stages in place and returns an alist of
+ * the final cost, the cost reached by the continuous phase, the number of
+ * quasi-Newton iterations and the number of filter evaluations.
+ */
+SCM relax_filter_values(SCM stages, SCM target, SCM iterations, SCM radius) {
+    size_t max_iterations =
+        SCM_UNBNDP(iterations) ? DEFAULT_RELAXATION_ITERATIONS : scm_to_size_t(iterations);
+    int refinement_radius = SCM_UNBNDP(radius) ? DEFAULT_REFINEMENT_RADIUS : scm_to_int(radius);
+    if (refinement_radius < 1) {
+        scm_out_of_range("relax-filter-values", radius);
+    }
+
+    Relaxation relaxation;
+    relaxation.filter = compile_filter(stages);
+    relaxation.target = get_response_target(target);
+    relaxation.evaluations = 0;
+
+    FlatFilter *filter = relaxation.filter;
+    size_t n = 0;
+    relaxation.variables = scm_gc_malloc_pointerless(
+        (filter->component_count + 1) * sizeof(size_t), "relaxed variables"
+    );
+    for (size_t i = 0; i < filter->component_count; i++) {
+        if (filter->components[i].is_connected) {
+            relaxation.variables[n++] = i;
+        }
+    }
+    relaxation.variable_count = n;
+    relaxation.lower = scm_gc_malloc_pointerless((n + 1) * sizeof(double), "relaxed lower bounds");
+    relaxation.upper = scm_gc_malloc_pointerless((n + 1) * sizeof(double), "relaxed upper bounds");
+    relaxation.point = scm_gc_malloc_pointerless((n + 1) * sizeof(double), "relaxed point");
+    for (size_t i = 0; i < n; i++) {
+        const FlatComponent *component = &filter->components[relaxation.variables[i]];
+        relaxation.lower[i] = log(preferred_value_from_rank(component->lower_rank));
+        relaxation.upper[i] = log(preferred_value_from_rank(component->upper_rank));
+        relaxation.point[i] = clamp(log(component->value), relaxation.lower[i], relaxation.upper[i]);
+    }
+
+    /* Each gradient task perturbs its own copy of the components. */
+    relaxation.task_filters = scm_gc_malloc((n + 1) * sizeof(FlatFilter), "gradient filters");
+    for (size_t i = 0; i < n; i++) {
+        relaxation.task_filters[i] = *filter;
+        relaxation.task_filters[i].components = scm_gc_malloc_pointerless(
+            (filter->component_count + 1) * sizeof(FlatComponent), "gradient components"
+        );
+        memcpy(
+            relaxation.task_filters[i].components,
+            filter->components,
+            filter->component_count * sizeof(FlatComponent)
+        );
+    }
+
+    size_t iteration_count = 0;
+    TRACE_BEGIN("relax");
+    double continuous_cost = n == 0 ?
+        flat_filter_cost(filter, relaxation.target) :
+        minimize_relaxed_cost(&relaxation, max_iterations, &iteration_count);
+    TRACE_END("relax");
+
+    TRACE_BEGIN("refine");
+    snap_relaxed_values(&relaxation);
+    double cost = refine_snapped_values(&relaxation, refinement_radius);
+    TRACE_END("refine");
+
+    store_flat_filter_state(filter, stages);
+    scm_remember_upto_here_1(target);
+    return scm_list_4(
+        scm_cons(scm_from_utf8_symbol("cost"), scm_from_double(cost)),
+        scm_cons(scm_from_utf8_symbol("continuous-cost"), scm_from_double(continuous_cost)),
+        scm_cons(scm_from_utf8_symbol("iterations"), scm_from_size_t(iteration_count)),
+        scm_cons(scm_from_utf8_symbol("evaluations"), scm_from_size_t(relaxation.evaluations))
+    );
+}
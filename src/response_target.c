@@ -0,0 +1,118 @@
+#include <complex.h>
+#include <math.h>
+#include <libguile.h>
+
+#include "filter.h"
+#include "flat_filter.h"
+#include "response_target.h"
+#include "trace.h"
+#include "two_port_network.h"
+
+SCM response_target_type;
+
+SCM make_response_target(SCM angular_frequencies, SCM magnitudes, SCM weights);
+SCM scm_filter_cost(SCM stages, SCM target);
+
+void init_response_target_type(void) {
+    SCM name, slots;
+    scm_t_struct_finalize finalizer;
+
+    name = scm_from_utf8_symbol("response-target");
+    slots = scm_list_1(scm_from_utf8_symbol("target"));
+    finalizer = NULL;
+    response_target_type = scm_make_foreign_object_type(name, slots, finalizer);
+
+    __extension__
+    scm_c_define_gsubr("make-response-target", 2, 1, 0, (scm_t_subr) make_response_target);
+    __extension__
+    scm_c_define_gsubr("filter-cost", 2, 0, 0, (scm_t_subr) scm_filter_cost);
+}
+
+SCM make_response_target(SCM angular_frequencies, SCM magnitudes, SCM weights) {
+    SCM_ASSERT_TYPE(
+        scm_is_vector(angular_frequencies), 
+        angular_frequencies, 
+        SCM_ARG1, 
+        "make-response-target", 
+        "Vector of angular frequencies");
+    SCM_ASSERT_TYPE(
+        scm_is_vector(magnitudes) && 
+            SCM_SIMPLE_VECTOR_LENGTH(magnitudes) == SCM_SIMPLE_VECTOR_LENGTH(angular_frequencies), 
+        magnitudes, 
+        SCM_ARG2, 
+        "make-response-target", 
+        "Vector of target gain magnitudes, one per frequency");
+    SCM_ASSERT_TYPE(
+        SCM_UNBNDP(weights) || (scm_is_vector(weights) && 
+            SCM_SIMPLE_VECTOR_LENGTH(weights) == SCM_SIMPLE_VECTOR_LENGTH(angular_frequencies)), 
+        weights, 
+        SCM_ARG3, 
+        "make-response-target", 
+        "Vector of weights, one per frequency");
+
+    size_t count = SCM_SIMPLE_VECTOR_LENGTH(angular_frequencies);
+    ResponseTarget *target = scm_gc_malloc(sizeof(ResponseTarget), "response target");
+    target->count = count;
+    target->angular_frequencies = scm_gc_malloc_pointerless(
+        count * sizeof(double), "target frequencies"
+    );
+    target->magnitudes = scm_gc_malloc_pointerless(count * sizeof(double), "target magnitudes");
+    target->weights = scm_gc_malloc_pointerless(count * sizeof(double), "target weights");
+    target->total_weight = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        target->angular_frequencies[i] = 
+            scm_to_double(SCM_SIMPLE_VECTOR_REF(angular_frequencies, i));
+        target->magnitudes[i] = scm_to_double(SCM_SIMPLE_VECTOR_REF(magnitudes, i));
+        target->weights[i] = 
+            SCM_UNBNDP(weights) ? 1.0 : scm_to_double(SCM_SIMPLE_VECTOR_REF(weights, i));
+        target->total_weight += target->weights[i];
+    }
+    return scm_make_foreign_object_1(response_target_type, target);
+}
+
+ResponseTarget *get_response_target(SCM target) {
+    scm_assert_foreign_object_type(response_target_type, target);
+    return scm_foreign_object_ref(target, 0);
+}
+
+/* Weighted squared error, in dB, of one point of the response. */
+double response_point_error(const ResponseTarget *target, size_t point, double complex gain) {
+    double error_db = 20.0 * log10(cabs(gain) / target->magnitudes[point]);
+    return target->weights[point] * error_db * error_db;
+}
+
+/* Weighted mean squared dB error of gains sampled at the target frequencies. */
+double response_error(const ResponseTarget *target, const double complex *gains) {
+    double error = 0;
+    for (size_t i = 0; i < target->count; i++) {
+        error += response_point_error(target, i, gains[i]);
+    }
+    return error / target->total_weight;
+}
+
+double flat_filter_cost(const FlatFilter *filter, const ResponseTarget *target) {
+    double error = 0;
+    for (size_t i = 0; i < target->count; i++) {
+        double complex gain = flat_filter_voltage_gain(target->angular_frequencies[i], filter);
+        error += response_point_error(target, i, gain);
+    }
+    return error / target->total_weight;
+}
+
+double filter_cost(SCM stages, const ResponseTarget *target) {
+    double error = 0;
+    for (size_t i = 0; i < target->count; i++) {
+        TwoPortNetwork network;
+        get_filter_network(&network, target->angular_frequencies[i], stages);
+        error += response_point_error(target, i, network_voltage_gain(&network));
+    }
+    return error / target->total_weight;
+}
+
+SCM scm_filter_cost(SCM stages, SCM target) {
+    TRACE_SCOPE_BEGIN("evaluate");
+    double cost = filter_cost(stages, get_response_target(target));
+    TRACE_SCOPE_END();
+    return scm_from_double(cost);
+}
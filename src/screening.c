@@ -0,0 +1,358 @@
+#include <complex.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <libguile.h>
+
+#include "batch_sweep.h"
+#include "flat_filter.h"
+#include "response_target.h"
+#include "screening.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "two_port_network.h"
+
+/*
+ * Screening scores every candidate with single-precision kernels, which
+ * halve the memory traffic and double the SIMD width of the double ones,
+ * and only passes the candidates that might meet the threshold to the
+ * double-precision SCM path (get_filter_network). Accepted costs therefore
+ * come from exactly the same code as filter-cost.
+ *
+ * Alongside every single-precision impedance and network element the
+ * kernels carry a running bound on its distance from the exact value,
+ * grown at each operation by the propagated input bounds plus one
+ * rounding of the computed result. At the end each gain therefore comes
+ * with a relative error bound, which turns into a bound on its dB error
+ * and so a lower bound on the exact cost. A candidate is only rejected
+ * when that lower bound exceeds the threshold; where the bound blows up
+ * (cancellation at a notch, overflow, values outside the float range) the
+ * candidate is passed to the double-precision path.
+ */
+
+#define SCREENING_BLOCK 64
+#define MAX_SCREENING_DEPTH 64
+#define DEFAULT_SCREENING_MARGIN 1e-9
+
+/*
+ * Relative rounding errors of the float operations, each a generous
+ * multiple of the unit roundoff FLT_EPSILON / 2: a sum or conversion,
+ * a complex product plus a sum (a dot-product term), and a complex
+ * reciprocal (divisions go through the scaled library routine).
+ */
+#define SUM_ROUNDING FLT_EPSILON
+#define PRODUCT_ROUNDING (2 * FLT_EPSILON)
+#define RECIPROCAL_ROUNDING (4 * FLT_EPSILON)
+
+typedef struct {
+    FlatFilter **filters;
+    const ResponseTarget *target;
+    double *costs;
+} Screening;
+
+/* Elementwise bounds on the error of a SinglePrecisionNetwork. */
+typedef struct {
+    float element11;
+    float element12;
+    float element21;
+    float element22;
+} NetworkErrorBound;
+
+SCM screen_filters(SCM filters, SCM target, SCM threshold, SCM margin);
+
+void init_screening(void) {
+    __extension__
+    scm_c_define_gsubr("screen-filters", 3, 1, 0, (scm_t_subr) screen_filters);
+}
+
+/*
+ * Reciprocal of a value known to within error_bound, and the bound on the
+ * reciprocal: |1/x - 1/y| <= e / (|x| (|x| - e)) when |x - y| <= e < |x|.
+ */
+static float complex bounded_reciprocal(float complex value, float error_bound, float *reciprocal_bound) {
+    float complex reciprocal = 1.0f / value;
+    float size = cabsf(value);
+    if (!(error_bound < size)) {
+        *reciprocal_bound = INFINITY;
+    }
+    else {
+        *reciprocal_bound = 
+            error_bound / (size * (size - error_bound)) + RECIPROCAL_ROUNDING * cabsf(reciprocal);
+    }
+    return reciprocal;
+}
+
+static float complex component_impedance_f(
+    float complex angular_term, 
+    const FlatComponent *component, 
+    float *error_bound
+) {
+    if (!component->is_connected) {
+        *error_bound = 0;
+        return INFINITY;
+    }
+
+    float value = (float) component->value;
+    if (!isnormal(value)) {
+        *error_bound = INFINITY;
+        return value;
+    }
+    float complex impedance;
+    float relative_error;
+    switch (component->kind) {
+        case RESISTOR_COMPONENT:
+            impedance = value;
+            relative_error = SUM_ROUNDING;
+            break;
+        case CAPACITOR_COMPONENT:
+            impedance = 1.0f / (angular_term * value);
+            relative_error = 3 * SUM_ROUNDING + PRODUCT_ROUNDING + RECIPROCAL_ROUNDING;
+            break;
+        case INDUCTOR_COMPONENT:
+            impedance = angular_term * value;
+            relative_error = 3 * SUM_ROUNDING;
+            break;
+        default:
+            *error_bound = INFINITY;
+            return NAN;
+    }
+    *error_bound = relative_error * cabsf(impedance);
+    return impedance;
+}
+
+static void block_node_impedances_f(
+    const FlatFilter *filter, 
+    size_t *node_index, 
+    const float complex *angular_terms, 
+    size_t count, 
+    float complex (*scratch)[SCREENING_BLOCK], 
+    float (*bounds)[SCREENING_BLOCK], 
+    size_t depth
+) {
+    const FlatNode *node = &filter->nodes[(*node_index)++];
+    float complex *impedances = scratch[depth];
+    float *impedance_bounds = bounds[depth];
+
+    if (node->kind == COMPONENT_NODE) {
+        const FlatComponent *component = &filter->components[node->operand];
+        for (size_t f = 0; f < count; f++) {
+            impedances[f] = component_impedance_f(angular_terms[f], component, &impedance_bounds[f]);
+        }
+        return;
+    }
+
+    for (size_t f = 0; f < count; f++) {
+        impedances[f] = 0;
+        impedance_bounds[f] = 0;
+    }
+    float complex *child = scratch[depth + 1];
+    float *child_bounds = bounds[depth + 1];
+    for (size_t i = 0; i < node->operand; i++) {
+        block_node_impedances_f(filter, node_index, angular_terms, count, scratch, bounds, depth + 1);
+        if (node->kind == SERIES_NODE) {
+            for (size_t f = 0; f < count; f++) {
+                impedances[f] += child[f];
+                impedance_bounds[f] += child_bounds[f] + SUM_ROUNDING * cabsf(impedances[f]);
+            }
+        }
+        else {
+            for (size_t f = 0; f < count; f++) {
+                float admittance_bound;
+                impedances[f] += bounded_reciprocal(child[f], child_bounds[f], &admittance_bound);
+                impedance_bounds[f] += admittance_bound + SUM_ROUNDING * cabsf(impedances[f]);
+            }
+        }
+    }
+    if (node->kind == PARALLEL_NODE) {
+        for (size_t f = 0; f < count; f++) {
+            impedances[f] = bounded_reciprocal(impedances[f], impedance_bounds[f], &impedance_bounds[f]);
+        }
+    }
+}
+
+/*
+ * One element of a bounded 2x2 product: the propagated input errors,
+ * their product, and one rounding of each product term.
+ */
+static float product_element_bound(
+    float complex left1, float left_bound1, 
+    float complex right1, float right_bound1, 
+    float complex left2, float left_bound2, 
+    float complex right2, float right_bound2
+) {
+    float left_size1 = cabsf(left1);
+    float right_size1 = cabsf(right1);
+    float left_size2 = cabsf(left2);
+    float right_size2 = cabsf(right2);
+    return left_bound1 * right_size1 + left_size1 * right_bound1 + left_bound1 * right_bound1 
+        + left_bound2 * right_size2 + left_size2 * right_bound2 + left_bound2 * right_bound2 
+        + PRODUCT_ROUNDING * (left_size1 * right_size1 + left_size2 * right_size2);
+}
+
+/* Bounds the error of network * stage, computed before the product is formed. */
+static void cascade_error_bound(
+    NetworkErrorBound *result, 
+    const SinglePrecisionNetwork *network, 
+    const NetworkErrorBound *bound, 
+    const SinglePrecisionNetwork *stage, 
+    const NetworkErrorBound *stage_bound
+) {
+    NetworkErrorBound product;
+    product.element11 = product_element_bound(
+        network->element11, bound->element11, stage->element11, stage_bound->element11, 
+        network->element12, bound->element12, stage->element21, stage_bound->element21
+    );
+    product.element12 = product_element_bound(
+        network->element11, bound->element11, stage->element12, stage_bound->element12, 
+        network->element12, bound->element12, stage->element22, stage_bound->element22
+    );
+    product.element21 = product_element_bound(
+        network->element21, bound->element21, stage->element11, stage_bound->element11, 
+        network->element22, bound->element22, stage->element21, stage_bound->element21
+    );
+    product.element22 = product_element_bound(
+        network->element21, bound->element21, stage->element12, stage_bound->element12, 
+        network->element22, bound->element22, stage->element22, stage_bound->element22
+    );
+    *result = product;
+}
+
+/*
+ * Lower bound on a point's contribution to the exact cost, given the
+ * single-precision gain and a bound on its error. Zero when the bound is
+ * too loose to say anything.
+ */
+static double point_error_lower_bound(
+    const ResponseTarget *target, 
+    size_t point, 
+    float complex gain, 
+    float error_bound
+) {
+    double size = cabsf(gain);
+    double relative_error = error_bound / size;
+    if (!(relative_error < 1) || !isfinite(size)) {
+        return 0;
+    }
+    /* |log(1 - d)| >= |log(1 + d)|, so this bounds the dB error either way. */
+    double db_error_bound = -20.0 * log10(1 - relative_error);
+    double error_db = fabs(20.0 * log10(size / target->magnitudes[point]));
+    double lower_db = error_db > db_error_bound ? error_db - db_error_bound : 0;
+    return target->weights[point] * lower_db * lower_db;
+}
+
+static size_t load_depth(const FlatFilter *filter, size_t *node_index) {
+    const FlatNode *node = &filter->nodes[(*node_index)++];
+    size_t depth = 0;
+    if (node->kind != COMPONENT_NODE) {
+        for (size_t i = 0; i < node->operand; i++) {
+            size_t child_depth = load_depth(filter, node_index);
+            depth = child_depth > depth ? child_depth : depth;
+        }
+    }
+    return depth + 1;
+}
+
+/*
+ * Lower bound on the exact cost from single-precision kernels. Returns
+ * zero when a load is nested too deeply for the fixed scratch space, so
+ * that the candidate is handed to the double-precision path rather than
+ * rejected.
+ */
+double single_precision_cost_bound(const FlatFilter *filter, const ResponseTarget *target) {
+    for (size_t i = 0; i < filter->stage_count; i++) {
+        size_t node_index = filter->stages[i].first_node;
+        if (load_depth(filter, &node_index) >= MAX_SCREENING_DEPTH) {
+            return 0;
+        }
+    }
+
+    float complex scratch[MAX_SCREENING_DEPTH][SCREENING_BLOCK];
+    float bounds[MAX_SCREENING_DEPTH][SCREENING_BLOCK];
+    float complex angular_terms[SCREENING_BLOCK];
+    SinglePrecisionNetwork networks[SCREENING_BLOCK];
+    NetworkErrorBound network_bounds[SCREENING_BLOCK];
+    double error = 0;
+
+    for (size_t first = 0; first < target->count; first += SCREENING_BLOCK) {
+        size_t count = target->count - first < SCREENING_BLOCK ? 
+            target->count - first : SCREENING_BLOCK;
+        for (size_t f = 0; f < count; f++) {
+            angular_terms[f] = I * (float) target->angular_frequencies[first + f];
+            identity_network_f(&networks[f]);
+            network_bounds[f] = (NetworkErrorBound) {0, 0, 0, 0};
+        }
+
+        for (size_t i = 0; i < filter->stage_count; i++) {
+            size_t node_index = filter->stages[i].first_node;
+            block_node_impedances_f(filter, &node_index, angular_terms, count, scratch, bounds, 0);
+            for (size_t f = 0; f < count; f++) {
+                SinglePrecisionNetwork work_area;
+                NetworkErrorBound stage_bound = {0, 0, 0, 0};
+                if (filter->stages[i].kind == SERIES_STAGE) {
+                    series_connected_network_f(&work_area, scratch[0][f]);
+                    stage_bound.element12 = bounds[0][f];
+                }
+                else {
+                    shunt_connected_network_f(&work_area, scratch[0][f]);
+                    bounded_reciprocal(scratch[0][f], bounds[0][f], &stage_bound.element21);
+                }
+                cascade_error_bound(
+                    &network_bounds[f], &networks[f], &network_bounds[f], &work_area, &stage_bound
+                );
+                cascade_network_f(&networks[f], &networks[f], &work_area);
+            }
+        }
+
+        for (size_t f = 0; f < count; f++) {
+            error += point_error_lower_bound(
+                target, first + f, network_voltage_gain_f(&networks[f]), network_bounds[f].element11
+            );
+        }
+    }
+    return error / target->total_weight;
+}
+
+static void screen_filter(size_t index, void *context) {
+    Screening *screening = context;
+    screening->costs[index] = 
+        single_precision_cost_bound(screening->filters[index], screening->target);
+}
+
+/*
+ * Returns a vector holding, for each filter, its double-precision cost if it
+ * survived screening and #f if single precision already rejected it.
+ * A candidate is rejected only when the lower bound on its exact cost
+ * exceeds threshold * (1 + margin); the relative margin covers the
+ * rounding of the double-precision path itself.
+ */
+SCM screen_filters(SCM filters, SCM target, SCM threshold, SCM margin) {
+    FlatFilter **flat_filters = compile_filters(filters, SCM_ARG1, "screen-filters");
+    size_t filter_count = SCM_SIMPLE_VECTOR_LENGTH(filters);
+    double threshold_cost = scm_to_double(threshold);
+    double margin_fraction = SCM_UNBNDP(margin) ? DEFAULT_SCREENING_MARGIN : scm_to_double(margin);
+
+    Screening screening;
+    screening.filters = flat_filters;
+    screening.target = get_response_target(target);
+    screening.costs = scm_gc_malloc_pointerless(
+        (filter_count + 1) * sizeof(double), "screening costs"
+    );
+    TRACE_BEGIN("screen");
+    parallel_for(filter_count, screen_filter, &screening);
+    TRACE_END("screen");
+
+    double cutoff = threshold_cost * (1 + margin_fraction);
+    SCM costs = scm_c_make_vector(filter_count, SCM_BOOL_F);
+    for (size_t i = 0; i < filter_count; i++) {
+        if (!(screening.costs[i] > cutoff)) {
+            SCM stages = SCM_SIMPLE_VECTOR_REF(filters, i);
+            TRACE_BEGIN("evaluate");
+            double cost = filter_cost(stages, screening.target);
+            TRACE_END("evaluate");
+            SCM_SIMPLE_VECTOR_SET(costs, i, scm_from_double(cost));
+        }
+    }
+    scm_remember_upto_here_1(target);
+    return costs;
+}
@@ -0,0 +1,298 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <libguile.h>
+
+#include "component.h"
+#include "filter.h"
+#include "flat_filter.h"
+#include "hash.h"
+#include "load.h"
+#include "preferred_value.h"
+#include "state_cache.h"
+
+/*
+ * A bounded open-addressing table from the 64-bit hash of a candidate's
+ * discrete state (structure, value ranks and connection flags) to its cost.
+ * Keys are the hashes alone, so two states that collide share an entry.
+ *
+ * When full, entries are evicted by the CLOCK policy: the hand clears the
+ * referenced bit of entries hit since its last pass and evicts the first
+ * unreferenced one. Entries visited within the last tabu-window visits are
+ * tabu and are not evicted while another victim exists.
+ */
+
+#define MAX_LOAD_PERCENT 75
+
+typedef struct {
+    uint64_t key;
+    double cost;
+    uint64_t last_visit;
+    bool is_occupied;
+    bool is_referenced;
+} StateEntry;
+
+typedef struct {
+    StateEntry *entries;
+    size_t capacity;
+    size_t max_count;
+    size_t count;
+    size_t clock_hand;
+    uint64_t visits;
+    uint64_t tabu_window;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} StateCache;
+
+SCM state_cache_type;
+
+SCM make_state_cache(SCM max_entries, SCM tabu_window);
+SCM state_cache_lookup(SCM cache, SCM stages);
+SCM state_cache_insert(SCM cache, SCM stages, SCM cost);
+SCM state_cache_tabu_p(SCM cache, SCM stages);
+SCM state_cache_statistics(SCM cache);
+SCM scm_filter_state_hash(SCM stages);
+void finalize_state_cache(SCM cache);
+
+void init_state_cache_type(void) {
+    SCM name, slots;
+
+    name = scm_from_utf8_symbol("state-cache");
+    slots = scm_list_1(scm_from_utf8_symbol("cache"));
+    state_cache_type = scm_make_foreign_object_type(name, slots, finalize_state_cache);
+
+    __extension__
+    scm_c_define_gsubr("make-state-cache", 1, 1, 0, (scm_t_subr) make_state_cache);
+    __extension__
+    scm_c_define_gsubr("state-cache-lookup", 2, 0, 0, (scm_t_subr) state_cache_lookup);
+    __extension__
+    scm_c_define_gsubr("state-cache-insert!", 3, 0, 0, (scm_t_subr) state_cache_insert);
+    __extension__
+    scm_c_define_gsubr("state-cache-tabu?", 2, 0, 0, (scm_t_subr) state_cache_tabu_p);
+    __extension__
+    scm_c_define_gsubr("state-cache-statistics", 1, 0, 0, (scm_t_subr) state_cache_statistics);
+    __extension__
+    scm_c_define_gsubr("filter-state-hash", 1, 0, 0, (scm_t_subr) scm_filter_state_hash);
+}
+
+static uint64_t hash_component_state(uint64_t hash, ComponentKind kind, int rank, bool is_connected) {
+    hash = hash_combine(hash, kind);
+    return hash_combine(hash, ((uint64_t) (uint32_t) rank << 1) | is_connected);
+}
+
+static uint64_t hash_load_state(uint64_t hash, SCM load) {
+    SCM type = get_load_type(load);
+    SCM elements = get_load_elements(load);
+
+    if (scm_is_eq(type, component_load_symbol)) {
+        hash = hash_combine(hash, COMPONENT_NODE);
+        return hash_component_state(
+            hash, 
+            component_kind(elements), 
+            preferred_component_value_rank(get_component_value(elements)), 
+            scm_is_true(get_component_is_connected(elements))
+        );
+    }
+
+    size_t child_count = SCM_SIMPLE_VECTOR_LENGTH(elements);
+    hash = hash_combine(hash, scm_is_eq(type, series_load_symbol) ? SERIES_NODE : PARALLEL_NODE);
+    hash = hash_combine(hash, child_count);
+    for (size_t i = 0; i < child_count; i++) {
+        hash = hash_load_state(hash, SCM_SIMPLE_VECTOR_REF(elements, i));
+    }
+    return hash;
+}
+
+uint64_t filter_state_hash(SCM stages) {
+    SCM_ASSERT_TYPE(
+        scm_is_vector(stages), 
+        stages, 
+        SCM_ARG1, 
+        "filter-state-hash", 
+        "Vector of filter stages");
+
+    uint64_t hash = 0;
+    for (size_t i = 0; i < SCM_SIMPLE_VECTOR_LENGTH(stages); i++) {
+        SCM stage = SCM_SIMPLE_VECTOR_REF(stages, i);
+        bool is_series = scm_is_eq(get_filter_stage_type(stage), series_filter_symbol);
+        hash = hash_combine(hash, is_series ? SERIES_STAGE : SHUNT_STAGE);
+        hash = hash_load_state(hash, get_filter_stage_load(stage));
+    }
+    return hash;
+}
+
+/* Equal to filter_state_hash of the stages the flat filter describes. */
+uint64_t flat_filter_state_hash(const FlatFilter *filter) {
+    uint64_t hash = 0;
+    for (size_t i = 0; i < filter->stage_count; i++) {
+        const FlatStage *stage = &filter->stages[i];
+        hash = hash_combine(hash, stage->kind);
+        for (size_t j = stage->first_node; j < stage->first_node + stage->node_count; j++) {
+            const FlatNode *node = &filter->nodes[j];
+            hash = hash_combine(hash, node->kind);
+            if (node->kind == COMPONENT_NODE) {
+                const FlatComponent *component = &filter->components[node->operand];
+                hash = hash_component_state(
+                    hash, component->kind, component->rank, component->is_connected
+                );
+            }
+            else {
+                hash = hash_combine(hash, node->operand);
+            }
+        }
+    }
+    return hash;
+}
+
+SCM scm_filter_state_hash(SCM stages) {
+    return scm_from_uint64(filter_state_hash(stages));
+}
+
+SCM make_state_cache(SCM max_entries, SCM tabu_window) {
+    size_t max_count = scm_to_size_t(max_entries);
+    if (max_count == 0) {
+        scm_out_of_range("make-state-cache", max_entries);
+    }
+
+    size_t capacity = 16;
+    while (capacity * MAX_LOAD_PERCENT / 100 < max_count) {
+        capacity *= 2;
+    }
+    StateEntry *entries = calloc(capacity, sizeof(StateEntry));
+    if (entries == NULL) {
+        scm_memory_error("make-state-cache");
+    }
+
+    StateCache *cache = scm_gc_malloc_pointerless(sizeof(StateCache), "state cache");
+    cache->entries = entries;
+    cache->capacity = capacity;
+    cache->max_count = max_count;
+    cache->count = 0;
+    cache->clock_hand = 0;
+    cache->visits = 0;
+    cache->tabu_window = SCM_UNBNDP(tabu_window) ? 0 : scm_to_uint64(tabu_window);
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+    return scm_make_foreign_object_1(state_cache_type, cache);
+}
+
+void finalize_state_cache(SCM cache_object) {
+    StateCache *cache = scm_foreign_object_ref(cache_object, 0);
+    free(cache->entries);
+}
+
+static StateCache *get_state_cache(SCM cache) {
+    scm_assert_foreign_object_type(state_cache_type, cache);
+    return scm_foreign_object_ref(cache, 0);
+}
+
+/* Slot holding key, or the empty slot where it would be inserted. */
+static size_t find_state_slot(const StateCache *cache, uint64_t key) {
+    size_t mask = cache->capacity - 1;
+    size_t slot = key & mask;
+    while (cache->entries[slot].is_occupied && cache->entries[slot].key != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static bool entry_is_tabu(const StateCache *cache, const StateEntry *entry) {
+    return cache->visits - entry->last_visit < cache->tabu_window;
+}
+
+static void remove_state_slot(StateCache *cache, size_t slot) {
+    size_t mask = cache->capacity - 1;
+    size_t next = slot;
+    for (;;) {
+        cache->entries[slot].is_occupied = false;
+        for (;;) {
+            next = (next + 1) & mask;
+            if (!cache->entries[next].is_occupied) {
+                cache->count--;
+                return;
+            }
+            size_t home = cache->entries[next].key & mask;
+            bool movable = slot <= next ? 
+                (home <= slot || home > next) : 
+                (home <= slot && home > next);
+            if (movable) {
+                break;
+            }
+        }
+        cache->entries[slot] = cache->entries[next];
+        slot = next;
+    }
+}
+
+static void evict_state(StateCache *cache) {
+    size_t mask = cache->capacity - 1;
+    /* Two sweeps clear every referenced bit; after that tabu entries go too. */
+    for (size_t step = 0; ; step++) {
+        StateEntry *entry = &cache->entries[cache->clock_hand];
+        if (entry->is_occupied) {
+            bool keep_tabu = step < 3 * cache->capacity && entry_is_tabu(cache, entry);
+            if (entry->is_referenced && step < 2 * cache->capacity) {
+                entry->is_referenced = false;
+            }
+            else if (!keep_tabu) {
+                remove_state_slot(cache, cache->clock_hand);
+                cache->evictions++;
+                return;
+            }
+        }
+        cache->clock_hand = (cache->clock_hand + 1) & mask;
+    }
+}
+
+SCM state_cache_lookup(SCM cache_object, SCM stages) {
+    StateCache *cache = get_state_cache(cache_object);
+    StateEntry *entry = &cache->entries[find_state_slot(cache, filter_state_hash(stages))];
+    if (!entry->is_occupied) {
+        cache->misses++;
+        return SCM_BOOL_F;
+    }
+    cache->hits++;
+    entry->is_referenced = true;
+    return scm_from_double(entry->cost);
+}
+
+/* Records the cost of stages and counts this as a visit for the tabu window. */
+SCM state_cache_insert(SCM cache_object, SCM stages, SCM cost) {
+    StateCache *cache = get_state_cache(cache_object);
+    uint64_t key = filter_state_hash(stages);
+    double state_cost = scm_to_double(cost);
+
+    size_t slot = find_state_slot(cache, key);
+    if (!cache->entries[slot].is_occupied) {
+        if (cache->count == cache->max_count) {
+            evict_state(cache);
+            slot = find_state_slot(cache, key);
+        }
+        cache->count++;
+    }
+    StateEntry *entry = &cache->entries[slot];
+    entry->key = key;
+    entry->cost = state_cost;
+    entry->last_visit = ++cache->visits;
+    entry->is_occupied = true;
+    entry->is_referenced = true;
+    return cost;
+}
+
+SCM state_cache_tabu_p(SCM cache_object, SCM stages) {
+    StateCache *cache = get_state_cache(cache_object);
+    StateEntry *entry = &cache->entries[find_state_slot(cache, filter_state_hash(stages))];
+    return scm_from_bool(entry->is_occupied && entry_is_tabu(cache, entry));
+}
+
+SCM state_cache_statistics(SCM cache_object) {
+    StateCache *cache = get_state_cache(cache_object);
+    return scm_list_4(
+        scm_cons(scm_from_utf8_symbol("size"), scm_from_size_t(cache->count)),
+        scm_cons(scm_from_utf8_symbol("hits"), scm_from_uint64(cache->hits)),
+        scm_cons(scm_from_utf8_symbol("misses"), scm_from_uint64(cache->misses)),
+        scm_cons(scm_from_utf8_symbol("evictions"), scm_from_uint64(cache->evictions))
+    );
+}
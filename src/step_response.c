@@ -0,0 +1,165 @@
+#include <complex.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <libguile.h>
+
+#include "batch_sweep.h"
+#include "fft.h"
+#include "flat_filter.h"
+#include "numeric_vector.h"
+#include "step_response.h"
+#include "trace.h"
+
+/*
+ * Time-domain responses from one frequency sweep. The filter is evaluated
+ * on the bins of a sample-count point DFT at the given sample rate, the
+ * Hermitian spectrum is inverted with the in-tree FFT to get the impulse
+ * response, and its running sum is the step response. The record must be
+ * long enough for the response to settle, since anything left over wraps
+ * around. Gains from the cascade are input over output voltage, so the
+ * transfer function is their reciprocal.
+ */
+
+#define DEFAULT_SETTLING_TOLERANCE 0.02
+#define RISE_START 0.1
+#define RISE_END 0.9
+/* The DC bin is evaluated just above zero, where reactances are finite. */
+#define DC_BIN_FRACTION 1e-6
+
+static const double TWO_PI = 6.28318530717958647692;
+
+SCM step_response(SCM stages, SCM sample_rate, SCM sample_count);
+SCM step_response_metrics(SCM stages, SCM sample_rate, SCM sample_count, SCM tolerance);
+
+void init_step_response(void) {
+    __extension__
+    scm_c_define_gsubr("step-response", 3, 0, 0, (scm_t_subr) step_response);
+    __extension__
+    scm_c_define_gsubr("step-response-metrics", 3, 1, 0, (scm_t_subr) step_response_metrics);
+}
+
+/* Fills steps with sample_count samples and returns the DC gain. */
+static double compute_step_response(
+    SCM stages, 
+    double rate, 
+    size_t count, 
+    double *steps, 
+    const char *subr
+) {
+    FlatFilter *filter = compile_filter(stages);
+    size_t bin_count = count / 2 + 1;
+    double *angular_frequencies = scm_gc_malloc_pointerless(bin_count * sizeof(double), "step bins");
+    double complex *gains = scm_gc_malloc_pointerless(bin_count * sizeof(double complex), "step gains");
+    double complex *spectrum = scm_gc_malloc_pointerless(count * sizeof(double complex), "step spectrum");
+
+    for (size_t k = 0; k < bin_count; k++) {
+        angular_frequencies[k] = TWO_PI * rate * (double) k / (double) count;
+    }
+    angular_frequencies[0] = DC_BIN_FRACTION * TWO_PI * rate / (double) count;
+
+    TRACE_BEGIN("evaluate");
+    batch_filter_gains(&filter, 1, angular_frequencies, bin_count, gains);
+    TRACE_END("evaluate");
+
+    for (size_t k = 0; k < bin_count; k++) {
+        spectrum[k] = 1.0 / gains[k];
+    }
+    spectrum[0] = creal(spectrum[0]);
+    if (count % 2 == 0) {
+        spectrum[count / 2] = creal(spectrum[count / 2]);
+    }
+    for (size_t k = bin_count; k < count; k++) {
+        spectrum[k] = conj(spectrum[count - k]);
+    }
+    if (!fft(spectrum, count, true)) {
+        scm_memory_error(subr);
+    }
+
+    double sum = 0;
+    for (size_t n = 0; n < count; n++) {
+        sum += creal(spectrum[n]) / (double) count;
+        steps[n] = sum;
+    }
+    return creal(1.0 / gains[0]);
+}
+
+static double read_sample_rate(SCM sample_rate, const char *subr) {
+    double rate = scm_to_double(sample_rate);
+    if (!(rate > 0) || isinf(rate)) {
+        scm_out_of_range(subr, sample_rate);
+    }
+    return rate;
+}
+
+static size_t read_sample_count(SCM sample_count, const char *subr) {
+    size_t count = scm_to_size_t(sample_count);
+    if (count < 2) {
+        scm_out_of_range(subr, sample_count);
+    }
+    return count;
+}
+
+SCM step_response(SCM stages, SCM sample_rate, SCM sample_count) {
+    double rate = read_sample_rate(sample_rate, "step-response");
+    size_t count = read_sample_count(sample_count, "step-response");
+    double *steps = scm_gc_malloc_pointerless(count * sizeof(double), "step response");
+    compute_step_response(stages, rate, count, steps, "step-response");
+    return real_vector_from_array(steps, count);
+}
+
+/* Time at which the normalized response first reaches level, or NaN. */
+static double crossing_time(const double *normalized, size_t count, double level, double rate) {
+    if (normalized[0] >= level) {
+        return 0;
+    }
+    for (size_t n = 1; n < count; n++) {
+        if (normalized[n] >= level) {
+            double fraction = (level - normalized[n - 1]) / (normalized[n] - normalized[n - 1]);
+            return ((double) (n - 1) + fraction) / rate;
+        }
+    }
+    return NAN;
+}
+
+/*
+ * Returns ((overshoot . fraction) (rise-time . seconds)
+ * (settling-time . seconds) (final-value . gain)). Overshoot and rise time
+ * (10% to 90%) are relative to the DC gain; settling time is when the
+ * response last leaves the band of tolerance (default 2%) around it.
+ */
+SCM step_response_metrics(SCM stages, SCM sample_rate, SCM sample_count, SCM tolerance) {
+    const char *subr = "step-response-metrics";
+    double rate = read_sample_rate(sample_rate, subr);
+    size_t count = read_sample_count(sample_count, subr);
+    double band = SCM_UNBNDP(tolerance) ? DEFAULT_SETTLING_TOLERANCE : scm_to_double(tolerance);
+    double *steps = scm_gc_malloc_pointerless(count * sizeof(double), "step response");
+    double final_value = compute_step_response(stages, rate, count, steps, subr);
+
+    double overshoot = NAN;
+    double rise_time = NAN;
+    double settling_time = NAN;
+    if (final_value != 0 && isfinite(final_value)) {
+        double peak = -INFINITY;
+        size_t last_outside = count;
+        for (size_t n = 0; n < count; n++) {
+            steps[n] /= final_value;
+            peak = steps[n] > peak ? steps[n] : peak;
+            if (fabs(steps[n] - 1) > band) {
+                last_outside = n;
+            }
+        }
+        overshoot = peak > 1 ? peak - 1 : 0;
+        rise_time = 
+            crossing_time(steps, count, RISE_END, rate) - 
+            crossing_time(steps, count, RISE_START, rate);
+        settling_time = last_outside == count ? 0 : (double) (last_outside + 1) / rate;
+    }
+
+    return scm_list_4(
+        scm_cons(scm_from_utf8_symbol("overshoot"), scm_from_double(overshoot)), 
+        scm_cons(scm_from_utf8_symbol("rise-time"), scm_from_double(rise_time)), 
+        scm_cons(scm_from_utf8_symbol("settling-time"), scm_from_double(settling_time)), 
+        scm_cons(scm_from_utf8_symbol("final-value"), scm_from_double(final_value))
+    );
+}
@@ -0,0 +1,270 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <libguile.h>
+
+#include "flat_filter.h"
+#include "response_target.h"
+#include "surrogate.h"
+#include "trace.h"
+
+/*
+ * An online ridge regression that predicts log(1 + cost) from a candidate's
+ * value ranks. Features per component are its rank offset from the
+ * template in decades, the square of that offset, and its connection flag,
+ * plus a bias. Training is recursive least squares: each evaluated
+ * candidate is one Sherman-Morrison update of the inverse Gram matrix, which
+ * starts as the identity over the ridge parameter, so the weights are always
+ * the exact ridge solution over everything seen so far.
+ *
+ * A candidate skips evaluation when its prediction, less confidence times
+ * the running RMS of the a-priori residuals, is still above the threshold.
+ * A fixed fraction of the skipped candidates is evaluated anyway to audit
+ * the skips: an audited skip that really was above the threshold is a hit,
+ * one that was not is a miss.
+ */
+
+#define RANKS_PER_DECADE 24.0
+#define DEFAULT_RIDGE 1.0
+#define DEFAULT_CONFIDENCE 2.0
+#define DEFAULT_AUDIT_RATE 0.05
+#define RESIDUAL_WINDOW 100
+
+typedef struct {
+    size_t component_count;
+    size_t feature_count;
+    int *reference_ranks;
+    double *weights;
+    double *inverse_gram;
+    double *features;
+    double *gain;
+    double confidence;
+    double audit_rate;
+    double residual_variance;
+    uint64_t trained;
+    uint64_t evaluated;
+    uint64_t skipped;
+    uint64_t audited;
+    uint64_t hits;
+    uint64_t misses;
+} Surrogate;
+
+SCM surrogate_type;
+
+SCM make_surrogate(SCM stages, SCM ridge, SCM confidence, SCM audit_rate);
+SCM surrogate_train(SCM surrogate, SCM stages, SCM cost);
+SCM surrogate_predict(SCM surrogate, SCM stages);
+SCM surrogate_filter_cost(SCM surrogate, SCM stages, SCM target, SCM threshold);
+SCM surrogate_statistics(SCM surrogate);
+
+void init_surrogate_type(void) {
+    SCM name, slots;
+    scm_t_struct_finalize finalizer;
+
+    name = scm_from_utf8_symbol("surrogate");
+    slots = scm_list_1(scm_from_utf8_symbol("model"));
+    finalizer = NULL;
+    surrogate_type = scm_make_foreign_object_type(name, slots, finalizer);
+
+    __extension__
+    scm_c_define_gsubr("make-surrogate", 1, 3, 0, (scm_t_subr) make_surrogate);
+    __extension__
+    scm_c_define_gsubr("surrogate-train!", 3, 0, 0, (scm_t_subr) surrogate_train);
+    __extension__
+    scm_c_define_gsubr("surrogate-predict", 2, 0, 0, (scm_t_subr) surrogate_predict);
+    __extension__
+    scm_c_define_gsubr("surrogate-filter-cost", 4, 0, 0, (scm_t_subr) surrogate_filter_cost);
+    __extension__
+    scm_c_define_gsubr("surrogate-statistics", 1, 0, 0, (scm_t_subr) surrogate_statistics);
+}
+
+SCM make_surrogate(SCM stages, SCM ridge, SCM confidence, SCM audit_rate) {
+    FlatFilter *filter = compile_filter(stages);
+    double ridge_parameter = SCM_UNBNDP(ridge) ? DEFAULT_RIDGE : scm_to_double(ridge);
+    if (!(ridge_parameter > 0)) {
+        scm_out_of_range("make-surrogate", ridge);
+    }
+
+    Surrogate *surrogate = scm_gc_malloc(sizeof(Surrogate), "surrogate");
+    size_t components = filter->component_count;
+    size_t features = 1 + 3 * components;
+    surrogate->component_count = components;
+    surrogate->feature_count = features;
+    surrogate->reference_ranks = scm_gc_malloc_pointerless(
+        (components + 1) * sizeof(int), "surrogate reference"
+    );
+    surrogate->weights = scm_gc_calloc(features * sizeof(double), "surrogate weights");
+    surrogate->inverse_gram = scm_gc_calloc(
+        features * features * sizeof(double), "surrogate inverse gram"
+    );
+    surrogate->features = scm_gc_malloc_pointerless(features * sizeof(double), "surrogate features");
+    surrogate->gain = scm_gc_malloc_pointerless(features * sizeof(double), "surrogate gain");
+    surrogate->confidence = SCM_UNBNDP(confidence) ? DEFAULT_CONFIDENCE : scm_to_double(confidence);
+    surrogate->audit_rate = SCM_UNBNDP(audit_rate) ? DEFAULT_AUDIT_RATE : scm_to_double(audit_rate);
+    if (!(surrogate->audit_rate >= 0 && surrogate->audit_rate <= 1)) {
+        scm_out_of_range("make-surrogate", audit_rate);
+    }
+    surrogate->residual_variance = 0;
+    surrogate->trained = 0;
+    surrogate->evaluated = 0;
+    surrogate->skipped = 0;
+    surrogate->audited = 0;
+    surrogate->hits = 0;
+    surrogate->misses = 0;
+
+    for (size_t i = 0; i < components; i++) {
+        surrogate->reference_ranks[i] = filter->components[i].rank;
+    }
+    for (size_t i = 0; i < features; i++) {
+        surrogate->inverse_gram[i * features + i] = 1.0 / ridge_parameter;
+    }
+    return scm_make_foreign_object_1(surrogate_type, surrogate);
+}
+
+static Surrogate *get_surrogate(SCM surrogate) {
+    scm_assert_foreign_object_type(surrogate_type, surrogate);
+    return scm_foreign_object_ref(surrogate, 0);
+}
+
+static void load_features(Surrogate *surrogate, SCM stages, const char *subr) {
+    FlatFilter *filter = compile_filter(stages);
+    if (filter->component_count != surrogate->component_count) {
+        scm_misc_error(subr, "Stages do not match the surrogate's topology.", SCM_EOL);
+    }
+
+    double *features = surrogate->features;
+    features[0] = 1;
+    for (size_t i = 0; i < filter->component_count; i++) {
+        const FlatComponent *component = &filter->components[i];
+        double offset = (component->rank - surrogate->reference_ranks[i]) / RANKS_PER_DECADE;
+        features[1 + 3 * i] = offset;
+        features[2 + 3 * i] = offset * offset;
+        features[3 + 3 * i] = component->is_connected;
+    }
+}
+
+static double predict_loaded(const Surrogate *surrogate) {
+    double prediction = 0;
+    for (size_t i = 0; i < surrogate->feature_count; i++) {
+        prediction += surrogate->weights[i] * surrogate->features[i];
+    }
+    return prediction;
+}
+
+/*
+ * One recursive least squares step on the loaded features. Non-finite
+ * costs (an open circuit where the output is needed, say) are not trained
+ * on: a single infinite residual would poison the weights, the inverse
+ * Gram matrix and the residual variance for good.
+ */
+static void train_loaded(Surrogate *surrogate, double cost) {
+    size_t n = surrogate->feature_count;
+    double *inverse_gram = surrogate->inverse_gram;
+    double *projection = surrogate->gain;
+    const double *features = surrogate->features;
+
+    double observation = log1p(cost);
+    if (!isfinite(observation)) {
+        return;
+    }
+    double residual = observation - predict_loaded(surrogate);
+    double denominator = 1;
+    for (size_t i = 0; i < n; i++) {
+        double sum = 0;
+        for (size_t j = 0; j < n; j++) {
+            sum += inverse_gram[i * n + j] * features[j];
+        }
+        projection[i] = sum;
+        denominator += features[i] * sum;
+    }
+    for (size_t i = 0; i < n; i++) {
+        surrogate->weights[i] += projection[i] * residual / denominator;
+        for (size_t j = 0; j < n; j++) {
+            inverse_gram[i * n + j] -= projection[i] * projection[j] / denominator;
+        }
+    }
+
+    surrogate->trained++;
+    double window = surrogate->trained < RESIDUAL_WINDOW ? surrogate->trained : RESIDUAL_WINDOW;
+    surrogate->residual_variance += (residual * residual - surrogate->residual_variance) / window;
+}
+
+SCM surrogate_train(SCM surrogate_object, SCM stages, SCM cost) {
+    Surrogate *surrogate = get_surrogate(surrogate_object);
+    load_features(surrogate, stages, "surrogate-train!");
+    train_loaded(surrogate, scm_to_double(cost));
+    return SCM_UNSPECIFIED;
+}
+
+SCM surrogate_predict(SCM surrogate_object, SCM stages) {
+    Surrogate *surrogate = get_surrogate(surrogate_object);
+    load_features(surrogate, stages, "surrogate-predict");
+    return scm_from_double(expm1(predict_loaded(surrogate)));
+}
+
+/*
+ * Returns the real cost, or #f if the surrogate is confident the candidate
+ * is above threshold. Skipping only starts once the model has been trained
+ * on at least as many candidates as it has features.
+ */
+SCM surrogate_filter_cost(SCM surrogate_object, SCM stages, SCM target, SCM threshold) {
+    Surrogate *surrogate = get_surrogate(surrogate_object);
+    const ResponseTarget *response_target = get_response_target(target);
+    double threshold_cost = scm_to_double(threshold);
+    load_features(surrogate, stages, "surrogate-filter-cost");
+
+    bool skip = false;
+    bool audit = false;
+    if (surrogate->trained >= surrogate->feature_count) {
+        double lower_bound = 
+            predict_loaded(surrogate) - 
+            surrogate->confidence * sqrt(surrogate->residual_variance);
+        skip = lower_bound > log1p(threshold_cost);
+    }
+    if (skip) {
+        surrogate->skipped++;
+        audit = 
+            (uint64_t) (surrogate->skipped * surrogate->audit_rate) > 
+            (uint64_t) ((surrogate->skipped - 1) * surrogate->audit_rate);
+        if (!audit) {
+            return SCM_BOOL_F;
+        }
+        surrogate->audited++;
+    }
+
+    TRACE_SCOPE_BEGIN("evaluate");
+    double cost = filter_cost(stages, response_target);
+    TRACE_SCOPE_END();
+    surrogate->evaluated++;
+    if (audit) {
+        if (cost > threshold_cost) {
+            surrogate->hits++;
+        }
+        else {
+            surrogate->misses++;
+        }
+    }
+    train_loaded(surrogate, cost);
+    scm_remember_upto_here_1(target);
+    return scm_from_double(cost);
+}
+
+SCM surrogate_statistics(SCM surrogate_object) {
+    Surrogate *surrogate = get_surrogate(surrogate_object);
+    double hit_rate = surrogate->audited > 0 ? 
+        (double) surrogate->hits / (double) surrogate->audited : 
+        NAN;
+    return scm_list_n(
+        scm_cons(scm_from_utf8_symbol("evaluated"), scm_from_uint64(surrogate->evaluated)),
+        scm_cons(scm_from_utf8_symbol("skipped"), scm_from_uint64(surrogate->skipped)),
+        scm_cons(scm_from_utf8_symbol("audited"), scm_from_uint64(surrogate->audited)),
+        scm_cons(scm_from_utf8_symbol("hits"), scm_from_uint64(surrogate->hits)),
+        scm_cons(scm_from_utf8_symbol("misses"), scm_from_uint64(surrogate->misses)),
+        scm_cons(scm_from_utf8_symbol("hit-rate"), scm_from_double(hit_rate)),
+        scm_cons(
+            scm_from_utf8_symbol("residual-rms"), 
+            scm_from_double(sqrt(surrogate->residual_variance))
+        ),
+        SCM_UNDEFINED
+    );
+}
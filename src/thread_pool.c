@@ -0,0 +1,139 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+/*
+ * Workers are plain POSIX threads that are never registered with Guile, so
+ * a task must only touch C data: no SCM values, no scm_* calls. The calling
+ * thread keeps ownership of anything the tasks read and runs items itself
+ * while the workers are busy.
+ */
+
+#define MAX_WORKERS 64
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t submit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_available = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_finished = PTHREAD_COND_INITIALIZER;
+
+static size_t worker_count;
+static unsigned long job_generation;
+static size_t workers_busy;
+
+static ParallelTask job_task;
+static void *job_context;
+static size_t job_count;
+static atomic_size_t job_next;
+
+static _Thread_local bool inside_task;
+
+static void run_job_items(void) {
+    size_t index;
+    while ((index = atomic_fetch_add(&job_next, 1)) < job_count) {
+        job_task(index, job_context);
+    }
+}
+
+static void *worker_main(void *unused) {
+    (void) unused;
+    inside_task = true;
+    unsigned long seen_generation = 0;
+
+    pthread_mutex_lock(&job_lock);
+    for (;;) {
+        while (job_generation == seen_generation) {
+            pthread_cond_wait(&job_available, &job_lock);
+        }
+        seen_generation = job_generation;
+        pthread_mutex_unlock(&job_lock);
+
+        run_job_items();
+
+        pthread_mutex_lock(&job_lock);
+        if (--workers_busy == 0) {
+            pthread_cond_signal(&job_finished);
+        }
+    }
+    return NULL;
+}
+
+static size_t requested_worker_count(void) {
+    const char *setting = getenv("FILTOPT_THREADS");
+    long threads;
+    if (setting != NULL) {
+        threads = strtol(setting, NULL, 10);
+    }
+    else {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads <= 1) {
+        return 0;
+    }
+    /* The submitting thread counts as one of the threads. */
+    return threads - 1 > MAX_WORKERS ? MAX_WORKERS : (size_t) (threads - 1);
+}
+
+static void start_workers(void) {
+    size_t requested = requested_worker_count();
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+    for (size_t i = 0; i < requested; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attributes, worker_main, NULL) != 0) {
+            break;
+        }
+        worker_count++;
+    }
+    pthread_attr_destroy(&attributes);
+}
+
+size_t thread_pool_size(void) {
+    pthread_once(&pool_once, start_workers);
+    return worker_count;
+}
+
+void parallel_for(size_t count, ParallelTask task, void *context) {
+    if (count == 0) {
+        return;
+    }
+    /* Nested calls from inside a task run inline instead of deadlocking. */
+    if (count == 1 || inside_task || thread_pool_size() == 0) {
+        for (size_t i = 0; i < count; i++) {
+            task(i, context);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&submit_lock);
+
+    pthread_mutex_lock(&job_lock);
+    job_task = task;
+    job_context = context;
+    job_count = count;
+    atomic_store(&job_next, 0);
+    workers_busy = worker_count;
+    job_generation++;
+    pthread_cond_broadcast(&job_available);
+    pthread_mutex_unlock(&job_lock);
+
+    inside_task = true;
+    run_job_items();
+    inside_task = false;
+
+    pthread_mutex_lock(&job_lock);
+    while (workers_busy > 0) {
+        pthread_cond_wait(&job_finished, &job_lock);
+    }
+    pthread_mutex_unlock(&job_lock);
+
+    pthread_mutex_unlock(&submit_lock);
+}
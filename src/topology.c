@@ -0,0 +1,409 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libguile.h>
+
+#include "component.h"
+#include "filter.h"
+#include "flat_filter.h"
+#include "load.h"
+#include "response_target.h"
+#include "thread_pool.h"
+#include "topology.h"
+
+/*
+ * Series and parallel connections are commutative and associative, so every
+ * load is kept in a canonical form: a series node has no series children, a
+ * parallel node has no parallel children, and children are sorted by their
+ * canonical encoding. Two loads are electrically identical exactly when
+ * their encodings are equal, e.g. "S(0,P(1,2))".
+ */
+
+#define DEFAULT_DESCENT_PASSES 8
+
+typedef struct Topology {
+    FlatNodeKind kind;
+    size_t template_index;
+    size_t child_count;
+    struct Topology **children;
+    char *canonical;
+} Topology;
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    Topology **items;
+} TopologyList;
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    Topology **slots;
+    uint64_t *hashes;
+} TopologySet;
+
+SCM enumerate_load_topologies(SCM templates, SCM max_components);
+SCM enumerate_ladder_topologies(SCM templates, SCM max_components, SCM max_stages, SCM limit);
+SCM optimize_topology_values(SCM ladders, SCM target, SCM passes);
+
+void init_topology(void) {
+    __extension__
+    scm_c_define_gsubr("enumerate-load-topologies", 2, 0, 0, (scm_t_subr) enumerate_load_topologies);
+    __extension__
+    scm_c_define_gsubr("enumerate-ladder-topologies", 3, 1, 0, (scm_t_subr) enumerate_ladder_topologies);
+    __extension__
+    scm_c_define_gsubr("optimize-topology-values", 2, 1, 0, (scm_t_subr) optimize_topology_values);
+}
+
+static uint64_t hash_string(const char *string) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *string != '\0'; string++) {
+        hash = (hash ^ (unsigned char) *string) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void append_topology(TopologyList *list, Topology *topology) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity == 0 ? 16 : 2 * list->capacity;
+        Topology **items = scm_gc_malloc(capacity * sizeof(Topology *), "topology list");
+        if (list->count > 0) {
+            memcpy(items, list->items, list->count * sizeof(Topology *));
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = topology;
+}
+
+static void init_topology_set(TopologySet *set, size_t capacity) {
+    set->count = 0;
+    set->capacity = capacity;
+    set->slots = scm_gc_calloc(capacity * sizeof(Topology *), "topology set");
+    set->hashes = scm_gc_malloc_pointerless(capacity * sizeof(uint64_t), "topology hashes");
+}
+
+static Topology **find_topology_slot(TopologySet *set, const char *canonical, uint64_t hash) {
+    size_t mask = set->capacity - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        Topology **slot = &set->slots[i];
+        if (*slot == NULL) {
+            return slot;
+        }
+        if (set->hashes[i] == hash && strcmp((*slot)->canonical, canonical) == 0) {
+            return slot;
+        }
+    }
+}
+
+static void insert_topology(TopologySet *set, Topology *topology, uint64_t hash) {
+    if (2 * (set->count + 1) > set->capacity) {
+        TopologySet grown;
+        init_topology_set(&grown, 2 * set->capacity);
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (set->slots[i] != NULL) {
+                insert_topology(&grown, set->slots[i], set->hashes[i]);
+            }
+        }
+        *set = grown;
+    }
+    Topology **slot = find_topology_slot(set, topology->canonical, hash);
+    set->hashes[slot - set->slots] = hash;
+    *slot = topology;
+    set->count++;
+}
+
+static int compare_topologies(const void *first, const void *second) {
+    const Topology *topology1 = *(Topology * const *) first;
+    const Topology *topology2 = *(Topology * const *) second;
+    return strcmp(topology1->canonical, topology2->canonical);
+}
+
+static size_t gather_children(Topology **children, size_t count, FlatNodeKind kind, Topology *topology) {
+    if (topology->kind == kind) {
+        memcpy(&children[count], topology->children, topology->child_count * sizeof(Topology *));
+        return count + topology->child_count;
+    }
+    children[count] = topology;
+    return count + 1;
+}
+
+/* Returns the canonical combination of two loads, or NULL if it was seen before. */
+static Topology *combine_topologies(
+    TopologySet *seen, 
+    FlatNodeKind kind, 
+    Topology *topology1, 
+    Topology *topology2, 
+    size_t max_children
+) {
+    Topology **children = malloc(max_children * sizeof(Topology *));
+    size_t child_count = gather_children(children, 0, kind, topology1);
+    child_count = gather_children(children, child_count, kind, topology2);
+    qsort(children, child_count, sizeof(Topology *), compare_topologies);
+
+    size_t length = 3;
+    for (size_t i = 0; i < child_count; i++) {
+        length += strlen(children[i]->canonical) + 1;
+    }
+    char *canonical = malloc(length);
+    char *end = canonical;
+    *end++ = kind == SERIES_NODE ? 'S' : 'P';
+    *end++ = '(';
+    for (size_t i = 0; i < child_count; i++) {
+        if (i > 0) {
+            *end++ = ',';
+        }
+        size_t child_length = strlen(children[i]->canonical);
+        memcpy(end, children[i]->canonical, child_length);
+        end += child_length;
+    }
+    *end++ = ')';
+    *end = '\0';
+
+    Topology *combined = NULL;
+    uint64_t hash = hash_string(canonical);
+    if (*find_topology_slot(seen, canonical, hash) == NULL) {
+        combined = scm_gc_malloc(sizeof(Topology), "topology");
+        combined->kind = kind;
+        combined->template_index = 0;
+        combined->child_count = child_count;
+        combined->children = scm_gc_malloc(child_count * sizeof(Topology *), "topology children");
+        memcpy(combined->children, children, child_count * sizeof(Topology *));
+        combined->canonical = scm_gc_malloc_pointerless(length, "canonical topology");
+        memcpy(combined->canonical, canonical, length);
+        insert_topology(seen, combined, hash);
+    }
+    free(children);
+    free(canonical);
+    return combined;
+}
+
+/* levels[k] receives every canonical load built from exactly k + 1 components. */
+static void enumerate_levels(TopologyList *levels, size_t template_count, size_t max_components) {
+    TopologySet seen;
+    init_topology_set(&seen, 64);
+
+    for (size_t i = 0; i < template_count; i++) {
+        Topology *leaf = scm_gc_malloc(sizeof(Topology), "topology");
+        leaf->kind = COMPONENT_NODE;
+        leaf->template_index = i;
+        leaf->child_count = 0;
+        leaf->children = NULL;
+        leaf->canonical = scm_gc_malloc_pointerless(24, "canonical topology");
+        snprintf(leaf->canonical, 24, "%zu", i);
+        insert_topology(&seen, leaf, hash_string(leaf->canonical));
+        append_topology(&levels[0], leaf);
+    }
+
+    /* Every series-parallel load splits into two smaller ones at its root. */
+    for (size_t components = 2; components <= max_components; components++) {
+        for (size_t left = 1; 2 * left <= components; left++) {
+            TopologyList *lefts = &levels[left - 1];
+            TopologyList *rights = &levels[components - left - 1];
+            for (size_t i = 0; i < lefts->count; i++) {
+                size_t first_right = 2 * left == components ? i : 0;
+                for (size_t j = first_right; j < rights->count; j++) {
+                    FlatNodeKind kinds[] = {SERIES_NODE, PARALLEL_NODE};
+                    for (size_t k = 0; k < 2; k++) {
+                        Topology *combined = combine_topologies(
+                            &seen, kinds[k], lefts->items[i], rights->items[j], components
+                        );
+                        if (combined != NULL) {
+                            append_topology(&levels[components - 1], combined);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static SCM topology_load(const Topology *topology, SCM templates) {
+    if (topology->kind == COMPONENT_NODE) {
+        return make_component_load(
+            duplicate_component(SCM_SIMPLE_VECTOR_REF(templates, topology->template_index))
+        );
+    }
+
+    SCM children = scm_c_make_vector(topology->child_count, SCM_BOOL_F);
+    for (size_t i = 0; i < topology->child_count; i++) {
+        SCM_SIMPLE_VECTOR_SET(children, i, topology_load(topology->children[i], templates));
+    }
+    if (topology->kind == SERIES_NODE) {
+        return make_series_load(children);
+    }
+    return make_parallel_load(children);
+}
+
+static TopologyList collect_load_topologies(
+    SCM templates, 
+    SCM max_components, 
+    const char *subr
+) {
+    SCM_ASSERT_TYPE(
+        scm_is_vector(templates) && SCM_SIMPLE_VECTOR_LENGTH(templates) > 0, 
+        templates, 
+        SCM_ARG1, 
+        subr, 
+        "Non-empty vector of template components");
+    size_t template_count = SCM_SIMPLE_VECTOR_LENGTH(templates);
+    for (size_t i = 0; i < template_count; i++) {
+        scm_assert_foreign_object_type(component_type, SCM_SIMPLE_VECTOR_REF(templates, i));
+    }
+    size_t component_limit = scm_to_size_t(max_components);
+    if (component_limit == 0) {
+        scm_out_of_range(subr, max_components);
+    }
+
+    TopologyList *levels = scm_gc_calloc(component_limit * sizeof(TopologyList), "topology levels");
+    enumerate_levels(levels, template_count, component_limit);
+
+    TopologyList all = {0, 0, NULL};
+    for (size_t level = 0; level < component_limit; level++) {
+        for (size_t i = 0; i < levels[level].count; i++) {
+            append_topology(&all, levels[level].items[i]);
+        }
+    }
+    return all;
+}
+
+SCM enumerate_load_topologies(SCM templates, SCM max_components) {
+    TopologyList topologies = collect_load_topologies(
+        templates, max_components, "enumerate-load-topologies"
+    );
+    SCM loads = scm_c_make_vector(topologies.count, SCM_BOOL_F);
+    for (size_t i = 0; i < topologies.count; i++) {
+        SCM_SIMPLE_VECTOR_SET(loads, i, topology_load(topologies.items[i], templates));
+    }
+    return loads;
+}
+
+/*
+ * Two adjacent series stages are one series stage holding both loads in
+ * series, and likewise for shunt stages in parallel, so canonical ladders
+ * alternate stage kinds and are fixed by their first stage kind and loads.
+ */
+SCM enumerate_ladder_topologies(SCM templates, SCM max_components, SCM max_stages, SCM limit) {
+    TopologyList loads = collect_load_topologies(
+        templates, max_components, "enumerate-ladder-topologies"
+    );
+    size_t stage_limit = scm_to_size_t(max_stages);
+    size_t ladder_limit = SCM_UNBNDP(limit) ? SIZE_MAX : scm_to_size_t(limit);
+
+    size_t *choices = scm_gc_malloc_pointerless(
+        (stage_limit + 1) * sizeof(size_t), "ladder choices"
+    );
+    SCM ladders = SCM_EOL;
+    size_t ladder_count = 0;
+    for (size_t stage_count = 1; stage_count <= stage_limit; stage_count++) {
+        for (int shunt_first = 0; shunt_first <= 1; shunt_first++) {
+            memset(choices, 0, stage_count * sizeof(size_t));
+            for (;;) {
+                if (ladder_count == ladder_limit) {
+                    return scm_vector(scm_reverse_x(ladders, SCM_EOL));
+                }
+                SCM stages = scm_c_make_vector(stage_count, SCM_BOOL_F);
+                for (size_t i = 0; i < stage_count; i++) {
+                    SCM load = topology_load(loads.items[choices[i]], templates);
+                    bool is_shunt = (i % 2 == 0) == (shunt_first == 1);
+                    SCM_SIMPLE_VECTOR_SET(
+                        stages, 
+                        i, 
+                        is_shunt ? make_shunt_filter_stage(load) : make_series_filter_stage(load)
+                    );
+                }
+                ladders = scm_cons(stages, ladders);
+                ladder_count++;
+
+                size_t position = 0;
+                while (position < stage_count && ++choices[position] == loads.count) {
+                    choices[position++] = 0;
+                }
+                if (position == stage_count) {
+                    break;
+                }
+            }
+        }
+    }
+    return scm_vector(scm_reverse_x(ladders, SCM_EOL));
+}
+
+/*
+ * Coordinate descent over the value ranks: each pass moves every connected
+ * component to its best rank within its limits, holding the others fixed.
+ */
+double descend_component_values(FlatFilter *filter, const ResponseTarget *target, size_t passes) {
+    double cost = flat_filter_cost(filter, target);
+    for (size_t pass = 0; pass < passes; pass++) {
+        bool improved = false;
+        for (size_t i = 0; i < filter->component_count; i++) {
+            FlatComponent *component = &filter->components[i];
+            if (!component->is_connected) {
+                continue;
+            }
+            int start_rank = component->rank;
+            int best_rank = start_rank;
+            for (int rank = component->lower_rank; rank <= component->upper_rank; rank++) {
+                if (rank == start_rank) {
+                    continue;
+                }
+                set_flat_component_rank(component, rank);
+                double candidate_cost = flat_filter_cost(filter, target);
+                if (candidate_cost < cost) {
+                    cost = candidate_cost;
+                    best_rank = rank;
+                }
+            }
+            set_flat_component_rank(component, best_rank);
+            improved |= best_rank != start_rank;
+        }
+        if (!improved) {
+            break;
+        }
+    }
+    return cost;
+}
+
+typedef struct {
+    FlatFilter **filters;
+    double *costs;
+    const ResponseTarget *target;
+    size_t passes;
+} TopologySearch;
+
+static void optimize_topology(size_t index, void *context) {
+    TopologySearch *search = context;
+    search->costs[index] = descend_component_values(
+        search->filters[index], search->target, search->passes
+    );
+}
+
+SCM optimize_topology_values(SCM ladders, SCM target, SCM passes) {
+    SCM_ASSERT_TYPE(
+        scm_is_vector(ladders), 
+        ladders, 
+        SCM_ARG1, 
+        "optimize-topology-values", 
+        "Vector of stage vectors");
+
+    size_t ladder_count = SCM_SIMPLE_VECTOR_LENGTH(ladders);
+    TopologySearch search;
+    search.target = get_response_target(target);
+    search.passes = SCM_UNBNDP(passes) ? DEFAULT_DESCENT_PASSES : scm_to_size_t(passes);
+    search.filters = scm_gc_malloc(ladder_count * sizeof(FlatFilter *), "topology filters");
+    search.costs = scm_gc_malloc_pointerless(ladder_count * sizeof(double), "topology costs");
+    for (size_t i = 0; i < ladder_count; i++) {
+        search.filters[i] = compile_filter(SCM_SIMPLE_VECTOR_REF(ladders, i));
+    }
+
+    parallel_for(ladder_count, optimize_topology, &search);
+
+    SCM costs = scm_c_make_vector(ladder_count, SCM_BOOL_F);
+    for (size_t i = 0; i < ladder_count; i++) {
+        store_flat_filter_state(search.filters[i], SCM_SIMPLE_VECTOR_REF(ladders, i));
+        SCM_SIMPLE_VECTOR_SET(costs, i, scm_from_double(search.costs[i]));
+    }
+    scm_remember_upto_here_1(target);
+    return costs;
+}
@@ -0,0 +1,354 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <gc/gc.h>
+#include <libguile.h>
+
+#include "trace.h"
+
+/*
+ * Scoped trace events in the Chrome trace-event format. Each thread appends
+ * to its own fixed-size buffer, so recording takes no lock: the writer
+ * publishes an event by bumping its buffer's count, and buffers are pushed
+ * onto a global list with a compare-and-swap the first time a thread
+ * records. Events past a full buffer are dropped and counted. A thread's
+ * buffer outlives the thread so that its events can still be written; it is
+ * freed by the next trace-clear!.
+ *
+ * Garbage collections are recorded as complete events from the collector's
+ * own start and end events, which run synchronously on the collecting
+ * thread (Guile's after-GC hook runs later, from an async). The callback
+ * must not allocate, so collections go to a buffer set up by set-tracing!.
+ */
+
+#define DEFAULT_TRACE_BUFFER_EVENTS (1 << 18)
+
+typedef struct {
+    const char *name;
+    uint64_t timestamp;
+    uint64_t duration;
+    char phase;
+} TraceEvent;
+
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;
+    unsigned thread_id;
+    size_t capacity;
+    atomic_size_t count;
+    atomic_size_t dropped;
+    atomic_bool is_retired;
+    TraceEvent events[];
+} TraceBuffer;
+
+typedef struct TraceName {
+    struct TraceName *next;
+    char name[];
+} TraceName;
+
+atomic_bool tracing_enabled;
+
+static _Atomic(TraceBuffer *) trace_buffers;
+static atomic_uint next_thread_id;
+static _Thread_local TraceBuffer *thread_buffer;
+static pthread_key_t thread_buffer_key;
+
+static _Atomic(TraceBuffer *) gc_buffer;
+static uint64_t gc_start_time;
+static GC_on_collection_event_proc previous_collection_event;
+
+static pthread_mutex_t trace_name_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceName *trace_names;
+
+SCM set_tracing(SCM enabled);
+SCM tracing_p(void);
+SCM scm_trace_begin(SCM name);
+SCM scm_trace_end(SCM name);
+SCM trace_write(SCM path);
+SCM trace_clear(void);
+static void retire_trace_buffer(void *buffer);
+static void trace_collection_event(GC_EventType event);
+
+void init_trace(void) {
+    if (pthread_key_create(&thread_buffer_key, retire_trace_buffer) != 0) {
+        scm_misc_error("init-trace", "Failed to create the trace buffer key.", SCM_EOL);
+    }
+    previous_collection_event = GC_get_on_collection_event();
+    GC_set_on_collection_event(trace_collection_event);
+
+    __extension__
+    scm_c_define_gsubr("set-tracing!", 1, 0, 0, (scm_t_subr) set_tracing);
+    __extension__
+    scm_c_define_gsubr("tracing?", 0, 0, 0, (scm_t_subr) tracing_p);
+    __extension__
+    scm_c_define_gsubr("trace-begin", 1, 0, 0, (scm_t_subr) scm_trace_begin);
+    __extension__
+    scm_c_define_gsubr("trace-end", 1, 0, 0, (scm_t_subr) scm_trace_end);
+    __extension__
+    scm_c_define_gsubr("trace-write", 1, 0, 0, (scm_t_subr) trace_write);
+    __extension__
+    scm_c_define_gsubr("trace-clear!", 0, 0, 0, (scm_t_subr) trace_clear);
+}
+
+static uint64_t trace_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+static TraceBuffer *allocate_trace_buffer(void) {
+    size_t capacity = DEFAULT_TRACE_BUFFER_EVENTS;
+    const char *setting = getenv("FILTOPT_TRACE_EVENTS");
+    if (setting != NULL && strtoul(setting, NULL, 10) > 0) {
+        capacity = strtoul(setting, NULL, 10);
+    }
+    TraceBuffer *buffer = malloc(sizeof(TraceBuffer) + capacity * sizeof(TraceEvent));
+    if (buffer == NULL) {
+        return NULL;
+    }
+    buffer->thread_id = atomic_fetch_add(&next_thread_id, 1) + 1;
+    buffer->capacity = capacity;
+    atomic_init(&buffer->count, 0);
+    atomic_init(&buffer->dropped, 0);
+    atomic_init(&buffer->is_retired, false);
+
+    buffer->next = atomic_load(&trace_buffers);
+    while (!atomic_compare_exchange_weak(&trace_buffers, &buffer->next, buffer)) {
+    }
+    return buffer;
+}
+
+static TraceBuffer *current_trace_buffer(void) {
+    if (thread_buffer == NULL) {
+        thread_buffer = allocate_trace_buffer();
+        if (thread_buffer != NULL) {
+            pthread_setspecific(thread_buffer_key, thread_buffer);
+        }
+    }
+    return thread_buffer;
+}
+
+/* Thread exit: keep the events for trace-write, free the buffer at trace-clear!. */
+static void retire_trace_buffer(void *buffer) {
+    atomic_store(&((TraceBuffer *) buffer)->is_retired, true);
+}
+
+static void append_trace_event(
+    TraceBuffer *buffer, 
+    const char *name, 
+    char phase, 
+    uint64_t timestamp, 
+    uint64_t duration
+) {
+    if (buffer == NULL) {
+        return;
+    }
+    size_t count = atomic_load_explicit(&buffer->count, memory_order_relaxed);
+    if (count == buffer->capacity) {
+        atomic_fetch_add_explicit(&buffer->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    TraceEvent *event = &buffer->events[count];
+    event->name = name;
+    event->timestamp = timestamp;
+    event->duration = duration;
+    event->phase = phase;
+    atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+}
+
+/* name must outlive the trace: a string literal or an interned trace name. */
+void record_trace_event(const char *name, char phase) {
+    append_trace_event(current_trace_buffer(), name, phase, trace_clock(), 0);
+}
+
+static void end_trace_span(void *name) {
+    record_trace_event(name, 'E');
+}
+
+/* Records the begin event and opens the dynwind context that ends the span. */
+void begin_trace_scope(const char *name) {
+    scm_dynwind_begin(0);
+    record_trace_event(name, 'B');
+    scm_dynwind_unwind_handler(end_trace_span, (void *) name, SCM_F_WIND_EXPLICITLY);
+}
+
+void end_trace_scope(void) {
+    scm_dynwind_end();
+}
+
+/*
+ * Runs with the collector's lock held, and for START and END with the world
+ * stopped or about to be, so it only reads the clock and writes the
+ * preallocated buffer. Collections are serialized, so one writer suffices.
+ */
+static void trace_collection_event(GC_EventType event) {
+    if (previous_collection_event != NULL) {
+        previous_collection_event(event);
+    }
+    TraceBuffer *buffer = atomic_load_explicit(&gc_buffer, memory_order_acquire);
+    if (buffer == NULL || !atomic_load_explicit(&tracing_enabled, memory_order_relaxed)) {
+        gc_start_time = 0;
+        return;
+    }
+    if (event == GC_EVENT_START) {
+        gc_start_time = trace_clock();
+    }
+    else if (event == GC_EVENT_END && gc_start_time != 0) {
+        append_trace_event(buffer, "gc", 'X', gc_start_time, trace_clock() - gc_start_time);
+        gc_start_time = 0;
+    }
+}
+
+static const char *intern_trace_name(SCM name, const char *subr) {
+    if (scm_is_symbol(name)) {
+        name = scm_symbol_to_string(name);
+    }
+    SCM_ASSERT_TYPE(scm_is_string(name), name, SCM_ARG1, subr, "String or symbol");
+
+    char *string = scm_to_utf8_string(name);
+    pthread_mutex_lock(&trace_name_lock);
+    TraceName *entry = trace_names;
+    while (entry != NULL && strcmp(entry->name, string) != 0) {
+        entry = entry->next;
+    }
+    if (entry == NULL) {
+        entry = malloc(sizeof(TraceName) + strlen(string) + 1);
+        if (entry != NULL) {
+            strcpy(entry->name, string);
+            entry->next = trace_names;
+            trace_names = entry;
+        }
+    }
+    pthread_mutex_unlock(&trace_name_lock);
+    free(string);
+    return entry != NULL ? entry->name : "unnamed";
+}
+
+SCM set_tracing(SCM enabled) {
+    if (scm_is_true(enabled) && atomic_load(&gc_buffer) == NULL) {
+        TraceBuffer *buffer = allocate_trace_buffer();
+        TraceBuffer *expected = NULL;
+        if (buffer != NULL && !atomic_compare_exchange_strong(&gc_buffer, &expected, buffer)) {
+            /* Another thread won the race; its buffer is on the list, leave ours empty. */
+            atomic_store(&buffer->is_retired, true);
+        }
+    }
+    atomic_store(&tracing_enabled, scm_is_true(enabled));
+    return enabled;
+}
+
+SCM tracing_p(void) {
+    return scm_from_bool(atomic_load(&tracing_enabled));
+}
+
+SCM scm_trace_begin(SCM name) {
+    if (atomic_load_explicit(&tracing_enabled, memory_order_relaxed)) {
+        record_trace_event(intern_trace_name(name, "trace-begin"), 'B');
+    }
+    return SCM_UNSPECIFIED;
+}
+
+SCM scm_trace_end(SCM name) {
+    if (atomic_load_explicit(&tracing_enabled, memory_order_relaxed)) {
+        record_trace_event(intern_trace_name(name, "trace-end"), 'E');
+    }
+    return SCM_UNSPECIFIED;
+}
+
+static void write_json_string(FILE *file, const char *string) {
+    fputc('"', file);
+    for (; *string != '\0'; string++) {
+        unsigned char character = *string;
+        if (character == '"' || character == '\\') {
+            fputc('\\', file);
+            fputc(character, file);
+        }
+        else if (character < 0x20) {
+            fprintf(file, "\\u%04x", character);
+        }
+        else {
+            fputc(character, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/* Writes every recorded event as Chrome trace-event JSON; returns the event count. */
+SCM trace_write(SCM path) {
+    char *file_name = scm_to_utf8_string(path);
+    FILE *file = fopen(file_name, "w");
+    free(file_name);
+    if (file == NULL) {
+        scm_syserror("trace-write");
+    }
+
+    size_t written = 0;
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+    for (TraceBuffer *buffer = atomic_load(&trace_buffers); buffer != NULL; buffer = buffer->next) {
+        size_t count = atomic_load_explicit(&buffer->count, memory_order_acquire);
+        for (size_t i = 0; i < count; i++) {
+            const TraceEvent *event = &buffer->events[i];
+            fputs(written == 0 ? "\n{\"name\":" : ",\n{\"name\":", file);
+            write_json_string(file, event->name);
+            fprintf(
+                file, 
+                ",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f", 
+                event->phase, 
+                buffer->thread_id, 
+                event->timestamp / 1000.0
+            );
+            if (event->phase == 'X') {
+                fprintf(file, ",\"dur\":%.3f", event->duration / 1000.0);
+            }
+            fputc('}', file);
+            written++;
+        }
+        size_t dropped = atomic_load(&buffer->dropped);
+        if (dropped > 0) {
+            fprintf(
+                file, 
+                "%s\n{\"name\":\"dropped %zu events\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}", 
+                written == 0 ? "" : ",", 
+                dropped, 
+                buffer->thread_id, 
+                count > 0 ? buffer->events[count - 1].timestamp / 1000.0 : 0.0
+            );
+            written++;
+        }
+    }
+    fputs("\n]}\n", file);
+    if (fclose(file) != 0) {
+        scm_syserror("trace-write");
+    }
+    return scm_from_size_t(written);
+}
+
+/*
+ * Forgets recorded events and frees the buffers of threads that have exited.
+ * Only call while no thread is recording.
+ */
+SCM trace_clear(void) {
+    TraceBuffer *kept = NULL;
+    TraceBuffer **tail = &kept;
+    TraceBuffer *next;
+    for (TraceBuffer *buffer = atomic_load(&trace_buffers); buffer != NULL; buffer = next) {
+        next = buffer->next;
+        if (atomic_load(&buffer->is_retired)) {
+            free(buffer);
+            continue;
+        }
+        atomic_store(&buffer->count, 0);
+        atomic_store(&buffer->dropped, 0);
+        *tail = buffer;
+        tail = &buffer->next;
+    }
+    *tail = NULL;
+    atomic_store(&trace_buffers, kept);
+    return SCM_UNSPECIFIED;
+}
@@ -1,8 +1,20 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <complex.h>
 #include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include <libguile.h>
 
 #include "two_port_network.h"
+#include "thread_pool.h"
+
+#define MIN_PARALLEL_CHUNK 16
+#define CALIBRATION_MAX_NETWORKS 8192
+#define CALIBRATION_REPETITIONS 8
 
 double complex *matrix_element(int row, int column, TwoPortNetwork *network) {
     assert(row > 0);
@@ -29,15 +41,219 @@ double complex *matrix_element(int row, int column, TwoPortNetwork *network) {
 }
 
 void cascade_network(TwoPortNetwork *result, TwoPortNetwork *matrix1, TwoPortNetwork *matrix2) {
+    TwoPortNetwork product;
     for (int i = 1; i <= 2; i++) {
         for (int j = 1; j <= 2; j++) {
+            *matrix_element(i, j, &product) = 0;
             for (int k = 1; k <= 2; k++) {
-                *matrix_element(i, j, result) += 
+                *matrix_element(i, j, &product) += 
                     *matrix_element(i, k, matrix1) * 
                     *matrix_element(k, j, matrix2);
             }
         }
     }
+    *result = product;
+}
+
+/*
+ * Balanced-tree product networks[0] * networks[1] * ... * networks[count - 1].
+ * The array is used as scratch space and is left holding partial products.
+ *
+ * Only the association of the products differs from a left-to-right cascade,
+ * so each entry of the result agrees with the serial product to within
+ * about 2 * count * DBL_EPSILON times the same entry of
+ * |networks[0]| * |networks[1]| * ... (elementwise magnitudes).
+ */
+void cascade_networks(TwoPortNetwork *result, TwoPortNetwork *networks, size_t count) {
+    if (count == 0) {
+        identity_network(result);
+        return;
+    }
+    for (size_t stride = 1; stride < count; stride *= 2) {
+        for (size_t i = 0; i + stride < count; i += 2 * stride) {
+            cascade_network(&networks[i], &networks[i], &networks[i + stride]);
+        }
+    }
+    *result = networks[0];
+}
+
+typedef struct {
+    TwoPortNetwork *networks;
+    TwoPortNetwork *partials;
+    size_t count;
+    size_t chunk_count;
+} CascadeChunks;
+
+static void cascade_chunk(size_t chunk, void *context) {
+    CascadeChunks *chunks = context;
+    size_t begin = chunk * chunks->count / chunks->chunk_count;
+    size_t end = (chunk + 1) * chunks->count / chunks->chunk_count;
+    cascade_networks(&chunks->partials[chunk], &chunks->networks[begin], end - begin);
+}
+
+/*
+ * Same product and tolerance as cascade_networks, with contiguous chunks
+ * reduced on the thread pool and the partial products combined in order.
+ */
+void parallel_cascade_networks(TwoPortNetwork *result, TwoPortNetwork *networks, size_t count) {
+    size_t chunk_count = thread_pool_size() + 1;
+    if (chunk_count > count / MIN_PARALLEL_CHUNK) {
+        chunk_count = count / MIN_PARALLEL_CHUNK;
+    }
+    if (chunk_count < 2) {
+        cascade_networks(result, networks, count);
+        return;
+    }
+
+    TwoPortNetwork *partials = malloc(chunk_count * sizeof(TwoPortNetwork));
+    if (partials == NULL) {
+        cascade_networks(result, networks, count);
+        return;
+    }
+    CascadeChunks chunks = {networks, partials, count, chunk_count};
+    parallel_for(chunk_count, cascade_chunk, &chunks);
+    cascade_networks(result, partials, chunk_count);
+    free(partials);
+}
+
+/*
+ * Single-precision kernels for screening, where a rough answer is enough to
+ * reject a candidate. Written out element by element so the compiler can
+ * keep them in registers.
+ */
+void cascade_network_f(
+    SinglePrecisionNetwork *result, 
+    SinglePrecisionNetwork *matrix1, 
+    SinglePrecisionNetwork *matrix2
+) {
+    SinglePrecisionNetwork product;
+    product.element11 = 
+        matrix1->element11 * matrix2->element11 + matrix1->element12 * matrix2->element21;
+    product.element12 = 
+        matrix1->element11 * matrix2->element12 + matrix1->element12 * matrix2->element22;
+    product.element21 = 
+        matrix1->element21 * matrix2->element11 + matrix1->element22 * matrix2->element21;
+    product.element22 = 
+        matrix1->element21 * matrix2->element12 + matrix1->element22 * matrix2->element22;
+    *result = product;
+}
+
+float complex network_voltage_gain_f(SinglePrecisionNetwork *network) {
+    return network->element11;
+}
+
+void series_connected_network_f(SinglePrecisionNetwork *network, float complex impedance) {
+    network->element11 = 1;
+    network->element12 = impedance;
+    network->element21 = 0;
+    network->element22 = 1;
+}
+
+void shunt_connected_network_f(SinglePrecisionNetwork *network, float complex impedance) {
+    network->element11 = 1;
+    network->element12 = 0;
+    network->element21 = 1.0f / impedance;
+    network->element22 = 1;
+}
+
+void identity_network_f(SinglePrecisionNetwork *network) {
+    network->element11 = 1;
+    network->element12 = 0;
+    network->element21 = 0;
+    network->element22 = 1;
+}
+
+static size_t cascade_crossover = SIZE_MAX;
+static pthread_once_t crossover_once = PTHREAD_ONCE_INIT;
+
+static double elapsed_seconds(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + 1e-9 * (end->tv_nsec - start->tv_nsec);
+}
+
+/* The left-to-right product get_filter_network uses for short ladders. */
+static void serial_cascade_networks(TwoPortNetwork *result, TwoPortNetwork *networks, size_t count) {
+    identity_network(result);
+    for (size_t i = 0; i < count; i++) {
+        cascade_network(result, result, &networks[i]);
+    }
+}
+
+/*
+ * Times only the product step. The stage matrices are built once; the tree
+ * reductions use their input as scratch, so it is restored, untimed, before
+ * every repetition.
+ */
+static double time_cascade(
+    void (*cascade)(TwoPortNetwork *, TwoPortNetwork *, size_t),
+    const TwoPortNetwork *stages,
+    TwoPortNetwork *scratch,
+    size_t count
+) {
+    double seconds = 0;
+    for (int repetition = 0; repetition < CALIBRATION_REPETITIONS; repetition++) {
+        struct timespec start, end;
+        TwoPortNetwork result;
+        memcpy(scratch, stages, count * sizeof(TwoPortNetwork));
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        cascade(&result, scratch, count);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        seconds += elapsed_seconds(&start, &end);
+    }
+    return seconds;
+}
+
+static void calibrate_cascade_crossover(void) {
+    const char *setting = getenv("FILTOPT_CASCADE_CROSSOVER");
+    if (setting != NULL) {
+        cascade_crossover = strtoul(setting, NULL, 10);
+        return;
+    }
+    if (thread_pool_size() == 0) {
+        return;
+    }
+
+    TwoPortNetwork *stages = malloc(CALIBRATION_MAX_NETWORKS * sizeof(TwoPortNetwork));
+    TwoPortNetwork *scratch = malloc(CALIBRATION_MAX_NETWORKS * sizeof(TwoPortNetwork));
+    if (stages == NULL || scratch == NULL) {
+        free(stages);
+        free(scratch);
+        return;
+    }
+    for (size_t i = 0; i < CALIBRATION_MAX_NETWORKS; i++) {
+        if (i % 2 == 0) {
+            series_connected_network(&stages[i], 1.0 + 0.5 * I);
+        }
+        else {
+            shunt_connected_network(&stages[i], 2.0 - 0.25 * I);
+        }
+    }
+    /* The crossover is the smallest size where the threads win twice in a row. */
+    size_t first_win = SIZE_MAX;
+    for (size_t count = 2 * MIN_PARALLEL_CHUNK; count <= CALIBRATION_MAX_NETWORKS; count *= 2) {
+        double serial = time_cascade(serial_cascade_networks, stages, scratch, count);
+        double parallel = time_cascade(parallel_cascade_networks, stages, scratch, count);
+        if (parallel < serial) {
+            if (first_win != SIZE_MAX) {
+                cascade_crossover = first_win;
+                break;
+            }
+            first_win = count;
+        }
+        else {
+            first_win = SIZE_MAX;
+        }
+    }
+    free(stages);
+    free(scratch);
+}
+
+/*
+ * Ladder length from which get_filter_network switches to the threaded tree
+ * reduction. Measured once per process; FILTOPT_CASCADE_CROSSOVER overrides.
+ */
+size_t parallel_cascade_crossover(void) {
+    pthread_once(&crossover_once, calibrate_cascade_crossover);
+    return cascade_crossover;
 }
 
 double complex network_voltage_gain(TwoPortNetwork *network) {
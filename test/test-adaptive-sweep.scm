@@ -0,0 +1,126 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-4)
+             (srfi srfi-4 gnu)
+             (srfi srfi-64))
+
+(test-begin "adaptive-sweep-test")
+
+(define (make-limited-component type value)
+  (make-component type
+                  (nearest-preferred-value value)
+                  (floor-preferred-value (/ value 100))
+                  (ceiling-preferred-value (* value 100))))
+
+(define (component-load type value)
+  (make-component-load (make-limited-component type value)))
+
+(define resonant-filter
+  (vector (make-series-filter-stage
+            (make-parallel-load
+              (vector (component-load 'resistor 1000)
+                      (make-series-load
+                        (vector (component-load 'inductor 0.01)
+                                (component-load 'capacitor 1e-7))))))
+          (make-shunt-filter-stage (component-load 'capacitor 2.2e-7))
+          (make-series-filter-stage (component-load 'resistor 470))
+          (make-shunt-filter-stage
+            (make-parallel-load
+              (vector (component-load 'inductor 0.1) (component-load 'resistor 10000))))))
+
+;; Series-LC shunt across the output: a notch at 1/sqrt(LC) = 31622.8 rad/s.
+(define notch-frequency (/ 1 (sqrt (* 1e-3 1e-6))))
+(define notch-filter
+  (vector (make-series-filter-stage (component-load 'resistor 1000))
+          (make-shunt-filter-stage
+            (make-series-load
+              (vector (component-load 'inductor 1e-3) (component-load 'capacitor 1e-6))))))
+
+(define (gain-db gain)
+  (* 20 (log10 (magnitude gain))))
+
+(define (sorted? frequencies)
+  (let loop ((i 1))
+    (or (>= i (f64vector-length frequencies))
+        (and (< (f64vector-ref frequencies (- i 1)) (f64vector-ref frequencies i))
+             (loop (+ i 1))))))
+
+;; Largest gap, in dB, between the adaptive grid interpolated linearly in
+;; log frequency and a dense logarithmic sweep of the same filter.
+(define (max-interpolation-error filter sweep min-frequency max-frequency)
+  (let* ((frequencies (car sweep))
+         (gains (cdr sweep))
+         (count (f64vector-length frequencies))
+         (dense-count 2000))
+    (let loop ((k 0) (j 1) (worst 0))
+      (if (> k dense-count)
+          worst
+          (let* ((frequency (expt 10 (+ (log10 min-frequency)
+                                        (* (/ k dense-count)
+                                           (- (log10 max-frequency) (log10 min-frequency))))))
+                 (j (let next ((j j))
+                      (if (and (< j (- count 1)) (< (f64vector-ref frequencies j) frequency))
+                          (next (+ j 1))
+                          j)))
+                 (start (log10 (f64vector-ref frequencies (- j 1))))
+                 (end (log10 (f64vector-ref frequencies j)))
+                 (t (/ (- (log10 frequency) start) (- end start)))
+                 (start-db (gain-db (c64vector-ref gains (- j 1))))
+                 (end-db (gain-db (c64vector-ref gains j)))
+                 (difference (abs (- (+ start-db (* t (- end-db start-db)))
+                                     (gain-db (filter_voltage_gain frequency filter))))))
+            (loop (+ k 1) j (max worst difference)))))))
+
+(define (count-between frequencies low high)
+  (let loop ((i 0) (count 0))
+    (if (= i (f64vector-length frequencies))
+        count
+        (loop (+ i 1)
+              (if (< low (f64vector-ref frequencies i) high) (+ count 1) count)))))
+
+;; Points per decade strictly between two frequencies.
+(define (density frequencies low high)
+  (/ (count-between frequencies low high) (log10 (/ high low))))
+
+;; The notch is sampled far more densely than the flat passband below it.
+(define (notch-refined? frequencies)
+  (> (density frequencies (/ notch-frequency 1.1) (* notch-frequency 1.1))
+     (* 10 (density frequencies 100 (/ notch-frequency 10)))))
+
+(test-begin "matches-dense-sweep")
+(define resonant-sweep (adaptive-sweep resonant-filter 10 1e7 0.1))
+(test-assert (sorted? (car resonant-sweep)))
+(test-equal (f64vector-length (car resonant-sweep)) (c64vector-length (cdr resonant-sweep)))
+(test-assert (< (f64vector-length (car resonant-sweep)) 400))
+(test-equal (filter_voltage_gain (f64vector-ref (car resonant-sweep) 7) resonant-filter)
+            (c64vector-ref (cdr resonant-sweep) 7))
+(test-assert (< (max-interpolation-error resonant-filter resonant-sweep 10 1e7) 0.1))
+(test-end "matches-dense-sweep")
+
+(test-begin "refines-notch")
+(define notch-sweep (adaptive-sweep notch-filter 100 1e7 0.1))
+(test-assert (sorted? (car notch-sweep)))
+(test-assert (< (max-interpolation-error notch-filter notch-sweep 100 1e7) 0.1))
+(test-assert (notch-refined? (car notch-sweep)))
+(test-end "refines-notch")
+
+;; A small budget is spent on the worst intervals, not the lowest frequencies.
+(test-begin "point-budget")
+(define budget-sweep (adaptive-sweep notch-filter 100 1e7 0.1 1.0 60))
+(test-assert (<= (f64vector-length (car budget-sweep)) 60))
+(test-assert (sorted? (car budget-sweep)))
+(test-assert (notch-refined? (car budget-sweep)))
+;; The 33-point coarse grid is always evaluated.
+(test-error #t (adaptive-sweep notch-filter 100 1e7 0.1 1.0 32))
+(test-end "point-budget")
+
+;; An open series resistor gives an infinite gain everywhere: nothing to refine.
+(test-begin "open-series")
+(define open-resistor (make-limited-component 'resistor 1000))
+(define open-filter
+  (vector (make-series-filter-stage (make-component-load open-resistor))
+          (make-shunt-filter-stage (component-load 'capacitor 1e-6))))
+(set-component-connected #f open-resistor)
+(test-equal 33 (f64vector-length (car (adaptive-sweep open-filter 100 1e7 0.1))))
+(test-end "open-series")
+
+(test-end "adaptive-sweep-test")
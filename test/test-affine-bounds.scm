@@ -0,0 +1,165 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-1)
+             (srfi srfi-4)
+             (srfi srfi-4 gnu)
+             (srfi srfi-64))
+
+(test-begin "affine-bounds-test")
+
+(define resistor 
+  (make-component 'resistor 
+                  (nearest-preferred-value 1000) 
+                  (floor-preferred-value 10) 
+                  (ceiling-preferred-value 10000)))
+(define capacitor 
+  (make-component 'capacitor 
+                  (nearest-preferred-value 1e-7) 
+                  (floor-preferred-value 1e-9) 
+                  (ceiling-preferred-value 1e-5)))
+(define stages 
+  (vector (make-series-filter-stage (make-component-load resistor)) 
+          (make-shunt-filter-stage (make-component-load capacitor))))
+(define frequencies (vector 100.0 10000.0 1000000.0))
+
+(test-begin "enclosure")
+(define bounds (response-bounds stages frequencies 0.05))
+(define nominal (batch-voltage-gains (vector stages) frequencies))
+(do ((i 0 (+ i 1))) ((= i 3))
+  (let ((gain-magnitude (magnitude (c64vector-ref nominal i))))
+    (test-assert (<= (f64vector-ref (assq-ref bounds 'magnitude-min) i) gain-magnitude))
+    (test-assert (>= (f64vector-ref (assq-ref bounds 'magnitude-max) i) gain-magnitude))))
+(test-end "enclosure")
+
+(test-begin "zero-tolerance")
+(define exact (response-bounds stages frequencies (vector 0.0 0.0)))
+(test-approximate (f64vector-ref (assq-ref exact 'magnitude-min) 1) 
+                  (f64vector-ref (assq-ref exact 'magnitude-max) 1) 
+                  1e-9)
+(test-end "zero-tolerance")
+
+(define (component-value component)
+  (evaluate-preferred-value (get-component-value component)))
+
+(define (limited-component type value)
+  (make-component type 
+                  (nearest-preferred-value value) 
+                  (floor-preferred-value (/ value 100)) 
+                  (ceiling-preferred-value (* value 100))))
+
+(define ladder-inductor (limited-component 'inductor 1e-3))
+(define ladder-capacitor (limited-component 'capacitor 1e-7))
+(define ladder-resistor (limited-component 'resistor 1000))
+(define load-resistor (limited-component 'resistor 10000))
+(define load-capacitor (limited-component 'capacitor 1e-8))
+(define ladder-components 
+  (list ladder-inductor ladder-capacitor ladder-resistor load-resistor load-capacitor))
+(define ladder 
+  (vector (make-series-filter-stage (make-component-load ladder-inductor)) 
+          (make-shunt-filter-stage (make-component-load ladder-capacitor)) 
+          (make-series-filter-stage (make-component-load ladder-resistor)) 
+          (make-shunt-filter-stage 
+            (make-parallel-load (vector (make-component-load load-resistor) 
+                                        (make-component-load load-capacitor))))))
+(define ladder-frequencies 
+  (let ((frequencies (make-vector 13)))
+    (do ((i 0 (+ i 1))) ((= i 13) frequencies)
+      (vector-set! frequencies i (expt 10.0 (+ 3 (/ i 3.0)))))))
+(define ladder-tolerance 0.05)
+
+;; The ladder's gain, the first element of its ABCD cascade, with the
+;; components (in stage order) at the given values.
+(define (ladder-gain values w)
+  (let* ((inductor (list-ref values 0))
+         (capacitor (list-ref values 1))
+         (resistor (list-ref values 2))
+         (load (/ 1 (+ (/ 1 (list-ref values 3)) (* +i w (list-ref values 4)))))
+         (stages (list (list 'series (* +i w inductor)) 
+                       (list 'shunt (/ 1 (* +i w capacitor))) 
+                       (list 'series resistor) 
+                       (list 'shunt load))))
+    (let loop ((stages stages) (a11 1) (a12 0))
+      (if (null? stages)
+          a11
+          (let ((impedance (cadar stages)))
+            (if (eq? (caar stages) 'series)
+                (loop (cdr stages) a11 (+ (* a11 impedance) a12))
+                (loop (cdr stages) (+ a11 (/ a12 impedance)) a12)))))))
+
+;; Each component at value * (1 + tolerance * e) for e in [-1, 1].
+(define (perturbed-values offsets)
+  (map (lambda (component offset) 
+         (* (component-value component) (+ 1 (* ladder-tolerance offset))))
+       ladder-components 
+       offsets))
+
+(define (corner-offsets index)
+  (map (lambda (bit) (if (logbit? bit index) 1 -1)) (iota (length ladder-components))))
+
+(define (random-offsets state)
+  (map (lambda (component) (- (* 2 (random:uniform state)) 1)) ladder-components))
+
+(define ladder-bounds (response-bounds ladder ladder-frequencies ladder-tolerance))
+
+(define (within-bounds? offsets)
+  (let loop ((i 0))
+    (or (= i (vector-length ladder-frequencies))
+        (let* ((gain (ladder-gain (perturbed-values offsets) (vector-ref ladder-frequencies i)))
+               (slack (* 1e-12 (magnitude gain))))
+          (define (inside? low high value)
+            (and (<= (- (f64vector-ref (assq-ref ladder-bounds low) i) slack) value)
+                 (<= value (+ (f64vector-ref (assq-ref ladder-bounds high) i) slack))))
+          (and (inside? 'real-min 'real-max (real-part gain))
+               (inside? 'imaginary-min 'imaginary-max (imag-part gain))
+               (inside? 'magnitude-min 'magnitude-max (magnitude gain))
+               (loop (+ i 1)))))))
+
+(test-begin "perturbed-enclosure")
+(test-assert (within-bounds? (map (lambda (component) 0) ladder-components)))
+(define corner-failures 0)
+(do ((index 0 (+ index 1))) ((= index (expt 2 (length ladder-components))))
+  (unless (within-bounds? (corner-offsets index))
+    (set! corner-failures (+ corner-failures 1))))
+(test-equal 0 corner-failures)
+(define sample-state (seed->random-state 41))
+(define sample-failures 0)
+(do ((i 0 (+ i 1))) ((= i 500))
+  (unless (within-bounds? (random-offsets sample-state))
+    (set! sample-failures (+ sample-failures 1))))
+(test-equal 0 sample-failures)
+(test-end "perturbed-enclosure")
+
+;; The Scheme model agrees with the library at the nominal values.
+(test-begin "nominal-model")
+(define ladder-nominal (batch-voltage-gains (vector ladder) ladder-frequencies))
+(do ((i 0 (+ i 1))) ((= i (vector-length ladder-frequencies)))
+  (let ((gain (c64vector-ref ladder-nominal i)))
+    (test-approximate 0 
+                      (/ (magnitude (- gain (ladder-gain (map component-value ladder-components) 
+                                                         (vector-ref ladder-frequencies i)))) 
+                         (magnitude gain)) 
+                      1e-12)))
+(test-end "nominal-model")
+
+;; A leading shunt multiplies a12 = 0 by its admittance, which is unbounded
+;; for a series LC near resonance; the product must stay 0, not NaN.
+(test-begin "shunt-first")
+(define shunt-first
+  (vector (make-shunt-filter-stage
+            (make-series-load (vector (make-component-load (limited-component 'inductor 1e-3))
+                                      (make-component-load (limited-component 'capacitor 1e-6)))))
+          (make-series-filter-stage (make-component-load (limited-component 'resistor 1000)))
+          (make-shunt-filter-stage (make-component-load (limited-component 'capacitor 1e-7)))))
+(define shunt-frequencies (vector (/ 1 (sqrt (* 1e-3 1e-6))) 1e3 1e5))
+(define shunt-bounds (response-bounds shunt-first shunt-frequencies 0.05))
+(define shunt-nominal (batch-voltage-gains (vector shunt-first) shunt-frequencies))
+(do ((i 0 (+ i 1))) ((= i 3))
+  (let ((gain (c64vector-ref shunt-nominal i)))
+    (define (bound name) (f64vector-ref (assq-ref shunt-bounds name) i))
+    (test-assert (not (any nan? (map bound '(real-min real-max imaginary-min imaginary-max
+                                             magnitude-min magnitude-max)))))
+    (test-assert (<= (bound 'real-min) (real-part gain) (bound 'real-max)))
+    (test-assert (<= (bound 'imaginary-min) (imag-part gain) (bound 'imaginary-max)))
+    (test-assert (<= (bound 'magnitude-min) (magnitude gain) (bound 'magnitude-max)))))
+(test-end "shunt-first")
+
+(test-end "affine-bounds-test")
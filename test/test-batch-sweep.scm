@@ -0,0 +1,55 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-4 gnu)
+             (srfi srfi-64))
+
+(test-begin "batch-sweep-test")
+
+(define (make-limited-component type value)
+  (make-component type 
+                  (nearest-preferred-value value) 
+                  (floor-preferred-value (/ value 100)) 
+                  (ceiling-preferred-value (* value 100))))
+
+(define (component-load type value)
+  (make-component-load (make-limited-component type value)))
+
+(define (make-candidate scale)
+  (vector (make-series-filter-stage 
+            (make-parallel-load 
+              (vector (component-load 'resistor (* scale 1000)) 
+                      (make-series-load 
+                        (vector (component-load 'inductor (* scale 0.01)) 
+                                (component-load 'capacitor 1e-7)))))) 
+          (make-shunt-filter-stage (component-load 'capacitor (* scale 2.2e-7))) 
+          (make-series-filter-stage (component-load 'resistor 470)) 
+          (make-shunt-filter-stage 
+            (make-parallel-load 
+              (vector (component-load 'inductor 0.1) (component-load 'resistor (* scale 10000)))))))
+
+(define candidates (vector (make-candidate 1) (make-candidate 3.3) (make-candidate 0.47)))
+
+;; More than one 64-point frequency tile, with a partial last tile.
+(define frequency-count 150)
+(define frequencies 
+  (let ((frequencies (make-vector frequency-count)))
+    (do ((i 0 (+ i 1))) ((= i frequency-count) frequencies)
+      (vector-set! frequencies i (expt 10.0 (+ 1 (* 6.0 (/ i frequency-count))))))))
+
+(test-begin "matches-scalar-path")
+(define gains (batch-voltage-gains candidates frequencies))
+(test-equal (* (vector-length candidates) frequency-count) (c64vector-length gains))
+(define mismatches 0)
+(do ((m 0 (+ m 1))) ((= m (vector-length candidates)))
+  (do ((f 0 (+ f 1))) ((= f frequency-count))
+    (unless (equal? (filter_voltage_gain (vector-ref frequencies f) (vector-ref candidates m)) 
+                    (c64vector-ref gains (+ (* m frequency-count) f)))
+      (set! mismatches (+ mismatches 1)))))
+(test-equal 0 mismatches)
+(test-end "matches-scalar-path")
+
+(test-begin "empty-inputs")
+(test-equal 0 (c64vector-length (batch-voltage-gains (vector) frequencies)))
+(test-equal 0 (c64vector-length (batch-voltage-gains candidates (vector))))
+(test-end "empty-inputs")
+
+(test-end "batch-sweep-test")
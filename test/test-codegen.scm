@@ -0,0 +1,86 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (ice-9 ftw)
+             (srfi srfi-1)
+             (srfi srfi-4 gnu)
+             (srfi srfi-64))
+
+(test-begin "codegen-test")
+
+;; Keep compiled kernels out of the user's cache.
+(define cache-directory
+  (string-append (or (getenv "TMPDIR") "/tmp") 
+                 "/filtopt-kernels-" 
+                 (number->string (getpid))))
+(setenv "FILTOPT_KERNEL_CACHE" cache-directory)
+
+(define resistor 
+  (make-component 'resistor 
+                  (nearest-preferred-value 1000) 
+                  (floor-preferred-value 10) 
+                  (ceiling-preferred-value 10000)))
+(define inductor 
+  (make-component 'inductor 
+                  (nearest-preferred-value 1e-3) 
+                  (floor-preferred-value 1e-6) 
+                  (ceiling-preferred-value 1e-1)))
+(define capacitor 
+  (make-component 'capacitor 
+                  (nearest-preferred-value 1e-7) 
+                  (floor-preferred-value 1e-9) 
+                  (ceiling-preferred-value 1e-5)))
+(define stages 
+  (vector (make-series-filter-stage 
+            (make-parallel-load (vector (make-component-load resistor) 
+                                        (make-component-load inductor)))) 
+          (make-shunt-filter-stage (make-component-load capacitor))))
+(define target (make-response-target (vector 10.0 1000.0 100000.0) (vector 1.0 0.5 0.1)))
+
+(test-begin "compiled")
+(define kernel (compile-filter-kernel stages))
+(test-assert (filter-kernel-compiled? kernel))
+(test-assert (any (lambda (name) (string-suffix? ".so" name)) 
+                  (scandir cache-directory)))
+(test-assert (filter-kernel-compiled? (compile-filter-kernel stages)))
+(test-end "compiled")
+
+;; Same arithmetic as the flat path without contraction, so costs are identical.
+(test-begin "kernel-cost")
+(test-equal (filter-cost stages target) (kernel-filter-cost kernel stages target))
+(increment-preferred-value (get-component-value capacitor))
+(test-equal (filter-cost stages target) (kernel-filter-cost kernel stages target))
+(set-component-connected #f inductor)
+(test-equal (filter-cost stages target) (kernel-filter-cost kernel stages target))
+(set-component-connected #t inductor)
+(test-end "kernel-cost")
+
+;; More than one frequency chunk, with a partial last one.
+(test-begin "kernel-voltage-gains")
+(define frequencies 
+  (let ((frequencies (make-vector 150)))
+    (do ((i 0 (+ i 1))) ((= i 150) frequencies)
+      (vector-set! frequencies i (expt 10.0 (+ 1 (* 6.0 (/ i 150))))))))
+(define kernel-gains (kernel-voltage-gains kernel stages frequencies))
+(define flat-gains (batch-voltage-gains (vector stages) frequencies))
+(test-equal 150 (c64vector-length kernel-gains))
+(define mismatches 0)
+(do ((i 0 (+ i 1))) ((= i 150))
+  (unless (= (magnitude (c64vector-ref kernel-gains i)) 
+             (magnitude (c64vector-ref flat-gains i)))
+    (set! mismatches (+ mismatches 1))))
+(test-equal 0 mismatches)
+(test-end "kernel-voltage-gains")
+
+(test-begin "topology-mismatch")
+(define other-stages 
+  (vector (make-shunt-filter-stage (make-component-load capacitor))))
+(test-error #t (kernel-voltage-gains kernel other-stages frequencies))
+(test-error #t (kernel-filter-cost kernel other-stages target))
+(test-end "topology-mismatch")
+
+(for-each (lambda (name) 
+            (unless (member name '("." ".."))
+              (delete-file (string-append cache-directory "/" name))))
+          (or (scandir cache-directory) '()))
+(rmdir cache-directory)
+
+(test-end "codegen-test")
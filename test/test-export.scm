@@ -0,0 +1,46 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (ice-9 rdelim)
+             (srfi srfi-64))
+
+(test-begin "export-test")
+
+(define resistor 
+  (make-component 'resistor 
+                  (nearest-preferred-value 100) 
+                  (floor-preferred-value 10) 
+                  (ceiling-preferred-value 10000)))
+(define stages (vector (make-series-filter-stage (make-component-load resistor))))
+(define frequencies (vector 6.283185307179586 62.83185307179586))
+
+(define (file-lines path)
+  (call-with-input-file path
+    (lambda (port)
+      (let loop ((lines '()))
+        (let ((line (read-line port)))
+          (if (eof-object? line) 
+              (reverse lines) 
+              (loop (cons line lines))))))))
+
+(test-begin "touchstone")
+(define touchstone-path (string-append (tmpnam) ".s2p"))
+(export-touchstone (vector stages) frequencies 50.0 (vector touchstone-path))
+(define touchstone-lines (file-lines touchstone-path))
+(test-equal 4 (length touchstone-lines))
+(define first-point (map string->number (string-split (caddr touchstone-lines) #\space)))
+(test-approximate 1.0 (car first-point) 1e-6)
+(test-approximate 0.5 (cadr first-point) 1e-8)
+(test-approximate 0.5 (list-ref first-point 3) 1e-8)
+(delete-file touchstone-path)
+(test-end "touchstone")
+
+(test-begin "csv")
+(define csv-path (tmpnam))
+(export-csv (vector stages stages) frequencies csv-path)
+(define csv-lines (file-lines csv-path))
+(test-equal 5 (length csv-lines))
+(test-equal "candidate,frequency_hz,real,imaginary,magnitude_db" (car csv-lines))
+(test-equal "1" (car (string-split (list-ref csv-lines 4) #\,)))
+(delete-file csv-path)
+(test-end "csv")
+
+(test-end "export-test")
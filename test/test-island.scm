@@ -0,0 +1,29 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-64))
+
+(test-begin "island-test")
+
+(define resistor 
+  (make-component 'resistor 
+                  (nearest-preferred-value 1000) 
+                  (floor-preferred-value 10) 
+                  (ceiling-preferred-value 10000)))
+(define capacitor 
+  (make-component 'capacitor 
+                  (nearest-preferred-value 1e-7) 
+                  (floor-preferred-value 1e-9) 
+                  (ceiling-preferred-value 1e-5)))
+(define stages 
+  (vector (make-series-filter-stage (make-component-load resistor)) 
+          (make-shunt-filter-stage (make-component-load capacitor))))
+(define target (make-response-target (vector 10.0 100.0 1000.0) (vector 1.0 0.8 0.2)))
+(define initial-cost (filter-cost stages target))
+
+(test-begin "search")
+(define result (island-search stages target 3 500 50 7))
+(test-assert (<= (assq-ref result 'cost) initial-cost))
+(test-approximate (assq-ref result 'cost) (filter-cost stages target) 1e-9)
+(test-assert (< (assq-ref result 'island) 3))
+(test-end "search")
+
+(test-end "island-test")
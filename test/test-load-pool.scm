@@ -0,0 +1,85 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-4 gnu)
+             (srfi srfi-64))
+
+(test-begin "load-pool-test")
+
+(define range-floor (floor-preferred-value 2.5))
+(define range-ceil (ceiling-preferred-value 420))
+
+(define (make-resistor-load value)
+  (make-component-load 
+    (make-component 'resistor (nearest-preferred-value value) range-floor range-ceil)))
+
+(define frequencies (vector 10.0 100.0))
+(define pool (make-load-pool frequencies))
+
+(define filter-a 
+  (vector (make-series-filter-stage 
+            (make-parallel-load (vector (make-resistor-load 100) (make-resistor-load 100))))))
+(define filter-b 
+  (vector (make-series-filter-stage 
+            (make-parallel-load (vector (make-resistor-load 100) (make-resistor-load 100))))
+          (make-shunt-filter-stage (make-resistor-load 220))))
+
+(test-begin "shared-subtrees")
+(define pooled-a (load-pool-intern pool filter-a))
+(test-equal 2 (load-pool-size pool))
+(define pooled-b (load-pool-intern pool filter-b))
+(test-equal 3 (load-pool-size pool))
+(test-end "shared-subtrees")
+
+(test-begin "pooled-gains")
+(define gains (pooled-voltage-gains (vector pooled-a pooled-b)))
+(test-equal 4 (c64vector-length gains))
+(test-equal (filter_voltage_gain 10.0 filter-a) (c64vector-ref gains 0))
+(test-equal (filter_voltage_gain 100.0 filter-b) (c64vector-ref gains 3))
+(test-end "pooled-gains")
+
+(test-begin "reference-counting")
+(load-pool-release! pooled-a)
+(test-equal 3 (load-pool-size pool))
+(load-pool-release! pooled-b)
+(test-equal 0 (load-pool-size pool))
+(test-error #t (load-pool-release! pooled-a))
+(test-error #t (pooled-voltage-gains (vector pooled-b)))
+(define pooled-again (load-pool-intern pool filter-b))
+(test-equal 3 (load-pool-size pool))
+(load-pool-release! pooled-again)
+(test-equal 0 (load-pool-size pool))
+(test-end "reference-counting")
+
+;; Best effort: a conservative collector may keep the dropped filter alive
+;; through a stale stack word, so the check is skipped unless the weak
+;; reference shows that it was collected.
+(test-begin "finalized-filters")
+(define dropped (make-weak-vector 1 #f))
+(define (intern-and-drop)
+  (weak-vector-set! dropped 0 (load-pool-intern pool filter-b))
+  (load-pool-size pool))
+(test-equal 3 (intern-and-drop))
+(define (collected? attempts)
+  (gc)
+  (or (not (weak-vector-ref dropped 0))
+      (and (> attempts 0) (collected? (- attempts 1)))))
+(define (finalized-size attempts)
+  (gc)
+  (let ((size (load-pool-size pool)))
+    (if (or (= size 0) (= attempts 0))
+        size
+        (begin (usleep 10000) (finalized-size (- attempts 1))))))
+(unless (collected? 10)
+  (test-skip 1))
+(test-equal "finalizer-releases" 0 (finalized-size 500))
+(test-end "finalized-filters")
+
+(test-begin "argument-checks")
+(test-error #t (pooled-voltage-gains (vector 1)))
+(test-error #t (pooled-voltage-gains (vector filter-a)))
+;; A fresh pool, since the dropped filter above may still be finalized later.
+(define checked-pool (make-load-pool frequencies))
+(test-error #t (load-pool-intern checked-pool (vector 1)))
+(test-equal 0 (load-pool-size checked-pool))
+(test-end "argument-checks")
+
+(test-end "load-pool-test")
@@ -0,0 +1,86 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-64))
+
+(test-begin "neighborhood-test")
+
+(define (make-limited-component type value)
+  (make-component type
+                  (nearest-preferred-value value)
+                  (floor-preferred-value (/ value 10))
+                  (ceiling-preferred-value (* value 10))))
+
+(define (component-load type value)
+  (make-component-load (make-limited-component type value)))
+
+;; Component 0 sits at its upper limit.
+(define edge-resistor
+  (make-component 'resistor
+                  (nearest-preferred-value 1000)
+                  (floor-preferred-value 100)
+                  (ceiling-preferred-value 1000)))
+
+(define stages
+  (vector (make-series-filter-stage
+            (make-parallel-load
+              (vector (make-component-load edge-resistor)
+                      (make-series-load
+                        (vector (component-load 'inductor 0.01)
+                                (component-load 'capacitor 1e-7))))))
+          (make-shunt-filter-stage (component-load 'capacitor 2.2e-7))
+          (make-series-filter-stage (component-load 'resistor 470))
+          (make-shunt-filter-stage
+            (make-parallel-load
+              (vector (component-load 'inductor 0.1) (component-load 'resistor 10000))))))
+
+(define frequencies
+  (let ((frequencies (make-vector 50)))
+    (do ((i 0 (+ i 1))) ((= i 50) frequencies)
+      (vector-set! frequencies i (expt 10.0 (+ 1 (* 6.0 (/ i 50))))))))
+(define target (make-response-target frequencies (make-vector 50 1.0)))
+
+(define (undo change)
+  (if (eq? change 'toggle) 'toggle (- change)))
+
+;; Each scanned cost is the cost of the full cascade after applying the
+;; move, up to the rounding of the reassociated products.
+(test-begin "matches-full-cascade")
+(define moves (scan-neighborhood stages target 3))
+(define worst-error 0)
+(do ((i 0 (+ i 1))) ((= i (vector-length moves)))
+  (let* ((move (vector-ref moves i))
+         (cost (car move))
+         (component (cadr move))
+         (change (caddr move)))
+    (apply-neighbor-move! stages component change)
+    (let ((full-cost (filter-cost stages target)))
+      ;; An open series component gives an infinite (or NaN) cost both ways.
+      (unless (or (= cost full-cost) (and (nan? cost) (nan? full-cost)))
+        (set! worst-error
+          (max worst-error (/ (abs (- cost full-cost)) (max 1 (abs full-cost)))))))
+    (apply-neighbor-move! stages component (undo change))))
+(test-assert (> (vector-length moves) 20))
+(test-assert (< worst-error 1e-12))
+(test-end "matches-full-cascade")
+
+(test-begin "sorted")
+(define sorted #t)
+(do ((i 1 (+ i 1))) ((= i (vector-length moves)))
+  (when (< (car (vector-ref moves i)) (car (vector-ref moves (- i 1))))
+    (set! sorted #f)))
+(test-assert sorted)
+(test-end "sorted")
+
+(define (edge-value)
+  (evaluate-preferred-value (get-component-value edge-resistor)))
+
+(test-begin "limits")
+(define upper-value (edge-value))
+(test-error #t (apply-neighbor-move! stages 0 1))
+(test-equal upper-value (edge-value))
+(apply-neighbor-move! stages 0 -1)
+(test-assert (< (edge-value) upper-value))
+(test-error #t (apply-neighbor-move! stages 0 -100))
+(test-error #t (apply-neighbor-move! stages 99 1))
+(test-end "limits")
+
+(test-end "neighborhood-test")
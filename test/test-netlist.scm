@@ -0,0 +1,86 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (rnrs bytevectors)
+             (srfi srfi-64))
+
+(test-begin "netlist-test")
+
+(define (make-limited-component type value)
+  (make-component type 
+                  (nearest-preferred-value value) 
+                  (floor-preferred-value (/ value 100)) 
+                  (ceiling-preferred-value (* value 100))))
+
+(define target (make-response-target (vector 10.0 100.0 1000.0 10000.0) (vector 1.0 1.0 0.5 0.1)))
+(define hand-built 
+  (vector (make-series-filter-stage (make-component-load (make-limited-component 'resistor 1000))) 
+          (make-shunt-filter-stage 
+            (make-parallel-load 
+              (vector (make-component-load (make-limited-component 'capacitor 1e-7)) 
+                      (make-component-load (make-limited-component 'inductor 0.1)))))))
+(define description 
+  '((series (resistor 1000 10 100000)) 
+    (shunt (parallel (capacitor 1e-7 1e-9 1e-5) (inductor 0.1 1e-3 10)))))
+
+(test-begin "build")
+(define built (build-filters (list description description)))
+(test-equal 2 (vector-length built))
+(test-equal 2 (vector-length (vector-ref built 0)))
+(test-approximate (filter-cost hand-built target) (filter-cost (vector-ref built 0) target) 1e-12)
+(define disconnected 
+  (make-component 'resistor 
+                  (nearest-preferred-value 1000) 
+                  (floor-preferred-value 10) 
+                  (ceiling-preferred-value 100000) 
+                  #f))
+(test-equal (encode-filters (vector (vector (make-series-filter-stage (make-component-load disconnected)))))
+            (encode-filters (build-filters (vector '((series (resistor 1000 10 100000 #f)))))))
+(test-error #t (build-filters '(((series (transistor 1 1 1))))))
+(test-error #t (build-filters '(((series (resistor -1 1 1))))))
+(test-end "build")
+
+(test-begin "limits")
+(test-error #t (build-filters '(((series (resistor 5 10 100))))))
+(test-error #t (build-filters '(((series (resistor 1000 10 100))))))
+(test-error #t (build-filters '(((series (resistor 1000 10 1.7e308))))))
+(test-error #t (build-filters '(((series (resistor 1000 1e-320 1e5))))))
+(test-end "limits")
+
+(test-begin "bytevector")
+(define encoded (encode-filters (vector hand-built)))
+(test-equal (string->utf8 "FLT1") (let ((magic (make-bytevector 4))) 
+                                    (bytevector-copy! encoded 0 magic 0 4) 
+                                    magic))
+(define decoded (decode-filters encoded))
+(test-equal 1 (vector-length decoded))
+(test-approximate (filter-cost hand-built target) (filter-cost (vector-ref decoded 0) target) 1e-12)
+(test-equal encoded (encode-filters decoded))
+(test-error #t (decode-filters (make-bytevector 3 0)))
+(let ((truncated (make-bytevector (- (bytevector-length encoded) 1))))
+  (bytevector-copy! encoded 0 truncated 0 (bytevector-length truncated))
+  (test-error #t (decode-filters truncated)))
+(test-end "bytevector")
+
+;; One filter of one series stage holding one resistor with the given ranks.
+(define (encoded-resistor value-rank lower-rank upper-rank)
+  (let ((bytes (make-bytevector 21 0)))
+    (bytevector-copy! (string->utf8 "FLT1") 0 bytes 0 4)
+    (bytevector-u32-set! bytes 4 1 (endianness little))
+    (bytevector-u32-set! bytes 8 1 (endianness little))
+    (bytevector-u8-set! bytes 12 0)
+    (bytevector-u8-set! bytes 13 0)
+    (bytevector-s16-set! bytes 14 value-rank (endianness little))
+    (bytevector-s16-set! bytes 16 lower-rank (endianness little))
+    (bytevector-s16-set! bytes 18 upper-rank (endianness little))
+    (bytevector-u8-set! bytes 20 1)
+    bytes))
+
+(test-begin "bytevector-limits")
+(define resistor-1000 (decode-filters (encoded-resistor 72 24 120)))
+(test-equal (encoded-resistor 72 24 120) (encode-filters resistor-1000))
+(test-error #t (decode-filters (encoded-resistor 20 24 120)))
+(test-error #t (decode-filters (encoded-resistor 121 24 120)))
+(test-error #t (decode-filters (encoded-resistor 72 24 32000)))
+(test-error #t (decode-filters (encoded-resistor -32000 -32000 120)))
+(test-end "bytevector-limits")
+
+(test-end "netlist-test")
@@ -0,0 +1,99 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-4 gnu)
+             (srfi srfi-64))
+
+(test-begin "nodal-test")
+
+(define (make-limited-component type value)
+  (make-component type 
+                  (nearest-preferred-value value) 
+                  (floor-preferred-value (/ value 100)) 
+                  (ceiling-preferred-value (* value 100))))
+
+(define resistor (make-limited-component 'resistor 1000))
+(define capacitor (make-limited-component 'capacitor 1e-7))
+(define target (make-response-target (vector 10.0 100.0 1000.0 10000.0) (vector 1.0 1.0 0.5 0.1)))
+
+(test-begin "ladder-equivalence")
+(define stages 
+  (vector (make-series-filter-stage (make-component-load resistor)) 
+          (make-shunt-filter-stage (make-component-load capacitor))))
+(define circuit (make-nodal-circuit (list (list 1 2 resistor) (list 2 0 capacitor)) 1 2))
+(test-approximate (filter-cost stages target) (nodal-filter-cost circuit target) 1e-9)
+(increment-preferred-value (get-component-value resistor))
+(test-approximate (filter-cost stages target) (nodal-filter-cost circuit target) 1e-9)
+(test-end "ladder-equivalence")
+
+;; Three unknowns in a chain: off-diagonal stamps, elimination updates
+;; and both substitution passes all take part.
+(test-begin "rc-ladder")
+(define ladder-components
+  (list (make-limited-component 'resistor 1000) (make-limited-component 'capacitor 1e-7)
+        (make-limited-component 'resistor 470) (make-limited-component 'capacitor 2.2e-8)
+        (make-limited-component 'resistor 2200) (make-limited-component 'capacitor 4.7e-9)))
+(define (ladder-stages components)
+  (if (null? components)
+      '()
+      (cons* (make-series-filter-stage (make-component-load (car components)))
+             (make-shunt-filter-stage (make-component-load (cadr components)))
+             (ladder-stages (cddr components)))))
+(define rc-stages (list->vector (ladder-stages ladder-components)))
+(define rc-circuit
+  (make-nodal-circuit
+    (map (lambda (nodes component) (append nodes (list component)))
+         '((1 2) (2 0) (2 3) (3 0) (3 4) (4 0))
+         ladder-components)
+    1
+    4))
+(test-equal 3 (assq-ref (nodal-circuit-statistics rc-circuit) 'unknowns))
+(test-approximate (filter-cost rc-stages target) (nodal-filter-cost rc-circuit target) 1e-9)
+(increment-preferred-value (get-component-value (list-ref ladder-components 2)))
+(decrement-preferred-value (get-component-value (list-ref ladder-components 5)))
+(test-approximate (filter-cost rc-stages target) (nodal-filter-cost rc-circuit target) 1e-9)
+(define rc-frequencies (vector 10.0 1000.0 31622.0 1e6))
+(define rc-gains (nodal-voltage-gains rc-circuit rc-frequencies))
+(do ((i 0 (+ i 1))) ((= i 4))
+  (let ((expected (filter_voltage_gain (vector-ref rc-frequencies i) rc-stages)))
+    (test-assert (< (magnitude (- (c64vector-ref rc-gains i) expected))
+                    (* 1e-12 (magnitude expected))))))
+(test-end "rc-ladder")
+
+;; Not a ladder: the bridging capacitor couples input and output directly.
+(test-begin "bridged-t")
+(define bridge-r1 (make-limited-component 'resistor 1000))
+(define bridge-r2 (make-limited-component 'resistor 2200))
+(define bridge-c1 (make-limited-component 'capacitor 1e-8))
+(define bridge-c2 (make-limited-component 'capacitor 2.2e-8))
+(define bridged-t 
+  (make-nodal-circuit 
+    (list (list 1 3 bridge-r1) 
+          (list 3 2 bridge-r2) 
+          (list 1 2 bridge-c1) 
+          (list 3 0 bridge-c2))
+    1 
+    2))
+(test-equal 2 (assq-ref (nodal-circuit-statistics bridged-t) 'unknowns))
+(define (component-value component)
+  (evaluate-preferred-value (get-component-value component)))
+;; Vout/Vin = (G1 G2 + Y1 S) / (G1 G2 + G2 Y2 + Y1 S), S = G1 + G2 + Y2.
+(define (bridged-t-transfer angular-frequency)
+  (let* ((s (make-rectangular 0 angular-frequency))
+         (g1 (/ 1 (component-value bridge-r1)))
+         (g2 (/ 1 (component-value bridge-r2)))
+         (y1 (* s (component-value bridge-c1)))
+         (y2 (* s (component-value bridge-c2)))
+         (sum (+ g1 g2 y2)))
+    (/ (+ (* g1 g2) (* y1 sum))
+       (+ (* g1 g2) (* g2 y2) (* y1 sum)))))
+(define bridge-frequencies (vector 10.0 1e4 4.5e4 1e5 1e7))
+(define bridge-gains (nodal-voltage-gains bridged-t bridge-frequencies))
+(test-equal 5 (c64vector-length bridge-gains))
+(do ((i 0 (+ i 1))) ((= i 5))
+  ;; The nodal gain is Vin/Vout, the inverse of the transfer function.
+  (test-assert (< (magnitude (- (* (c64vector-ref bridge-gains i)
+                                   (bridged-t-transfer (vector-ref bridge-frequencies i)))
+                                1))
+                  1e-12)))
+(test-end "bridged-t")
+
+(test-end "nodal-test")
@@ -0,0 +1,66 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-64))
+
+(test-begin "pareto-archive-test")
+
+(define range-floor (floor-preferred-value 2.5))
+(define range-ceil (ceiling-preferred-value 420))
+(define resistor (make-component 'resistor (nearest-preferred-value 100) range-floor range-ceil))
+(define stages (vector (make-series-filter-stage (make-component-load resistor))))
+(define original-value (evaluate-preferred-value (get-component-value resistor)))
+
+(test-begin "dominance")
+(define archive (make-pareto-archive stages 2 10))
+(test-assert (pareto-archive-insert! archive stages #(2.0 2.0)))
+(test-assert (not (pareto-archive-insert! archive stages #(3.0 2.0))))
+(test-assert (not (pareto-archive-insert! archive stages #(2.0 2.0))))
+(test-assert (pareto-archive-insert! archive stages #(1.0 3.0)))
+(test-equal 2 (pareto-archive-size archive))
+(test-assert (pareto-archive-insert! archive stages #(0.5 1.0)))
+(test-equal 1 (pareto-archive-size archive))
+(test-assert (pareto-archive-dominated? archive #(0.6 1.0)))
+(test-assert (not (pareto-archive-dominated? archive #(0.4 5.0))))
+(test-end "dominance")
+
+(test-begin "staircase")
+(define staircase (make-pareto-archive stages 2 100))
+(do ((i 0 (+ i 1))) ((= i 10))
+  (pareto-archive-insert! staircase stages (vector i (- 10 i))))
+(test-equal 10 (pareto-archive-size staircase))
+;; Dominates exactly #(3 7) and #(4 6).
+(test-assert (pareto-archive-insert! staircase stages #(2.5 5.5)))
+(test-equal 9 (pareto-archive-size staircase))
+(test-equal #(2.5 5.5) (pareto-archive-objectives staircase 3))
+(test-equal #(5.0 5.0) (pareto-archive-objectives staircase 4))
+(test-assert (pareto-archive-dominated? staircase #(3.0 7.5)))
+(test-assert (not (pareto-archive-dominated? staircase #(2.4 7.9))))
+(test-assert (pareto-archive-dominated? staircase #(-0.0 10.0)))
+(test-end "staircase")
+
+(test-begin "three-objectives")
+(define cube (make-pareto-archive stages 3 100))
+(test-assert (pareto-archive-insert! cube stages #(0.0 1.0 2.0)))
+(test-assert (not (pareto-archive-insert! cube stages #(-0.0 1.0 2.0))))
+(test-assert (pareto-archive-insert! cube stages #(1.0 0.0 2.0)))
+(test-assert (pareto-archive-insert! cube stages #(0.5 0.5 0.5)))
+(test-equal 3 (pareto-archive-size cube))
+(test-assert (pareto-archive-insert! cube stages #(0.0 0.0 0.0)))
+(test-equal 1 (pareto-archive-size cube))
+(test-end "three-objectives")
+
+(test-begin "restore")
+(increment-preferred-value (get-component-value resistor))
+(pareto-archive-restore! archive 0 stages)
+(test-equal original-value (evaluate-preferred-value (get-component-value resistor)))
+(test-equal #(0.5 1.0) (pareto-archive-objectives archive 0))
+(test-end "restore")
+
+(test-begin "bounded-size")
+(define small-archive (make-pareto-archive stages 2 4))
+(do ((i 0 (+ i 1))) ((= i 8))
+  (pareto-archive-insert! small-archive stages (vector i (- 8 i))))
+(test-assert (<= (pareto-archive-size small-archive) 4))
+(test-equal #(0.0 8.0) (pareto-archive-objectives small-archive 0))
+(test-end "bounded-size")
+
+(test-end "pareto-archive-test")
@@ -0,0 +1,51 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-64))
+
+(test-begin "relaxation-test")
+
+;; The response of a series R, shunt C low-pass only depends on RC, so the
+;; resistor is pinned to one value and only the capacitor is searched.
+(define (make-low-pass capacitor)
+  (vector (make-series-filter-stage 
+            (make-component-load 
+              (make-component 'resistor 
+                              (nearest-preferred-value 1000) 
+                              (floor-preferred-value 1000) 
+                              (ceiling-preferred-value 1000)))) 
+          (make-shunt-filter-stage (make-component-load capacitor))))
+
+(define (make-capacitor value lower upper)
+  (make-component 'capacitor 
+                  (nearest-preferred-value value) 
+                  (floor-preferred-value lower) 
+                  (ceiling-preferred-value upper)))
+
+(define frequencies (vector 100.0 1000.0 3000.0 10000.0 30000.0 100000.0))
+(define (response-magnitudes stages)
+  (list->vector 
+    (map (lambda (frequency) (magnitude (filter_voltage_gain frequency stages))) 
+         (vector->list frequencies))))
+(define target 
+  (make-response-target frequencies (response-magnitudes (make-low-pass (make-capacitor 1e-7 1e-7 1e-7)))))
+
+(test-begin "recovers-preferred-values")
+(define capacitor (make-capacitor 1e-9 1e-10 1e-4))
+(define stages (make-low-pass capacitor))
+(test-assert (> (filter-cost stages target) 1.0))
+(define result (relax-filter-values stages target))
+(test-approximate 0.0 (assq-ref result 'cost) 1e-9)
+(test-approximate (assq-ref result 'cost) (filter-cost stages target) 1e-12)
+(test-approximate 1e-7 (evaluate-preferred-value (get-component-value capacitor)) 1e-12)
+(test-assert (< (assq-ref result 'evaluations) 500))
+(test-end "recovers-preferred-values")
+
+(test-begin "respects-limits")
+(define limited-capacitor (make-capacitor 4.7e-9 4.7e-9 2.2e-8))
+(relax-filter-values (make-low-pass limited-capacitor) target 20 1)
+(test-approximate 
+  (evaluate-preferred-value (get-component-upper-limit limited-capacitor)) 
+  (evaluate-preferred-value (get-component-value limited-capacitor)) 
+  1e-15)
+(test-end "respects-limits")
+
+(test-end "relaxation-test")
@@ -0,0 +1,89 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-64))
+
+(test-begin "screening-test")
+
+(define (make-limited-component type value)
+  (make-component type
+                  (nearest-preferred-value value)
+                  (floor-preferred-value (/ value 100))
+                  (ceiling-preferred-value (* value 100))))
+
+(define (component-load type value)
+  (make-component-load (make-limited-component type value)))
+
+(define* (make-candidate scale #:optional
+                        (series-resistor (make-limited-component 'resistor 470)))
+  (vector (make-series-filter-stage
+            (make-parallel-load
+              (vector (component-load 'resistor (* scale 1000))
+                      (make-series-load
+                        (vector (component-load 'inductor (* scale 0.01))
+                                (component-load 'capacitor 1e-7))))))
+          (make-shunt-filter-stage (component-load 'capacitor (* scale 2.2e-7)))
+          (make-series-filter-stage (make-component-load series-resistor))
+          (make-shunt-filter-stage
+            (make-parallel-load
+              (vector (component-load 'inductor 0.1) (component-load 'resistor (* scale 10000)))))))
+
+(define frequencies
+  (let ((frequencies (make-vector 100)))
+    (do ((i 0 (+ i 1))) ((= i 100) frequencies)
+      (vector-set! frequencies i (expt 10.0 (+ 1 (* 6.0 (/ i 100))))))))
+
+;; The target is the response of one candidate, so costs range from zero,
+;; where single precision can prove nothing, up to far above the threshold.
+(define reference (make-candidate 1))
+(define target
+  (make-response-target
+    frequencies
+    (list->vector
+      (map (lambda (frequency) (magnitude (filter_voltage_gain frequency reference)))
+           (vector->list frequencies)))))
+
+;; An open series resistor: no output at all, so an infinite cost.
+(define open-resistor (make-limited-component 'resistor 470))
+(define open-candidate (make-candidate 1.5 open-resistor))
+(set-component-connected #f open-resistor)
+
+(define candidates
+  (list->vector
+    (append (map make-candidate '(1 1.01 1.05 1.1 1.2 1.5 2 3 0.9 0.8 0.5 0.3 0.1))
+            (list reference open-candidate))))
+(define costs
+  (list->vector
+    (map (lambda (candidate) (filter-cost candidate target)) (vector->list candidates))))
+
+(define (sorted-costs)
+  (let ((finite (filter (lambda (cost) (and (real? cost) (finite? cost))) (vector->list costs))))
+    (list->vector (sort finite <))))
+
+;; Every candidate at or below the threshold survives with exactly its
+;; filter-cost; a rejected candidate's filter-cost is above the threshold.
+(define (screening-agrees? threshold)
+  (let ((screened (screen-filters candidates target threshold)))
+    (let loop ((i 0))
+      (or (= i (vector-length candidates))
+          (let ((cost (vector-ref costs i))
+                (screened-cost (vector-ref screened i)))
+            (and (if screened-cost
+                     (or (equal? cost screened-cost)
+                         (and (nan? cost) (nan? screened-cost)))
+                     (> cost threshold))
+                 (loop (+ i 1))))))))
+
+(test-begin "matches-filter-cost")
+(let ((thresholds (sorted-costs)))
+  (do ((i 0 (+ i 1))) ((= i (vector-length thresholds)))
+    (test-assert (screening-agrees? (vector-ref thresholds i)))
+    (test-assert (screening-agrees? (* (vector-ref thresholds i) (+ 1 1e-12))))))
+(test-assert (screening-agrees? 0))
+(test-end "matches-filter-cost")
+
+(test-begin "rejects-clear-misses")
+(define screened (screen-filters candidates target 1e-3))
+(test-equal 0.0 (vector-ref screened 13))
+(test-equal #f (vector-ref screened 12))
+(test-end "rejects-clear-misses")
+
+(test-end "screening-test")
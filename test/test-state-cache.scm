@@ -0,0 +1,38 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-64))
+
+(test-begin "state-cache-test")
+
+(define range-floor (floor-preferred-value 2.5))
+(define range-ceil (ceiling-preferred-value 420))
+(define resistor (make-component 'resistor (nearest-preferred-value 100) range-floor range-ceil))
+(define stages (vector (make-series-filter-stage (make-component-load resistor))))
+
+(test-begin "hash")
+(define initial-hash (filter-state-hash stages))
+(test-equal initial-hash (filter-state-hash stages))
+(increment-preferred-value (get-component-value resistor))
+(test-assert (not (equal? initial-hash (filter-state-hash stages))))
+(decrement-preferred-value (get-component-value resistor))
+(test-equal initial-hash (filter-state-hash stages))
+(test-end "hash")
+
+(test-begin "lookup")
+(define cache (make-state-cache 2 1))
+(test-equal #f (state-cache-lookup cache stages))
+(state-cache-insert! cache stages 4.5)
+(test-equal 4.5 (state-cache-lookup cache stages))
+(test-assert (state-cache-tabu? cache stages))
+(test-end "lookup")
+
+(test-begin "bounded-size")
+(increment-preferred-value (get-component-value resistor))
+(state-cache-insert! cache stages 1.0)
+(test-assert (not (state-cache-tabu? cache (vector))))
+(increment-preferred-value (get-component-value resistor))
+(state-cache-insert! cache stages 2.0)
+(test-equal 2 (assq-ref (state-cache-statistics cache) 'size))
+(test-equal 1 (assq-ref (state-cache-statistics cache) 'evictions))
+(test-end "bounded-size")
+
+(test-end "state-cache-test")
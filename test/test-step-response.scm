@@ -0,0 +1,31 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-4)
+             (srfi srfi-64))
+
+(test-begin "step-response-test")
+
+(define resistor 
+  (make-component 'resistor 
+                  (nearest-preferred-value 1000) 
+                  (floor-preferred-value 10) 
+                  (ceiling-preferred-value 10000)))
+(define capacitor 
+  (make-component 'capacitor 
+                  (nearest-preferred-value 1e-6) 
+                  (floor-preferred-value 1e-9) 
+                  (ceiling-preferred-value 1e-5)))
+(define stages 
+  (vector (make-series-filter-stage (make-component-load resistor)) 
+          (make-shunt-filter-stage (make-component-load capacitor))))
+
+(test-begin "first-order")
+(define steps (step-response stages 1e5 4096))
+(test-equal 4096 (f64vector-length steps))
+(test-approximate 1.0 (f64vector-ref steps 4095) 1e-3)
+(define metrics (step-response-metrics stages 1e5 4096))
+(test-approximate 0.0 (assq-ref metrics 'overshoot) 1e-3)
+(test-approximate 2.197e-3 (assq-ref metrics 'rise-time) 3e-5)
+(test-approximate 3.91e-3 (assq-ref metrics 'settling-time) 5e-5)
+(test-end "first-order")
+
+(test-end "step-response-test")
@@ -0,0 +1,62 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-64))
+
+(test-begin "surrogate-test")
+
+(define resistor 
+  (make-component 'resistor 
+                  (nearest-preferred-value 1000) 
+                  (floor-preferred-value 10) 
+                  (ceiling-preferred-value 100000)))
+(define shunt-resistor 
+  (make-component 'resistor 
+                  (nearest-preferred-value 1000) 
+                  (floor-preferred-value 10) 
+                  (ceiling-preferred-value 100000)))
+(define stages 
+  (vector (make-series-filter-stage (make-component-load resistor)) 
+          (make-shunt-filter-stage (make-component-load shunt-resistor))))
+(define target (make-response-target (vector 10.0 100.0) (vector 1.0 1.0)))
+
+(test-begin "training")
+(define surrogate (make-surrogate stages 1e-3 2.0 0.5))
+(do ((i 0 (+ i 1))) ((= i 40))
+  (surrogate-filter-cost surrogate stages target 1e6)
+  (increment-preferred-value (get-component-value resistor)))
+(test-equal 40 (assq-ref (surrogate-statistics surrogate) 'evaluated))
+(test-approximate (filter-cost stages target) (surrogate-predict surrogate stages) 
+                  (* 0.5 (filter-cost stages target)))
+(test-end "training")
+
+(test-begin "skipping")
+(define outcome (surrogate-filter-cost surrogate stages target 1.0))
+(define statistics (surrogate-statistics surrogate))
+(test-equal #f outcome)
+(test-equal 1 (assq-ref statistics 'skipped))
+(test-equal (assq-ref statistics 'audited) 
+            (+ (assq-ref statistics 'hits) (assq-ref statistics 'misses)))
+(test-end "skipping")
+
+(test-begin "non-finite-costs")
+(define open-resistor 
+  (make-component 'resistor 
+                  (nearest-preferred-value 1000) 
+                  (floor-preferred-value 10) 
+                  (ceiling-preferred-value 100000)))
+(define open-stages 
+  (vector (make-series-filter-stage (make-component-load open-resistor)) 
+          (make-shunt-filter-stage (make-component-load shunt-resistor))))
+(define guarded (make-surrogate open-stages 1e-3 2.0 0.5))
+(do ((i 0 (+ i 1))) ((= i 10))
+  (surrogate-filter-cost guarded open-stages target 1e6)
+  (increment-preferred-value (get-component-value open-resistor)))
+(set-component-connected #f open-resistor)
+(test-assert (not (finite? (filter-cost open-stages target))))
+(surrogate-filter-cost guarded open-stages target 1e6)
+(surrogate-train! guarded open-stages +nan.0)
+(set-component-connected #t open-resistor)
+(test-assert (finite? (surrogate-predict guarded open-stages)))
+(test-assert (finite? (assq-ref (surrogate-statistics guarded) 'residual-rms)))
+(test-end "non-finite-costs")
+
+(test-end "surrogate-test")
@@ -0,0 +1,40 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (srfi srfi-64))
+
+(test-begin "topology-test")
+
+(define range-floor (floor-preferred-value 10))
+(define range-ceil (ceiling-preferred-value 10000))
+(define resistor (make-component 'resistor (nearest-preferred-value 1000) range-floor range-ceil))
+(define capacitor 
+  (make-component 'capacitor 
+                  (nearest-preferred-value 1e-7) 
+                  (floor-preferred-value 1e-9) 
+                  (ceiling-preferred-value 1e-5)))
+
+(test-begin "canonical-loads")
+(test-equal 1 (vector-length (enumerate-load-topologies (vector resistor) 1)))
+(test-equal 3 (vector-length (enumerate-load-topologies (vector resistor) 2)))
+(test-equal 7 (vector-length (enumerate-load-topologies (vector resistor) 3)))
+(test-equal 17 (vector-length (enumerate-load-topologies (vector resistor) 4)))
+(test-equal 8 (vector-length (enumerate-load-topologies (vector resistor capacitor) 2)))
+(test-end "canonical-loads")
+
+(test-begin "alternating-ladders")
+(test-equal 4 (vector-length (enumerate-ladder-topologies (vector resistor capacitor) 1 1)))
+(test-equal 12 (vector-length (enumerate-ladder-topologies (vector resistor capacitor) 1 2)))
+(test-equal 5 (vector-length (enumerate-ladder-topologies (vector resistor capacitor) 1 2 5)))
+(test-end "alternating-ladders")
+
+(test-begin "optimize-values")
+(define target (make-response-target (vector 10.0 100.0 1000.0) (vector 1.0 1.0 1.0)))
+(define ladders (enumerate-ladder-topologies (vector resistor capacitor) 1 2))
+(define costs (optimize-topology-values ladders target))
+(test-equal (vector-length ladders) (vector-length costs))
+(test-approximate 
+  (vector-ref costs 0) 
+  (filter-cost (vector-ref ladders 0) target) 
+  1e-9)
+(test-end "optimize-values")
+
+(test-end "topology-test")
@@ -0,0 +1,153 @@
+(load-extension "filtopt" "init_filtopt")
+(use-modules (ice-9 textual-ports)
+             (rnrs bytevectors)
+             (srfi srfi-1)
+             (srfi srfi-64))
+
+(test-begin "trace-test")
+
+;; A strict reader for the JSON that trace-write emits: objects become
+;; alists with string keys, arrays become lists. Raises on malformed input.
+(define (parse-json text)
+  (define position 0)
+  (define (peek) (and (< position (string-length text)) (string-ref text position)))
+  (define (next!)
+    (let ((character (peek)))
+      (unless character (error "unexpected end of JSON"))
+      (set! position (+ position 1))
+      character))
+  (define (skip-whitespace!)
+    (when (and (peek) (char-whitespace? (peek)))
+      (set! position (+ position 1))
+      (skip-whitespace!)))
+  (define (expect! character)
+    (skip-whitespace!)
+    (unless (eqv? (next!) character) (error "expected" character position)))
+  (define (parse-string)
+    (expect! #\")
+    (let loop ((characters '()))
+      (let ((character (next!)))
+        (cond ((eqv? character #\") (list->string (reverse characters)))
+              ((eqv? character #\\)
+               (let ((escaped (next!)))
+                 (case escaped
+                   ((#\" #\\ #\/) (loop (cons escaped characters)))
+                   ((#\n) (loop (cons #\newline characters)))
+                   ((#\u) (let ((code (string->number (substring text position (+ position 4)) 16)))
+                            (set! position (+ position 4))
+                            (loop (cons (integer->char code) characters))))
+                   (else (error "bad escape" escaped)))))
+              ((char<? character #\space) (error "control character in string"))
+              (else (loop (cons character characters)))))))
+  (define (parse-number)
+    (let ((start position))
+      (while (and (peek) (or (char-numeric? (peek)) (memv (peek) '(#\- #\+ #\. #\e #\E))))
+        (set! position (+ position 1)))
+      (or (string->number (substring text start position)) (error "bad number" start))))
+  (define (parse-sequence close parse-element)
+    (skip-whitespace!)
+    (if (eqv? (peek) close)
+        (begin (next!) '())
+        (let loop ((elements (list (parse-element))))
+          (skip-whitespace!)
+          (let ((character (next!)))
+            (cond ((eqv? character #\,) (loop (cons (parse-element) elements)))
+                  ((eqv? character close) (reverse elements))
+                  (else (error "expected" close position)))))))
+  (define (parse-member)
+    (let ((key (parse-string)))
+      (expect! #\:)
+      (cons key (parse-value))))
+  (define (parse-literal word value)
+    (unless (and (<= (+ position (string-length word)) (string-length text))
+                 (string=? word (substring text position (+ position (string-length word)))))
+      (error "bad literal" position))
+    (set! position (+ position (string-length word)))
+    value)
+  (define (parse-value)
+    (skip-whitespace!)
+    (let ((character (peek)))
+      (cond ((eqv? character #\{) (next!) (parse-sequence #\} parse-member))
+            ((eqv? character #\[) (next!) (parse-sequence #\] parse-value))
+            ((eqv? character #\") (parse-string))
+            ((eqv? character #\t) (parse-literal "true" #t))
+            ((eqv? character #\f) (parse-literal "false" #f))
+            ((eqv? character #\n) (parse-literal "null" 'null))
+            (else (parse-number)))))
+  (let ((value (parse-value)))
+    (skip-whitespace!)
+    (when (peek) (error "trailing data" position))
+    value))
+
+(define (field event key)
+  (let ((entry (assoc key event)))
+    (and entry (cdr entry))))
+
+;; Every B has a matching E on the same thread, properly nested.
+(define (balanced? events)
+  (let loop ((events events) (open '()))
+    (if (null? events)
+        (null? open)
+        (let* ((event (car events))
+               (phase (field event "ph"))
+               (key (cons (field event "tid") (field event "name"))))
+          (cond ((string=? phase "B") (loop (cdr events) (cons key open)))
+                ((string=? phase "E")
+                 (and (pair? open) (equal? (car open) key) (loop (cdr events) (cdr open))))
+                (else (loop (cdr events) open)))))))
+
+(define (make-limited-component type value)
+  (make-component type
+                  (nearest-preferred-value value)
+                  (floor-preferred-value (/ value 100))
+                  (ceiling-preferred-value (* value 100))))
+
+(define stages
+  (vector (make-series-filter-stage (make-component-load (make-limited-component 'resistor 1000)))
+          (make-shunt-filter-stage (make-component-load (make-limited-component 'capacitor 1e-7)))))
+(define target (make-response-target (vector 10.0 100.0 1000.0) (vector 1.0 1.0 1.0)))
+
+(define trace-file
+  (let* ((port (mkstemp! (string-copy "/tmp/filtopt-trace-XXXXXX")))
+         (name (port-filename port)))
+    (close-port port)
+    name))
+
+(trace-clear!)
+(set-tracing! #t)
+(trace-begin "test")
+(filter-cost stages target)
+(filter_voltage_gain 100.0 stages)
+(decode-filters (encode-filters (vector stages)))
+;; Errors raised inside traced spans must still close them.
+(test-assert (not (false-if-exception (decode-filters (u8-list->bytevector '(1 2 3))))))
+(test-assert (not (false-if-exception (filter-cost (vector 'not-a-stage) target))))
+(gc)
+(trace-end "test")
+(set-tracing! #f)
+
+(test-begin "valid-balanced-json")
+(define written (trace-write trace-file))
+(define trace (parse-json (call-with-input-file trace-file get-string-all)))
+(define events (field trace "traceEvents"))
+(test-equal written (length events))
+(test-assert (balanced? events))
+(test-assert (every (lambda (event) (and (string? (field event "name")) (real? (field event "ts"))))
+                    events))
+(test-assert (any (lambda (event) (equal? (field event "name") "decode-filters")) events))
+(test-assert (any (lambda (event)
+                    (and (equal? (field event "name") "gc")
+                         (equal? (field event "ph") "X")
+                         (>= (field event "dur") 0)))
+                  events))
+(test-end "valid-balanced-json")
+
+(test-begin "clear")
+(trace-clear!)
+(test-equal 0 (trace-write trace-file))
+(test-equal '() (field (parse-json (call-with-input-file trace-file get-string-all)) "traceEvents"))
+(test-end "clear")
+
+(delete-file trace-file)
+
+(test-end "trace-test")